@@ -0,0 +1,325 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fields.h"
+
+/*
+ * Measure the throughput of converting fields to numbers, compared with the
+ * corresponding C library functions. The input consists of prices, such as
+ * 12345.67, volumes, such as 1234567, and timestamps, such as
+ * 2016-01-04 09:30:00.
+ */
+
+#define VALUES  (4 * 1024 * 1024)
+#define ROUNDS  5
+
+static void
+die(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal: ");
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+
+    exit(EXIT_FAILURE);
+}
+
+static char *
+generate(struct fields_field *fields, const char *format)
+{
+    unsigned long seed = 1;
+    char *buffer;
+    size_t size;
+    size_t i;
+
+    buffer = malloc(VALUES * 32);
+    if (buffer == NULL)
+        die("malloc");
+
+    size = 0;
+
+    for (i = 0; i < VALUES; i++) {
+        int length;
+
+        seed = seed * 1103515245 + 12345;
+
+        length = sprintf(buffer + size, format, (seed >> 16) % 100000,
+            (seed >> 8) % 100);
+
+        fields[i].value = buffer + size;
+        fields[i].length = length;
+
+        size += length + 1;
+    }
+
+    return buffer;
+}
+
+static char *
+generate_timestamps(struct fields_field *fields)
+{
+    unsigned long seed = 1;
+    char *buffer;
+    size_t size;
+    size_t i;
+
+    buffer = malloc(VALUES * 32);
+    if (buffer == NULL)
+        die("malloc");
+
+    size = 0;
+
+    for (i = 0; i < VALUES; i++) {
+        int length;
+
+        seed = seed * 1103515245 + 12345;
+
+        length = sprintf(buffer + size, "%04lu-%02lu-%02lu %02lu:%02lu:%02lu",
+            1970 + (seed >> 8) % 60, 1 + (seed >> 12) % 12,
+            1 + (seed >> 16) % 28, (seed >> 20) % 24, (seed >> 24) % 60,
+            (seed >> 4) % 60);
+
+        fields[i].value = buffer + size;
+        fields[i].length = length;
+
+        size += length + 1;
+    }
+
+    return buffer;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static volatile double sink;
+
+static void
+report(const char *name, double best)
+{
+    printf("%s: %d values, %.1f M values/s\n", name, VALUES,
+        VALUES / best / 1e6);
+}
+
+static void
+run_double(const struct fields_field *fields)
+{
+    double best_libc = 0;
+    double best = 0;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        double start, elapsed, sum = 0;
+        size_t j;
+
+        start = now();
+
+        for (j = 0; j < VALUES; j++)
+            sum += strtod(fields[j].value, NULL);
+
+        elapsed = now() - start;
+        if (best_libc == 0 || elapsed < best_libc)
+            best_libc = elapsed;
+
+        sink += sum;
+        sum = 0;
+
+        start = now();
+
+        for (j = 0; j < VALUES; j++) {
+            double value;
+
+            if (fields_field_double(&fields[j], &value) != 0)
+                die("fields_field_double");
+
+            sum += value;
+        }
+
+        elapsed = now() - start;
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+
+        sink += sum;
+    }
+
+    report("strtod", best_libc);
+    report("fields_field_double", best);
+}
+
+static void
+run_decimal(const struct fields_field *fields)
+{
+    double best = 0;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        double start, elapsed;
+        int64_t sum = 0;
+        size_t j;
+
+        start = now();
+
+        for (j = 0; j < VALUES; j++) {
+            int64_t value;
+
+            if (fields_field_decimal(&fields[j], 2, &value) != 0)
+                die("fields_field_decimal");
+
+            sum += value;
+        }
+
+        elapsed = now() - start;
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+
+        sink += sum;
+    }
+
+    report("fields_field_decimal", best);
+}
+
+static void
+run_int64(const struct fields_field *fields)
+{
+    double best_libc = 0;
+    double best = 0;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        double start, elapsed;
+        int64_t sum = 0;
+        size_t j;
+
+        start = now();
+
+        for (j = 0; j < VALUES; j++)
+            sum += strtoll(fields[j].value, NULL, 10);
+
+        elapsed = now() - start;
+        if (best_libc == 0 || elapsed < best_libc)
+            best_libc = elapsed;
+
+        sink += sum;
+        sum = 0;
+
+        start = now();
+
+        for (j = 0; j < VALUES; j++) {
+            int64_t value;
+
+            if (fields_field_int64(&fields[j], &value) != 0)
+                die("fields_field_int64");
+
+            sum += value;
+        }
+
+        elapsed = now() - start;
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+
+        sink += sum;
+    }
+
+    report("strtoll", best_libc);
+    report("fields_field_int64", best);
+}
+
+static void
+run_timestamp(const struct fields_field *fields)
+{
+    double best_libc = 0;
+    double best = 0;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        double start, elapsed;
+        int64_t sum = 0;
+        size_t j;
+
+        start = now();
+
+        for (j = 0; j < VALUES; j++) {
+            struct tm tm;
+
+            memset(&tm, 0, sizeof(tm));
+            tm.tm_isdst = -1;
+
+            if (strptime(fields[j].value, "%Y-%m-%d %H:%M:%S", &tm) == NULL)
+                die("strptime");
+
+            sum += mktime(&tm);
+        }
+
+        elapsed = now() - start;
+        if (best_libc == 0 || elapsed < best_libc)
+            best_libc = elapsed;
+
+        sink += sum;
+        sum = 0;
+
+        start = now();
+
+        for (j = 0; j < VALUES; j++) {
+            int64_t value;
+
+            if (fields_field_timestamp(&fields[j], &value) != 0)
+                die("fields_field_timestamp");
+
+            sum += value;
+        }
+
+        elapsed = now() - start;
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+
+        sink += sum;
+    }
+
+    report("strptime+mktime", best_libc);
+    report("fields_field_timestamp", best);
+}
+
+int
+main(void)
+{
+    struct fields_field *fields;
+    char *buffer;
+
+    fields = malloc(VALUES * sizeof(*fields));
+    if (fields == NULL)
+        die("malloc");
+
+    buffer = generate(fields, "%lu.%02lu");
+    run_double(fields);
+    run_decimal(fields);
+    free(buffer);
+
+    buffer = generate(fields, "%lu%02lu");
+    run_int64(fields);
+    free(buffer);
+
+    buffer = generate_timestamps(fields);
+    run_timestamp(fields);
+    free(buffer);
+
+    free(fields);
+
+    return 0;
+}
@@ -0,0 +1,491 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "fields.h"
+#include "fields_posix.h"
+
+/*
+ * Measure the throughput of reading synthetic datasets of different shapes.
+ * The datasets without quoting are generated in three formats: as
+ * comma-separated values, as tab-separated values and with a delimiter
+ * that has no specialized parser. The others are comma-separated values.
+ * Each dataset is read from a buffer, a file stream and a file descriptor,
+ * both with a reader and with a push parser that is fed the same input in
+ * chunks.
+ *
+ * The output has a header line followed by one tab-separated line per run.
+ * Cycles are time stamp counter ticks, which are not available on all
+ * machines.
+ */
+
+#define INPUT_SIZE  (32 * 1024 * 1024)
+#define CHUNK_SIZE  (64 * 1024)
+#define ROUNDS      3
+
+enum {
+    SOURCE_BUFFER,
+    SOURCE_FILE,
+    SOURCE_FD
+};
+
+static const char *source_names[] = { "buffer", "file", "fd" };
+
+struct input {
+    const char                 *buffer;
+    size_t                      size;
+    FILE                       *file;
+    int                         source;
+    const struct fields_format *format;
+};
+
+struct result {
+    unsigned long   records;
+    double          elapsed;
+    uint64_t        cycles;
+};
+
+static void
+die(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal: ");
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+
+    exit(EXIT_FAILURE);
+}
+
+static unsigned long
+next(unsigned long *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+
+    return (*seed >> 16) & 0x7fff;
+}
+
+/*
+ * Datasets
+ * ========
+ */
+
+static size_t
+generate_narrow(char *buffer, size_t buffer_size, char delimiter)
+{
+    unsigned long seed = 1;
+    size_t size = 0;
+
+    while (size + 64 < buffer_size) {
+        unsigned long id = next(&seed);
+        unsigned long count = next(&seed) % 100;
+        unsigned long flag = next(&seed) % 10;
+
+        size += sprintf(buffer + size, "%lu%c%lu%c%lu\n", id, delimiter,
+            count, delimiter, flag);
+    }
+
+    return size;
+}
+
+static size_t
+generate_wide(char *buffer, size_t buffer_size, char delimiter)
+{
+    unsigned long seed = 2;
+    size_t size = 0;
+
+    while (size + 200 * 16 < buffer_size) {
+        unsigned i;
+
+        for (i = 0; i < 200; i++) {
+            unsigned long whole = next(&seed);
+            unsigned long cents = next(&seed) % 100;
+
+            size += sprintf(buffer + size, "%lu.%02lu%c", whole, cents,
+                i + 1 < 200 ? delimiter : '\n');
+        }
+    }
+
+    return size;
+}
+
+static size_t
+generate_quoted(char *buffer, size_t buffer_size, char delimiter)
+{
+    unsigned long seed = 3;
+    size_t size = 0;
+
+    while (size + 8 * 48 < buffer_size) {
+        unsigned i;
+
+        for (i = 0; i < 8; i++) {
+            char end = i + 1 < 8 ? delimiter : '\n';
+            unsigned long kind = next(&seed) % 4;
+            unsigned long first = next(&seed);
+            unsigned long second;
+
+            switch (kind) {
+            case 0:
+                size += sprintf(buffer + size, "\"say \"\"%lu\"\"\"%c", first,
+                    end);
+                break;
+            case 1:
+                second = next(&seed);
+                size += sprintf(buffer + size, "\"line %lu\nline %lu\"%c",
+                    first, second, end);
+                break;
+            case 2:
+                second = next(&seed);
+                size += sprintf(buffer + size, "\"%lu%c \"\"%lu\"\"%c\r\n\"%c",
+                    first, delimiter, second, delimiter, end);
+                break;
+            default:
+                size += sprintf(buffer + size, "\"item %lu\"%c", first, end);
+                break;
+            }
+        }
+    }
+
+    return size;
+}
+
+static size_t
+generate_utf8(char *buffer, size_t buffer_size, char delimiter)
+{
+    static const char *words[] = {
+        "Zürich", "Ålesund", "København", "Москва", "Αθήνα", "東京",
+        "서울", "São Paulo", "Kraków", "İstanbul"
+    };
+    unsigned long seed = 4;
+    size_t size = 0;
+
+    while (size + 128 < buffer_size) {
+        unsigned long id = next(&seed);
+        const char *city = words[next(&seed) % 10];
+        const char *from = words[next(&seed) % 10];
+        const char *to = words[next(&seed) % 10];
+        unsigned long whole = next(&seed);
+        unsigned long cents = next(&seed) % 100;
+
+        size += sprintf(buffer + size,
+            "%lu%c%s%c\"%s%c %s\"%c%lu.%02lu\r\n", id, delimiter, city,
+            delimiter, from, delimiter, to, delimiter, whole, cents);
+    }
+
+    return size;
+}
+
+static size_t
+generate_giant(char *buffer, size_t buffer_size, char delimiter)
+{
+    unsigned long seed = 5;
+    size_t size = 0;
+
+    while (size + 64 < buffer_size) {
+        unsigned long first;
+        unsigned long second;
+
+        if (next(&seed) % 8 == 0) {
+            first = next(&seed);
+            second = next(&seed);
+            size += sprintf(buffer + size, "\"%lu%c%lu\"%c", first, delimiter,
+                second, delimiter);
+        }
+        else {
+            first = next(&seed);
+            size += sprintf(buffer + size, "%lu%c", first, delimiter);
+        }
+    }
+
+    buffer[size - 1] = '\n';
+
+    return size;
+}
+
+/*
+ * A format without quoting whose delimiter has no specialized parser.
+ */
+static const struct fields_format unquoted = { ';', '\0' };
+
+static const struct {
+    const char *name;
+    size_t (*generate)(char *, size_t, char);
+    const char *format_name;
+    const struct fields_format *format;
+} datasets[] = {
+    { "narrow", generate_narrow, "csv", &fields_csv },
+    { "narrow", generate_narrow, "tsv", &fields_tsv },
+    { "narrow", generate_narrow, "unquoted", &unquoted },
+    { "wide", generate_wide, "csv", &fields_csv },
+    { "wide", generate_wide, "tsv", &fields_tsv },
+    { "wide", generate_wide, "unquoted", &unquoted },
+    { "quoted", generate_quoted, "csv", &fields_csv },
+    { "crlf-utf8", generate_utf8, "csv", &fields_csv },
+    { "giant-record", generate_giant, "csv", &fields_csv }
+};
+
+/*
+ * Runs
+ * ====
+ */
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t
+ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void
+rewind_input(const struct input *input)
+{
+    switch (input->source) {
+    case SOURCE_FILE:
+        rewind(input->file);
+        break;
+    case SOURCE_FD:
+        if (lseek(fileno(input->file), 0, SEEK_SET) != 0)
+            die("lseek");
+        break;
+    default:
+        break;
+    }
+}
+
+static unsigned long
+run_reader(const struct input *input, struct fields_record *record)
+{
+    struct fields_reader *reader;
+    unsigned long records = 0;
+
+    switch (input->source) {
+    case SOURCE_FILE:
+        reader = fields_read_file(input->file, input->format, NULL);
+        break;
+    case SOURCE_FD:
+        reader = fields_read_fd(fileno(input->file), input->format, NULL);
+        break;
+    default:
+        reader = fields_read_buffer(input->buffer, input->size,
+            input->format, NULL);
+        break;
+    }
+
+    if (reader == NULL)
+        die("%s reader", source_names[input->source]);
+
+    while (fields_reader_read(reader, record) == 0)
+        records++;
+
+    if (fields_reader_error(reader) != 0)
+        die("%s", fields_reader_strerror(fields_reader_error(reader)));
+
+    fields_reader_free(reader);
+
+    return records;
+}
+
+/*
+ * Read the next chunk of input for a push parser. A buffer is fed in place.
+ */
+static size_t
+read_chunk(const struct input *input, size_t offset, char *chunk,
+    const char **result)
+{
+    ssize_t length;
+    size_t size;
+
+    switch (input->source) {
+    case SOURCE_FILE:
+        size = fread(chunk, 1, CHUNK_SIZE, input->file);
+        if (ferror(input->file))
+            die("fread");
+        *result = chunk;
+        return size;
+    case SOURCE_FD:
+        length = read(fileno(input->file), chunk, CHUNK_SIZE);
+        if (length < 0)
+            die("read");
+        *result = chunk;
+        return length;
+    default:
+        size = input->size - offset;
+        *result = input->buffer + offset;
+        return size < CHUNK_SIZE ? size : CHUNK_SIZE;
+    }
+}
+
+static unsigned long
+run_parser(const struct input *input, struct fields_record *record,
+    char *chunk)
+{
+    struct fields_parser *parser;
+    unsigned long records = 0;
+    size_t offset = 0;
+
+    parser = fields_parser_alloc(input->format, NULL);
+    if (parser == NULL)
+        die("fields_parser_alloc");
+
+    for (;;) {
+        const char *buffer;
+        size_t size;
+
+        if (fields_parser_read(parser, record) == 0) {
+            records++;
+            continue;
+        }
+
+        if (!fields_parser_starved(parser))
+            break;
+
+        size = read_chunk(input, offset, chunk, &buffer);
+        offset += size;
+
+        if (fields_parser_feed(parser, buffer, size) != 0)
+            die("fields_parser_feed");
+    }
+
+    if (fields_parser_error(parser) != 0)
+        die("%s", fields_reader_strerror(fields_parser_error(parser)));
+
+    fields_parser_free(parser);
+
+    return records;
+}
+
+static unsigned long
+run(const char *name, const char *format_name, const struct input *input,
+    int push, struct fields_record *record, char *chunk)
+{
+    struct result best = { 0, 0, 0 };
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        struct result result;
+        uint64_t start_ticks;
+        double start;
+
+        rewind_input(input);
+
+        start = now();
+        start_ticks = ticks();
+
+        if (push)
+            result.records = run_parser(input, record, chunk);
+        else
+            result.records = run_reader(input, record);
+
+        result.cycles = ticks() - start_ticks;
+        result.elapsed = now() - start;
+
+        if (best.elapsed == 0 || result.elapsed < best.elapsed)
+            best = result;
+    }
+
+    printf("%s\t%s\t%s\t%s\t%lu\t%lu\t%.2f\t%.0f", name, format_name,
+        source_names[input->source], push ? "parser" : "reader",
+        (unsigned long)input->size, best.records,
+        input->size / best.elapsed / 1e6, best.records / best.elapsed);
+
+    if (best.cycles > 0)
+        printf("\t%.3f\n", (double)best.cycles / input->size);
+    else
+        printf("\t-\n");
+
+    return best.records;
+}
+
+int
+main(void)
+{
+    struct fields_record *record;
+    char *buffer;
+    char *chunk;
+    size_t i;
+
+    buffer = malloc(INPUT_SIZE);
+    if (buffer == NULL)
+        die("malloc");
+
+    chunk = malloc(CHUNK_SIZE);
+    if (chunk == NULL)
+        die("malloc");
+
+    record = fields_record_alloc(NULL);
+    if (record == NULL)
+        die("fields_record_alloc");
+
+    printf("dataset\tformat\tsource\tparser\tbytes\trecords\tMB/s\trecords/s\t"
+        "cycles/byte\n");
+
+    for (i = 0; i < sizeof(datasets) / sizeof(datasets[0]); i++) {
+        struct input input;
+        unsigned long records = 0;
+        int push;
+
+        input.buffer = buffer;
+        input.format = datasets[i].format;
+        input.size = datasets[i].generate(buffer, INPUT_SIZE,
+            input.format->delimiter);
+
+        input.file = tmpfile();
+        if (input.file == NULL)
+            die("tmpfile");
+
+        if (fwrite(buffer, 1, input.size, input.file) != input.size ||
+            fflush(input.file) != 0)
+            die("fwrite");
+
+        for (input.source = SOURCE_BUFFER; input.source <= SOURCE_FD;
+            input.source++) {
+            for (push = 0; push <= 1; push++) {
+                unsigned long result;
+
+                result = run(datasets[i].name, datasets[i].format_name,
+                    &input, push, record, chunk);
+                if (records != 0 && result != records)
+                    die("%s: %lu records, expected %lu", datasets[i].name,
+                        result, records);
+
+                records = result;
+            }
+        }
+
+        fclose(input.file);
+    }
+
+    fields_record_free(record);
+
+    free(chunk);
+    free(buffer);
+
+    return 0;
+}
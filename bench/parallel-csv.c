@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fields.h"
+#include "fields_posix.h"
+
+/*
+ * Measure how the throughput of reading comma-separated values from a
+ * buffer scales with the number of threads. Every other field of the input
+ * is quoted and some of the quoted fields contain line breaks. Both the
+ * sequential and the parallel runs are timed from the allocation of the
+ * reader, which includes starting the threads, to the last record.
+ */
+
+#define COLUMNS     20
+#define INPUT_SIZE  (128 * 1024 * 1024)
+#define ROUNDS      3
+
+static void
+die(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal: ");
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+
+    exit(EXIT_FAILURE);
+}
+
+static size_t
+generate(char *buffer, size_t buffer_size)
+{
+    unsigned long seed = 1;
+    size_t size = 0;
+
+    while (size + COLUMNS * 32 < buffer_size) {
+        unsigned i;
+
+        for (i = 0; i < COLUMNS; i++) {
+            char delimiter = i + 1 < COLUMNS ? ',' : '\n';
+
+            seed = seed * 1103515245 + 12345;
+
+            if (i % 2 == 0)
+                size += sprintf(buffer + size, "%lu%c", (seed >> 16) % 100000,
+                    delimiter);
+            else if ((seed >> 8) % 16 == 0)
+                size += sprintf(buffer + size, "\"%lu,\n\"\"%lu\"\"\"%c",
+                    (seed >> 16) % 1000, (seed >> 4) % 1000, delimiter);
+            else
+                size += sprintf(buffer + size, "\"item %lu\"%c",
+                    (seed >> 16) % 100000, delimiter);
+        }
+    }
+
+    return size;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *name, unsigned long records, size_t size, double best)
+{
+    printf("%s: %lu records, %lu bytes, %.2f GB/s\n", name, records,
+        (unsigned long)size, size / best / 1e9);
+}
+
+static void
+run(const char *buffer, size_t size)
+{
+    struct fields_record *record;
+    double best = 0;
+    unsigned long records = 0;
+    int i;
+
+    record = fields_record_alloc(NULL);
+    if (record == NULL)
+        die("fields_record_alloc");
+
+    for (i = 0; i < ROUNDS; i++) {
+        struct fields_reader *reader;
+        double start, elapsed;
+
+        start = now();
+
+        reader = fields_read_buffer(buffer, size, &fields_csv, NULL);
+        if (reader == NULL)
+            die("fields_read_buffer");
+
+        records = 0;
+
+        while (fields_reader_read(reader, record) == 0)
+            records++;
+
+        elapsed = now() - start;
+
+        if (fields_reader_error(reader) != 0)
+            die("%s", fields_reader_strerror(fields_reader_error(reader)));
+
+        fields_reader_free(reader);
+
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    report("parallel-csv-sequential", records, size, best);
+
+    fields_record_free(record);
+}
+
+static void
+run_parallel(const char *buffer, size_t size, unsigned int threads)
+{
+    struct fields_record *record;
+    double best = 0;
+    unsigned long records = 0;
+    char name[64];
+    int i;
+
+    record = fields_record_alloc(NULL);
+    if (record == NULL)
+        die("fields_record_alloc");
+
+    for (i = 0; i < ROUNDS; i++) {
+        struct fields_parallel *parallel;
+        double start, elapsed;
+
+        start = now();
+
+        parallel = fields_parallel_alloc(buffer, size, &fields_csv, NULL,
+            threads);
+        if (parallel == NULL)
+            die("fields_parallel_alloc");
+
+        records = 0;
+
+        while (fields_parallel_read(parallel, record) == 0)
+            records++;
+
+        elapsed = now() - start;
+
+        if (fields_parallel_error(parallel) != 0)
+            die("%s", fields_reader_strerror(fields_parallel_error(parallel)));
+
+        fields_parallel_free(parallel);
+
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    sprintf(name, "parallel-csv-%u", threads);
+    report(name, records, size, best);
+
+    fields_record_free(record);
+}
+
+int
+main(void)
+{
+    char *buffer;
+    size_t size;
+    long online;
+    unsigned int threads;
+
+    buffer = malloc(INPUT_SIZE);
+    if (buffer == NULL)
+        die("malloc");
+
+    size = generate(buffer, INPUT_SIZE);
+
+    online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1)
+        online = 1;
+
+    run(buffer, size);
+
+    for (threads = 1; threads <= (unsigned long)online; threads *= 2)
+        run_parallel(buffer, size, threads);
+
+    if ((threads / 2) != (unsigned long)online)
+        run_parallel(buffer, size, online);
+
+    free(buffer);
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fields.h"
+
+/*
+ * Measure the throughput of reading comma-separated values from a buffer and
+ * writing them back to another buffer. Every other field of the input is
+ * quoted, some of them needlessly, and some of the quoted fields contain
+ * delimiters and quote characters.
+ */
+
+#define COLUMNS     20
+#define INPUT_SIZE  (64 * 1024 * 1024)
+#define ROUNDS      5
+
+static void
+die(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal: ");
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+
+    exit(EXIT_FAILURE);
+}
+
+static size_t
+generate(char *buffer, size_t buffer_size)
+{
+    unsigned long seed = 1;
+    size_t size = 0;
+
+    while (size + COLUMNS * 32 < buffer_size) {
+        unsigned i;
+
+        for (i = 0; i < COLUMNS; i++) {
+            char delimiter = i + 1 < COLUMNS ? ',' : '\n';
+
+            seed = seed * 1103515245 + 12345;
+
+            if (i % 2 == 0)
+                size += sprintf(buffer + size, "%lu.%02lu%c",
+                    (seed >> 16) % 100000, (seed >> 8) % 100, delimiter);
+            else if ((seed >> 8) % 16 == 0)
+                size += sprintf(buffer + size, "\"%lu, \"\"%lu\"\"\"%c",
+                    (seed >> 16) % 1000, (seed >> 4) % 1000, delimiter);
+            else
+                size += sprintf(buffer + size, "\"item %lu\"%c",
+                    (seed >> 16) % 100000, delimiter);
+        }
+    }
+
+    return size;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run(const char *name, const char *buffer, size_t size, char *output,
+    size_t output_size, const struct fields_settings *settings)
+{
+    struct fields_record *record;
+    double best = 0;
+    unsigned long records = 0;
+    size_t length = 0;
+    int i;
+
+    record = fields_record_alloc(settings);
+    if (record == NULL)
+        die("fields_record_alloc");
+
+    for (i = 0; i < ROUNDS; i++) {
+        struct fields_reader *reader;
+        struct fields_writer *writer = NULL;
+        double start, elapsed;
+
+        reader = fields_read_buffer(buffer, size, &fields_csv, settings);
+        if (reader == NULL)
+            die("fields_read_buffer");
+
+        if (output != NULL) {
+            writer = fields_write_buffer(output, output_size, &length,
+                &fields_csv, settings);
+            if (writer == NULL)
+                die("fields_write_buffer");
+        }
+
+        records = 0;
+
+        start = now();
+
+        while (fields_reader_read(reader, record) == 0) {
+            if (writer != NULL && fields_writer_write_record(writer,
+                record) != 0)
+                break;
+
+            records++;
+        }
+
+        if (writer != NULL)
+            fields_writer_flush(writer);
+
+        elapsed = now() - start;
+
+        if (fields_reader_error(reader) != 0)
+            die("%s", fields_reader_strerror(fields_reader_error(reader)));
+
+        if (writer != NULL) {
+            if (fields_writer_error(writer) != 0)
+                die("%s", fields_writer_strerror(fields_writer_error(writer)));
+
+            fields_writer_free(writer);
+        }
+
+        fields_reader_free(reader);
+
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("%s: %lu records, %lu bytes in, %lu bytes out, %.2f GB/s\n", name,
+        records, (unsigned long)size, (unsigned long)length, size / best / 1e9);
+
+    fields_record_free(record);
+}
+
+int
+main(void)
+{
+    struct fields_settings settings;
+    char *buffer;
+    char *output;
+    size_t size;
+
+    buffer = malloc(INPUT_SIZE);
+    if (buffer == NULL)
+        die("malloc");
+
+    output = malloc(INPUT_SIZE);
+    if (output == NULL)
+        die("malloc");
+
+    size = generate(buffer, INPUT_SIZE);
+
+    settings = fields_defaults;
+    run("read", buffer, size, NULL, 0, &settings);
+    run("round-trip", buffer, size, output, INPUT_SIZE, &settings);
+
+    settings.views = 1;
+    run("round-trip-views", buffer, size, output, INPUT_SIZE, &settings);
+
+    free(output);
+    free(buffer);
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fields.h"
+
+/*
+ * Measure the throughput of reading wide tab-separated values from a buffer.
+ * The input consists of 200 columns of numeric values per record, of which
+ * the projection reads two. Scanning passes all fields to callbacks instead.
+ */
+
+#define COLUMNS     200
+#define INPUT_SIZE  (64 * 1024 * 1024)
+#define ROUNDS      5
+
+static void
+die(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal: ");
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+
+    exit(EXIT_FAILURE);
+}
+
+static size_t
+generate(char *buffer, size_t buffer_size)
+{
+    unsigned long seed = 1;
+    size_t size = 0;
+
+    while (size + COLUMNS * 16 < buffer_size) {
+        unsigned i;
+
+        for (i = 0; i < COLUMNS; i++) {
+            seed = seed * 1103515245 + 12345;
+
+            size += sprintf(buffer + size, "%lu.%02lu%c", (seed >> 16) % 100000,
+                (seed >> 8) % 100, i + 1 < COLUMNS ? '\t' : '\n');
+        }
+    }
+
+    return size;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run(const char *name, const char *buffer, size_t size,
+    const struct fields_settings *settings)
+{
+    struct fields_record *record;
+    double best = 0;
+    unsigned long records = 0;
+    int i;
+
+    record = fields_record_alloc(settings);
+    if (record == NULL)
+        die("fields_record_alloc");
+
+    for (i = 0; i < ROUNDS; i++) {
+        struct fields_reader *reader;
+        double start, elapsed;
+
+        reader = fields_read_buffer(buffer, size, &fields_tsv, settings);
+        if (reader == NULL)
+            die("fields_read_buffer");
+
+        records = 0;
+
+        start = now();
+
+        while (fields_reader_read(reader, record) == 0)
+            records++;
+
+        elapsed = now() - start;
+
+        if (fields_reader_error(reader) != 0)
+            die("%s", fields_reader_strerror(fields_reader_error(reader)));
+
+        fields_reader_free(reader);
+
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("%s: %lu records, %lu bytes, %.2f GB/s\n", name, records,
+        (unsigned long)size, size / best / 1e9);
+
+    fields_record_free(record);
+}
+
+static void
+count_field(void *context, const char *value, size_t length, size_t index)
+{
+    unsigned long *fields = context;
+
+    (void)value;
+    (void)length;
+    (void)index;
+
+    fields[0]++;
+}
+
+static void
+count_record(void *context)
+{
+    unsigned long *fields = context;
+
+    fields[1]++;
+}
+
+static void
+run_scan(const char *name, const char *buffer, size_t size,
+    const struct fields_settings *settings)
+{
+    static const struct fields_callbacks callbacks = {
+        .on_field       = count_field,
+        .on_record_end  = count_record
+    };
+    unsigned long counts[2] = { 0, 0 };
+    double best = 0;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        struct fields_reader *reader;
+        double start, elapsed;
+
+        reader = fields_read_buffer(buffer, size, &fields_tsv, settings);
+        if (reader == NULL)
+            die("fields_read_buffer");
+
+        counts[0] = 0;
+        counts[1] = 0;
+
+        start = now();
+
+        if (fields_reader_scan(reader, &callbacks, counts) != 0)
+            die("%s", fields_reader_strerror(fields_reader_error(reader)));
+
+        elapsed = now() - start;
+
+        fields_reader_free(reader);
+
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("%s: %lu records, %lu bytes, %.2f GB/s\n", name, counts[1],
+        (unsigned long)size, size / best / 1e9);
+}
+
+int
+main(void)
+{
+    static const size_t projection[] = { 0, 6 };
+    struct fields_settings settings;
+    char *buffer;
+    size_t size;
+
+    buffer = malloc(INPUT_SIZE);
+    if (buffer == NULL)
+        die("malloc");
+
+    size = generate(buffer, INPUT_SIZE);
+
+    settings = fields_defaults;
+    run("wide-tsv", buffer, size, &settings);
+
+    settings.views = 1;
+    run("wide-tsv-views", buffer, size, &settings);
+
+    settings = fields_defaults;
+    settings.projection = projection;
+    settings.projection_size = sizeof(projection) / sizeof(projection[0]);
+    run("wide-tsv-projection", buffer, size, &settings);
+
+    settings = fields_defaults;
+    run_scan("wide-tsv-scan", buffer, size, &settings);
+
+    free(buffer);
+
+    return 0;
+}
@@ -6,7 +6,8 @@
 
 /*
  * Read tabular text data in the Yahoo! Finance Historical Prices format from
- * the standard input, print adjusted close prices to the standard output.
+ * the standard input, write dates and adjusted close prices as tab-separated
+ * values to the standard output.
  *
  * For testing, you can download the data for SPDR S&P 500 (SPY) at:
  *
@@ -33,12 +34,17 @@ int
 main(void)
 {
     struct fields_reader *reader;
+    struct fields_writer *writer;
     struct fields_record *record;
 
     reader = fields_read_file(stdin, &fields_csv, NULL);
     if (reader == NULL)
         die("fields_read_file");
 
+    writer = fields_write_file(stdout, &fields_tsv, NULL);
+    if (writer == NULL)
+        die("fields_write_file");
+
     record = fields_record_alloc(NULL);
     if (record == NULL)
         die("fields_record_alloc");
@@ -58,7 +64,17 @@ main(void)
         fields_record_field(record, 0, &date);
         fields_record_field(record, 6, &price);
 
-        printf("%s\t%s\n", date.value, price.value);
+        fields_writer_write_field(writer, &date);
+        fields_writer_write_field(writer, &price);
+
+        if (fields_writer_end_record(writer) != 0)
+            break;
+    }
+
+    if (fields_writer_flush(writer) != 0) {
+        int error = fields_writer_error(writer);
+
+        die("%s", fields_writer_strerror(error));
     }
 
     if (fields_reader_error(reader) != 0) {
@@ -74,6 +90,7 @@ main(void)
     }
 
     fields_record_free(record);
+    fields_writer_free(writer);
     fields_reader_free(reader);
 
     return 0;
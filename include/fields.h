@@ -23,6 +23,7 @@
 #ifndef FIELDS_H
 #define FIELDS_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -55,7 +56,7 @@ extern "C" {
  */
 
 /*
- * The input format.
+ * The input or output format.
  */
 struct fields_format;
 
@@ -77,7 +78,7 @@ extern const struct fields_format fields_tsv;
  */
 
 /*
- * The settings for readers and records.
+ * The settings for readers, writers and records.
  */
 struct fields_settings;
 
@@ -99,6 +100,11 @@ struct fields_field
     /*
      * The value. The value is a sequence of zero or more bytes and is followed
      * by a NUL character. The value may contain NUL characters.
+     *
+     * If the record uses views, the value may point into the source buffer
+     * instead. Such a value is not followed by a NUL character and remains
+     * valid only until the next read from the reader or until the reader is
+     * deallocated, whichever comes first. Always use the length.
      */
     const char *value;
 
@@ -157,103 +163,1015 @@ int fields_record_field(const struct fields_record *, unsigned int,
  */
 size_t fields_record_size(const struct fields_record *);
 
+/*
+ * The memory footprint of a record, in bytes.
+ */
+struct fields_footprint {
+    /*
+     * The memory currently held by the record.
+     */
+    size_t  current;
+
+    /*
+     * The most memory the record has held at any time.
+     */
+    size_t  peak;
+};
+
+/*
+ * Get the memory footprint of the record.
+ *
+ * - record:    the record object
+ * - footprint: a footprint object
+ */
+void fields_record_footprint(const struct fields_record *,
+    struct fields_footprint *);
+
+/*
+ * Batches
+ * -------
+ */
+
+/*
+ * A batch is a sequence of zero or more records. The fields of all records
+ * are stored in one buffer.
+ */
+struct fields_batch;
+
+/*
+ * Allocate a batch. The batch expands as needed regardless of the settings.
+ * The settings apply to the records as they are read into the batch. If
+ * `settings` is `NULL`, the default settings are used.
+ *
+ * - settings: the settings for the records
+ *
+ * If successful, returns a batch object. Otherwise returns `NULL`.
+ */
+struct fields_batch *fields_batch_alloc(const struct fields_settings *);
+
+/*
+ * Deallocate the batch.
+ *
+ * - batch: the batch object
+ */
+void fields_batch_free(struct fields_batch *);
+
+/*
+ * Remove all records from the batch.
+ *
+ * - batch: the batch object
+ */
+void fields_batch_clear(struct fields_batch *);
+
+/*
+ * Copy a record to the end of the batch.
+ *
+ * - batch:  the batch object
+ * - record: a record object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_batch_push(struct fields_batch *, const struct fields_record *);
+
+/*
+ * Get the number of records in the batch.
+ *
+ * - batch: the batch object
+ *
+ * Returns the number of records in the batch.
+ */
+size_t fields_batch_size(const struct fields_batch *);
+
+/*
+ * Make a record refer to the record at the specified index. The fields of the
+ * record point into the batch and remain valid until the batch is cleared or
+ * deallocated. The operation fails if the index is too large or if the record
+ * cannot hold the fields.
+ *
+ * - batch:  the batch object
+ * - index:  an index
+ * - record: a record object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_batch_record(const struct fields_batch *, size_t,
+    struct fields_record *);
+
+/*
+ * Get the contents of the batch. The operation updates the value, field and
+ * record arrays:
+ *
+ * - `values` contains the fields of all records, each field followed by a
+ *   `NUL` character.
+ * - `fields` contains the offset of each field in `values`, followed by the
+ *   length of `values`.
+ * - `records` contains the index of the first field of each record in
+ *   `fields`, followed by the number of fields in the batch.
+ *
+ * Hence field `i` has the length `fields[i + 1] - fields[i] - 1`, and record
+ * `j` consists of the fields from `records[j]` up to `records[j + 1]`. The
+ * arrays remain valid until the batch is modified or deallocated.
+ *
+ * - batch:   the batch object
+ * - values:  a pointer to the value array
+ * - fields:  a pointer to the field array
+ * - records: a pointer to the record array
+ */
+void fields_batch_contents(const struct fields_batch *, const char **,
+    const size_t **, const size_t **);
+
+/*
+ * Columns
+ * -------
+ */
+
+/*
+ * A columns object holds a sequence of zero or more rows stored column by
+ * column. Each row is a record. A field missing from a record is null.
+ */
+struct fields_columns;
+
+/*
+ * A column follows the layout of an Apache Arrow string column.
+ */
+struct fields_column
+{
+    /*
+     * The values of all rows one after another. The values are not
+     * separated by any characters.
+     */
+    const char *values;
+
+    /*
+     * The offset of each value in `values`, followed by the length of
+     * `values`. The value at row `i` has the length
+     * `offsets[i + 1] - offsets[i]`. A null value has zero length.
+     */
+    const int32_t *offsets;
+
+    /*
+     * The validity bitmap. The bit `i % 8` of the byte `i / 8`, counting
+     * from the least significant bit, is set unless the value at row `i` is
+     * null.
+     */
+    const uint8_t *validity;
+
+    /*
+     * The number of null values.
+     */
+    size_t null_count;
+};
+
+/*
+ * Allocate a columns object with the specified number of columns. The object
+ * expands as needed regardless of the settings. Only the allocator of the
+ * settings applies to the object; the records are read with the settings of
+ * the reader. If `settings` is `NULL`, the default settings are used.
+ *
+ * - num_columns: the number of columns
+ * - settings:    the settings for the allocator
+ *
+ * If successful, returns a columns object. Otherwise returns `NULL`.
+ */
+struct fields_columns *fields_columns_alloc(size_t,
+    const struct fields_settings *);
+
+/*
+ * Deallocate the columns object.
+ *
+ * - columns: the columns object
+ */
+void fields_columns_free(struct fields_columns *);
+
+/*
+ * Remove all rows from the columns object.
+ *
+ * - columns: the columns object
+ */
+void fields_columns_clear(struct fields_columns *);
+
+/*
+ * Copy a record to the end of the columns object as a row. The operation
+ * fails if the record has more fields than there are columns or if a column
+ * grows beyond 2 GB.
+ *
+ * - columns: the columns object
+ * - record:  a record object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_columns_push(struct fields_columns *, const struct fields_record *);
+
+/*
+ * Get the number of rows in the columns object.
+ *
+ * - columns: the columns object
+ *
+ * Returns the number of rows in the columns object.
+ */
+size_t fields_columns_size(const struct fields_columns *);
+
+/*
+ * Get the column at the specified index. If successful, the operation
+ * updates the column object. Otherwise the operation does not alter the
+ * column object. The operation fails if the index is too large. The column
+ * remains valid until the columns object is modified or deallocated.
+ *
+ * - columns: the columns object
+ * - index:   an index
+ * - column:  a column object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_columns_column(const struct fields_columns *, size_t,
+    struct fields_column *);
+
+/*
+ * Conversions
+ * -----------
+ */
+
+/*
+ * Convert a field to a 64-bit integer. The field must consist of an optional
+ * sign followed by one or more decimal digits. If successful, the operation
+ * updates the result. The conversion does not depend on the locale.
+ *
+ * - field:  a field object
+ * - result: the result
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_field_int64(const struct fields_field *, int64_t *);
+
+/*
+ * Convert a field to a double. The field must consist of an optional sign,
+ * decimal digits with an optional decimal point and an optional exponent.
+ * The result is correctly rounded. If successful, the operation updates the
+ * result. The conversion does not depend on the locale: values that need
+ * `strtod` are passed to it without a decimal point, which is the only
+ * character of a valid value that varies between locales. It is safe to
+ * call while other threads run.
+ *
+ * - field:  a field object
+ * - result: the result
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_field_double(const struct fields_field *, double *);
+
+/*
+ * Convert a field to a fixed-point decimal number, that is, to a 64-bit
+ * integer holding the value multiplied by `10^scale`. The field must consist
+ * of an optional sign and decimal digits with an optional decimal point. It
+ * may have more decimals than the scale only if the extra decimals are zeros.
+ * If successful, the operation updates the result. The conversion does not
+ * depend on the locale.
+ *
+ * - field:  a field object
+ * - scale:  the number of decimals, at most 18
+ * - result: the result
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_field_decimal(const struct fields_field *, unsigned int,
+    int64_t *);
+
+/*
+ * Convert a field to a date. The field must have the format `YYYY-MM-DD`.
+ * The result is the number of days since 1970-01-01 in the proleptic
+ * Gregorian calendar. If successful, the operation updates the result.
+ *
+ * - field:  a field object
+ * - result: the result
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_field_date(const struct fields_field *, int32_t *);
+
+/*
+ * Convert a field to a timestamp. The field must have the format
+ * `YYYY-MM-DD`, `YYYY-MM-DD HH:MM:SS` or `YYYY-MM-DD HH:MM:SS.ffffff`, where
+ * the fraction of a second has one to six digits. The date and the time may
+ * also be separated by `T`. The result is the number of microseconds since
+ * 1970-01-01 00:00:00, ignoring time zones and leap seconds. If successful,
+ * the operation updates the result.
+ *
+ * - field:  a field object
+ * - result: the result
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_field_timestamp(const struct fields_field *, int64_t *);
+
+/*
+ * Convert the first rows of a column to 64-bit integers, as with
+ * `fields_field_int64`. The result for a null value is zero. The operation
+ * stops at the first value that cannot be converted and updates the row.
+ *
+ * - column:   a column object
+ * - num_rows: the number of rows
+ * - values:   an array of `num_rows` results
+ * - row:      the row of the value that cannot be converted
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_column_int64(const struct fields_column *, size_t, int64_t *,
+    size_t *);
+
+/*
+ * Convert the first rows of a column to doubles, as with
+ * `fields_field_double`. The result for a null value is zero. The operation
+ * stops at the first value that cannot be converted and updates the row.
+ *
+ * - column:   a column object
+ * - num_rows: the number of rows
+ * - values:   an array of `num_rows` results
+ * - row:      the row of the value that cannot be converted
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_column_double(const struct fields_column *, size_t, double *,
+    size_t *);
+
+/*
+ * Convert the first rows of a column to fixed-point decimal numbers, as with
+ * `fields_field_decimal`. The result for a null value is zero. The operation
+ * stops at the first value that cannot be converted and updates the row.
+ *
+ * - column:   a column object
+ * - num_rows: the number of rows
+ * - scale:    the number of decimals, at most 18
+ * - values:   an array of `num_rows` results
+ * - row:      the row of the value that cannot be converted
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_column_decimal(const struct fields_column *, size_t, unsigned int,
+    int64_t *, size_t *);
+
+/*
+ * Convert the first rows of a column to dates, as with `fields_field_date`.
+ * The result for a null value is zero. The operation stops at the first value
+ * that cannot be converted and updates the row.
+ *
+ * - column:   a column object
+ * - num_rows: the number of rows
+ * - values:   an array of `num_rows` results
+ * - row:      the row of the value that cannot be converted
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_column_date(const struct fields_column *, size_t, int32_t *,
+    size_t *);
+
+/*
+ * Convert the first rows of a column to timestamps, as with
+ * `fields_field_timestamp`. The result for a null value is zero. The
+ * operation stops at the first value that cannot be converted and updates
+ * the row.
+ *
+ * - column:   a column object
+ * - num_rows: the number of rows
+ * - values:   an array of `num_rows` results
+ * - row:      the row of the value that cannot be converted
+ *
+ * If successful, returns zero. Otherwise returns an error code.
+ */
+int fields_column_timestamp(const struct fields_column *, size_t, int64_t *,
+    size_t *);
+
+/*
+ * Get a string representation of an error code.
+ *
+ * - error: an error code
+ *
+ * Returns a string representation of the error code.
+ */
+const char *fields_conversion_strerror(int);
+
+/*
+ * The error codes for conversions.
+ */
+enum fields_conversion_error
+{
+    FIELDS_CONVERSION_ERROR_SYNTAX    = 1,
+    FIELDS_CONVERSION_ERROR_RANGE     = 2,
+    FIELDS_CONVERSION_ERROR_PRECISION = 3,
+    FIELDS_CONVERSION_ERROR_MEMORY    = 4,
+    FIELDS_CONVERSION_ERROR_DATE      = 5
+};
+
 /*
  * Positions
  * ---------
  */
 
 /*
- * A position refers to a character in a text.
+ * A position refers to a character in a text.
+ */
+struct fields_position
+{
+    /*
+     * The character's row.
+     */
+    unsigned long row;
+
+    /*
+     * The character's column.
+     */
+    unsigned long column;
+};
+
+/*
+ * Readers
+ * -------
+ */
+
+/*
+ * A reader reads records from a source, such as a buffer or a file.
+ */
+struct fields_reader;
+
+/*
+ * Allocate a reader that reads from the specified buffer. The operation fails
+ * if the input format or the settings are erroneous. If `settings` is `NULL`,
+ * the default settings are used.
+ *
+ * - buffer:      a buffer
+ * - buffer_size: size of the buffer
+ * - format:      the input format
+ * - settings:    the settings for the reader
+ *
+ * If successful, returns a reader object. Otherwise returns `NULL`.
+ */
+struct fields_reader *fields_read_buffer(const char *, size_t,
+    const struct fields_format *, const struct fields_settings *);
+
+/*
+ * Allocate a reader that reads from the specified file. The operation fails
+ * if the input format or the settings are erroneous. If `settings` is `NULL`,
+ * the default settings are used.
+ *
+ * - file:     a file
+ * - format:   the input format
+ * - settings: the settings for the reader
+ *
+ * If successful, returns a reader object. Otherwise returns `NULL`.
+ */
+struct fields_reader *fields_read_file(FILE *, const struct fields_format *,
+    const struct fields_settings *);
+
+/*
+ * Deallocate the reader.
+ *
+ * - reader: the reader object
+ */
+void fields_reader_free(struct fields_reader *);
+
+/*
+ * Read a record. If successful, the operation updates the record object.
+ * Otherwise the operation resets the record object. The operation fails at
+ * end of input or upon error state.
+ *
+ * - reader: the reader object
+ * - record: a record object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_reader_read(struct fields_reader *, struct fields_record *);
+
+/*
+ * Read up to the specified number of records into a batch. The operation
+ * first clears the batch. It fails if no records can be read, that is, at
+ * end of input or upon error state. If an error occurs after some records
+ * have been read, the operation succeeds and the next operation fails.
+ *
+ * - reader:      the reader object
+ * - batch:       a batch object
+ * - max_records: the maximum number of records
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_reader_read_batch(struct fields_reader *, struct fields_batch *,
+    size_t);
+
+/*
+ * Read up to the specified number of records into a columns object. The
+ * operation first clears the columns object. It fails if no records can be
+ * read, that is, at end of input or upon error state. A record with more
+ * fields than there are columns causes an error. If an error occurs after
+ * some records have been read, the operation succeeds and the next operation
+ * fails.
+ *
+ * - reader:   the reader object
+ * - columns:  a columns object
+ * - max_rows: the maximum number of records
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_reader_read_columns(struct fields_reader *, struct fields_columns *,
+    size_t);
+
+/*
+ * The callbacks for scanning records.
+ */
+struct fields_callbacks
+{
+    /*
+     * Called for each field of a record with the context, the value, the
+     * length of the value and the index of the field within the record. The
+     * value is not followed by a NUL character and remains valid only until
+     * the callback returns. May be `NULL`.
+     */
+    void (*on_field)(void *, const char *, size_t, size_t);
+
+    /*
+     * Called with the context at the end of each record. May be `NULL`.
+     */
+    void (*on_record_end)(void *);
+};
+
+/*
+ * Scan the remaining records, passing their fields to the callbacks instead
+ * of reading them into a record object. A record that contains no quote
+ * characters and lies within a single source buffer is passed to the
+ * callbacks straight from the source buffer. Other records are read into a
+ * record object within the reader first.
+ *
+ * The fields of a record are passed to the callbacks as they are found. If
+ * the record then turns out to be erroneous, the record end callback is not
+ * called for it.
+ *
+ * - reader:    the reader object
+ * - callbacks: the callbacks
+ * - context:   the context for the callbacks
+ *
+ * Returns zero at end of input. Otherwise returns non-zero.
+ */
+int fields_reader_scan(struct fields_reader *, const struct fields_callbacks *,
+    void *);
+
+/*
+ * Get the current position of the reader. The operation updates the position
+ * object.
+ *
+ * The column counts UTF-8 characters: every byte except a UTF-8
+ * continuation byte starts a new column. Input in another encoding, such as
+ * Latin-1, therefore counts one column per byte. Up to version 0.6.0, a
+ * byte that looked like the initial byte of a multibyte character skipped
+ * the following bytes, whatever they were, so that columns and even line
+ * breaks in such input went uncounted.
+ *
+ * - reader:   the reader object
+ * - position: a position object
+ */
+void fields_reader_position(const struct fields_reader *,
+    struct fields_position *);
+
+/*
+ * Check whether the reader is in error state.
+ *
+ * - reader: the reader object
+ *
+ * Returns an error code if the reader is in error state. Otherwise returns zero.
+ */
+int fields_reader_error(const struct fields_reader *);
+
+/*
+ * Get a string representation of an error code.
+ *
+ * error: an error code
+ *
+ * Returns a string representation of the error code.
+ */
+const char *fields_reader_strerror(int);
+
+/*
+ * The error codes for a reader.
+ */
+enum fields_reader_error
+{
+    FIELDS_READER_ERROR_TOO_BIG_RECORD       = 1,
+    FIELDS_READER_ERROR_TOO_MANY_FIELDS      = 2,
+    FIELDS_READER_ERROR_UNEXPECTED_CHARACTER = 3,
+    FIELDS_READER_ERROR_UNREADABLE_SOURCE    = 4
+};
+
+/*
+ * Indexes
+ * -------
+ */
+
+/*
+ * An index holds the offset and the position of every Nth record of an
+ * input, so that a reader can seek to any record by reading at most N - 1
+ * records.
+ */
+struct fields_index;
+
+/*
+ * A stamp identifies the version of an input, for example by the size and
+ * the modification time of a file.
+ */
+struct fields_stamp
+{
+    /*
+     * The size of the input.
+     */
+    uint64_t size;
+
+    /*
+     * The modification time of the input.
+     */
+    uint64_t mtime;
+};
+
+/*
+ * Build an index by reading the remaining records from the specified reader.
+ * The offsets are relative to where the reader started reading. The
+ * operation fails if the interval is zero, if the reader is in the middle of
+ * a record or waits for more input, if the reader runs into an error or if
+ * memory runs out. If `settings` is `NULL`, the default settings are used.
+ *
+ * - reader:   a reader object
+ * - interval: the number of records between index entries
+ * - settings: the settings for the index
+ *
+ * If successful, returns an index object. Otherwise returns `NULL`.
+ */
+struct fields_index *fields_index_build(struct fields_reader *, size_t,
+    const struct fields_settings *);
+
+/*
+ * Deallocate the index.
+ *
+ * - index: the index object
+ */
+void fields_index_free(struct fields_index *);
+
+/*
+ * Get the number of records in the input of the index.
+ *
+ * - index: the index object
+ *
+ * Returns the number of records.
+ */
+size_t fields_index_records(const struct fields_index *);
+
+/*
+ * Save the index to the specified file along with the stamp of its input.
+ *
+ * - index: the index object
+ * - file:  a file
+ * - stamp: the stamp of the input
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_index_save(const struct fields_index *, FILE *,
+    const struct fields_stamp *);
+
+/*
+ * Load an index from the specified file. The operation fails if the index
+ * was saved with a different stamp or built for a different input format,
+ * or if the file is not a valid index. If `settings` is `NULL`, the default
+ * settings are used.
+ *
+ * - file:     a file
+ * - stamp:    the stamp of the input
+ * - format:   the input format
+ * - settings: the settings for the index
+ *
+ * If successful, returns an index object. Otherwise returns `NULL`.
+ */
+struct fields_index *fields_index_load(FILE *, const struct fields_stamp *,
+    const struct fields_format *, const struct fields_settings *);
+
+/*
+ * Seek the reader to the specified record using an index built from the same
+ * input, so that the next read returns the record and the position is that
+ * of the record. The record number is zero-based; seeking to the number of
+ * records leaves the reader at the end of input. The operation clears error
+ * state.
+ *
+ * Readers that read from a buffer, a file, a file descriptor or a memory-
+ * mapped file can seek. The operation fails without changing the reader if
+ * the reader cannot seek, if the record number exceeds the number of records
+ * in the index, or if the index was built for a different input format.
+ * If the source fails to reposition, the reader is left in error state.
+ *
+ * - reader:        the reader object
+ * - index:         an index object
+ * - record_number: the number of the record
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_reader_seek(struct fields_reader *, const struct fields_index *,
+    size_t);
+
+/*
+ * Checkpoints
+ * -----------
  */
-struct fields_position
+
+/*
+ * A checkpoint holds the state of a reader between two records, so that
+ * another reader can later resume reading the same input from there.
+ */
+struct fields_checkpoint
 {
     /*
-     * The character's row.
+     * The offset of the next record from where the reader started reading.
      */
-    unsigned long row;
+    uint64_t offset;
 
     /*
-     * The character's column.
+     * The row of the next record.
      */
-    unsigned long column;
+    uint64_t row;
+
+    /*
+     * Non-zero if the previous record ended with a CR, in which case a line
+     * feed at the offset belongs to its record separator.
+     */
+    int cr;
 };
 
 /*
- * Readers
+ * The size of an encoded checkpoint.
+ */
+#define FIELDS_CHECKPOINT_SIZE (24)
+
+/*
+ * Take a checkpoint after the last record read. The operation fails upon
+ * error state and while a parser waits for the rest of a record.
+ *
+ * - reader:     the reader object
+ * - checkpoint: a checkpoint object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_reader_checkpoint(const struct fields_reader *,
+    struct fields_checkpoint *);
+
+/*
+ * Restore a checkpoint taken by a reader of the same input, so that the
+ * next read returns the record following the checkpoint and the position is
+ * that of the record. The operation clears error state. Readers that can
+ * seek, as described for `fields_reader_seek`, can restore a checkpoint.
+ *
+ * The operation fails without changing the reader if the reader cannot
+ * seek. If the source fails to reposition, the reader is left in error
+ * state.
+ *
+ * - reader:     the reader object
+ * - checkpoint: a checkpoint object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_reader_restore(struct fields_reader *,
+    const struct fields_checkpoint *);
+
+/*
+ * Encode a checkpoint into `FIELDS_CHECKPOINT_SIZE` bytes that can be
+ * stored and decoded on any platform.
+ *
+ * - checkpoint: a checkpoint object
+ * - bytes:      a buffer of `FIELDS_CHECKPOINT_SIZE` bytes
+ */
+void fields_checkpoint_encode(const struct fields_checkpoint *,
+    unsigned char *);
+
+/*
+ * Decode a checkpoint from `FIELDS_CHECKPOINT_SIZE` bytes.
+ *
+ * - checkpoint: a checkpoint object
+ * - bytes:      a buffer of `FIELDS_CHECKPOINT_SIZE` bytes
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_checkpoint_decode(struct fields_checkpoint *,
+    const unsigned char *);
+
+/*
+ * Parsers
  * -------
  */
 
 /*
- * A reader reads records from a source, such as a buffer or a file.
+ * A parser reads records from input that the caller feeds to it in chunks
+ * of any size, as the input becomes available. A parser never waits for
+ * input. When it runs out of input in the middle of a record, it keeps the
+ * record read so far and resumes it from where it left off once the next
+ * chunk is fed, so that no input is scanned twice.
  */
-struct fields_reader;
+struct fields_parser;
 
 /*
- * Allocate a reader that reads from the specified buffer. The operation fails
- * if the input format or the settings are erroneous. If `settings` is `NULL`,
- * the default settings are used.
+ * Allocate a parser. The operation fails if the input format or the settings
+ * are erroneous. If `settings` is `NULL`, the default settings are used.
+ *
+ * - format:   the input format
+ * - settings: the settings for the parser
+ *
+ * If successful, returns a parser object. Otherwise returns `NULL`.
+ */
+struct fields_parser *fields_parser_alloc(const struct fields_format *,
+    const struct fields_settings *);
+
+/*
+ * Deallocate the parser.
+ *
+ * - parser: the parser object
+ */
+void fields_parser_free(struct fields_parser *);
+
+/*
+ * Feed a chunk of input to the parser. An empty chunk marks the end of the
+ * input. The operation fails unless the parser is starved or if the end of
+ * the input has already been fed.
  *
+ * The chunk is not copied. It must stay valid and unchanged until the parser
+ * is starved again.
+ *
+ * - parser:      the parser object
  * - buffer:      a buffer
  * - buffer_size: size of the buffer
- * - format:      the input format
- * - settings:    the settings for the reader
  *
- * If successful, returns a reader object. Otherwise returns `NULL`.
+ * If successful, returns zero. Otherwise returns non-zero.
  */
-struct fields_reader *fields_read_buffer(const char *, size_t,
+int fields_parser_feed(struct fields_parser *, const char *, size_t);
+
+/*
+ * Read a record, as with `fields_reader_read`. The operation also fails if
+ * the parser runs out of input, which starves the parser. If the parser runs
+ * out of input in the middle of a record, it keeps the record read so far in
+ * the record object. The next operation must then be given the same record
+ * object.
+ *
+ * - parser: the parser object
+ * - record: a record object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_parser_read(struct fields_parser *, struct fields_record *);
+
+/*
+ * Scan records, as with `fields_reader_scan`, until the parser is starved or
+ * reaches the end of input. A record that the parser runs out of input in
+ * the middle of is resumed by the next operation.
+ *
+ * - parser:    the parser object
+ * - callbacks: the callbacks
+ * - context:   the context for the callbacks
+ *
+ * Returns zero if the parser is starved or at end of input. Otherwise
+ * returns non-zero.
+ */
+int fields_parser_scan(struct fields_parser *, const struct fields_callbacks *,
+    void *);
+
+/*
+ * Check whether the parser is starved, that is, whether it waits for the
+ * next chunk of input. A parser is starved until the first chunk is fed.
+ *
+ * - parser: the parser object
+ *
+ * Returns non-zero if the parser is starved. Otherwise returns zero.
+ */
+int fields_parser_starved(const struct fields_parser *);
+
+/*
+ * Get the current position of the parser, as with `fields_reader_position`.
+ *
+ * - parser:   the parser object
+ * - position: a position object
+ */
+void fields_parser_position(const struct fields_parser *,
+    struct fields_position *);
+
+/*
+ * Check whether the parser is in error state. The error codes and their
+ * string representations are the same as for a reader.
+ *
+ * - parser: the parser object
+ *
+ * Returns an error code if the parser is in error state. Otherwise returns zero.
+ */
+int fields_parser_error(const struct fields_parser *);
+
+/*
+ * Writers
+ * -------
+ */
+
+/*
+ * A writer writes records to a sink, such as a buffer or a file. The writer
+ * collects its output in a sink buffer and passes it to the sink when the
+ * sink buffer is full or when the writer is flushed.
+ *
+ * A field is quoted only if it contains the delimiter, the quote character,
+ * CR or LF, and a quote character within a quoted field is doubled. A record
+ * that consists of a single empty field is written as a quoted empty field,
+ * if quoting is enabled, to set it apart from a record with no fields for
+ * readers that make the distinction. Each record ends with LF.
+ */
+struct fields_writer;
+
+/*
+ * Allocate a writer that writes to the specified buffer. The operation fails
+ * if the output format or the settings are erroneous. If `settings` is
+ * `NULL`, the default settings are used.
+ *
+ * Whenever the writer flushes, it appends its output to the buffer and
+ * updates the length. The flush fails if the output does not fit.
+ *
+ * - buffer:      a buffer
+ * - buffer_size: size of the buffer
+ * - length:      a pointer to the length of the output in the buffer
+ * - format:      the output format
+ * - settings:    the settings for the writer
+ *
+ * If successful, returns a writer object. Otherwise returns `NULL`.
+ */
+struct fields_writer *fields_write_buffer(char *, size_t, size_t *,
     const struct fields_format *, const struct fields_settings *);
 
 /*
- * Allocate a reader that reads from the specified file. The operation fails
- * if the input format or the settings are erroneous. If `settings` is `NULL`,
- * the default settings are used.
+ * Allocate a writer that writes to the specified file. The operation fails
+ * if the output format or the settings are erroneous. If `settings` is
+ * `NULL`, the default settings are used.
  *
  * - file:     a file
- * - format:   the input format
- * - settings: the settings for the reader
+ * - format:   the output format
+ * - settings: the settings for the writer
  *
- * If successful, returns a reader object. Otherwise returns `NULL`.
+ * If successful, returns a writer object. Otherwise returns `NULL`.
  */
-struct fields_reader *fields_read_file(FILE *, const struct fields_format *,
+struct fields_writer *fields_write_file(FILE *, const struct fields_format *,
     const struct fields_settings *);
 
 /*
- * Deallocate the reader.
+ * Deallocate the writer. The operation does not flush the writer.
  *
- * - reader: the reader object
+ * - writer: the writer object
  */
-void fields_reader_free(struct fields_reader *);
+void fields_writer_free(struct fields_writer *);
 
 /*
- * Read a record. If successful, the operation updates the record object.
- * Otherwise the operation resets the record object. The operation fails at
- * end of input or upon error state.
+ * Write a field to the current record. The operation fails if the field
+ * cannot be represented in the output format, that is, if quoting is
+ * disabled and the field contains the delimiter, CR or LF, or upon error
+ * state.
  *
- * - reader: the reader object
+ * - writer: the writer object
+ * - field:  a field object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_writer_write_field(struct fields_writer *,
+    const struct fields_field *);
+
+/*
+ * End the current record. The operation fails upon error state.
+ *
+ * - writer: the writer object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_writer_end_record(struct fields_writer *);
+
+/*
+ * Write a record, as with `fields_writer_write_field` for each of its fields
+ * followed by `fields_writer_end_record`.
+ *
+ * - writer: the writer object
  * - record: a record object
  *
  * If successful, returns zero. Otherwise returns non-zero.
  */
-int fields_reader_read(struct fields_reader *, struct fields_record *);
+int fields_writer_write_record(struct fields_writer *,
+    const struct fields_record *);
 
 /*
- * Get the current position of the reader. The operation updates the position
- * object.
+ * Pass the output collected in the sink buffer to the sink. The operation
+ * fails if the sink fails or upon error state. After an unquotable field,
+ * the operation still passes the complete records to the sink, leaving out
+ * the record that contains the field, but fails.
  *
- * - reader:   the reader object
- * - position: a position object
+ * - writer: the writer object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
  */
-void fields_reader_position(const struct fields_reader *,
-    struct fields_position *);
+int fields_writer_flush(struct fields_writer *);
 
 /*
- * Check whether the reader is in error state.
+ * Check whether the writer is in error state.
  *
- * - reader: the reader object
+ * - writer: the writer object
  *
- * Returns an error code if the reader is in error state. Otherwise returns zero.
+ * Returns an error code if the writer is in error state. Otherwise returns zero.
  */
-int fields_reader_error(const struct fields_reader *);
+int fields_writer_error(const struct fields_writer *);
 
 /*
  * Get a string representation of an error code.
@@ -262,17 +1180,15 @@ int fields_reader_error(const struct fields_reader *);
  *
  * Returns a string representation of the error code.
  */
-const char *fields_reader_strerror(int);
+const char *fields_writer_strerror(int);
 
 /*
- * The error codes for a reader.
+ * The error codes for a writer.
  */
-enum fields_reader_error
+enum fields_writer_error
 {
-    FIELDS_READER_ERROR_TOO_BIG_RECORD       = 1,
-    FIELDS_READER_ERROR_TOO_MANY_FIELDS      = 2,
-    FIELDS_READER_ERROR_UNEXPECTED_CHARACTER = 3,
-    FIELDS_READER_ERROR_UNREADABLE_SOURCE    = 4
+    FIELDS_WRITER_ERROR_UNQUOTABLE_FIELD = 1,
+    FIELDS_WRITER_ERROR_UNWRITABLE_SINK  = 2
 };
 
 /*
@@ -321,6 +1237,96 @@ enum fields_format_error
     FIELDS_FORMAT_ERROR_QUOTE     = 2
 };
 
+/*
+ * Custom Allocators
+ * -----------------
+ */
+
+/*
+ * An allocator. The methods behave like `malloc`, `realloc` and `free`,
+ * with the context as the first argument. `free` is never called with
+ * `NULL`.
+ */
+struct fields_allocator
+{
+    /*
+     * Allocate a block of memory. Returns `NULL` on failure.
+     */
+    void *  (*alloc)(void *, size_t);
+
+    /*
+     * Resize a block of memory. Returns `NULL` on failure, leaving the block
+     * unchanged.
+     */
+    void *  (*realloc)(void *, void *, size_t);
+
+    /*
+     * Deallocate a block of memory.
+     */
+    void    (*free)(void *, void *);
+
+    /*
+     * The context passed to the methods.
+     */
+    void *  context;
+};
+
+/*
+ * The allocator that uses `malloc`, `realloc` and `free`.
+ */
+extern const struct fields_allocator fields_stdlib_allocator;
+
+/*
+ * An arena is an allocator that allocates blocks from a single slab of
+ * memory by bumping a pointer. Deallocating the most recently allocated block
+ * returns its memory to the arena. Other blocks are only reclaimed when the
+ * arena is cleared. An arena is not thread-safe.
+ */
+struct fields_arena;
+
+/*
+ * Allocate an arena with a slab of the specified size.
+ *
+ * - size: the size of the slab
+ *
+ * If successful, returns an arena object. Otherwise returns `NULL`.
+ */
+struct fields_arena *fields_arena_alloc(size_t);
+
+/*
+ * Deallocate the arena and its slab. All blocks allocated from the arena
+ * become invalid.
+ *
+ * - arena: an arena object
+ */
+void fields_arena_free(struct fields_arena *);
+
+/*
+ * Reclaim all blocks allocated from the arena. All blocks allocated from the
+ * arena become invalid.
+ *
+ * - arena: an arena object
+ */
+void fields_arena_clear(struct fields_arena *);
+
+/*
+ * Get the number of bytes in use in the arena, including block headers and
+ * padding.
+ *
+ * - arena: an arena object
+ *
+ * Returns the number of bytes in use.
+ */
+size_t fields_arena_used(const struct fields_arena *);
+
+/*
+ * Make an allocator that allocates from the arena.
+ *
+ * - arena:     an arena object
+ * - allocator: the allocator to initialize
+ */
+void fields_arena_allocator(struct fields_arena *, struct fields_allocator *);
+
 /*
  * Custom Settings
  * ---------------
@@ -342,7 +1348,7 @@ struct fields_settings
     size_t  source_buffer_size;
 
     /*
-     * Size of the buffer within a record.
+     * Initial size of the buffer within a record.
      */
     size_t  record_buffer_size;
 
@@ -350,6 +1356,51 @@ struct fields_settings
      * The maximum number of fields a record may contain.
      */
     size_t  record_max_fields;
+
+    /*
+     * Use views in the record. If true, a record that lies within a single
+     * source buffer and contains no quote characters is not copied into the
+     * record buffer. Instead, its fields point directly into the source
+     * buffer. Other records are copied as usual.
+     */
+    int     views;
+
+    /*
+     * The indexes of the fields to read, in ascending order. If not `NULL`,
+     * a record contains only these fields. The other fields are scanned for
+     * their boundaries but never copied, and the fields following the last
+     * index are skipped as a whole, without checking them for unexpected
+     * characters. A record read with a projection never uses views.
+     */
+    const size_t *  projection;
+
+    /*
+     * The number of indexes in the projection.
+     */
+    size_t          projection_size;
+
+    /*
+     * The allocator for readers, sources, records, batches and columns
+     * objects. If `NULL`, `fields_stdlib_allocator` is used. The allocator
+     * must outlive the objects allocated with it and must be thread-safe if
+     * used with a parallel reader.
+     */
+    const struct fields_allocator * allocator;
+
+    /*
+     * The number of records after which an expanding record is shrunk back
+     * to fit the records it has read since. The record buffer is shrunk to
+     * twice the size of the largest of them, rounded up to a power of two,
+     * and the field table to the smallest size that held the most fields.
+     * If zero, a record never shrinks.
+     */
+    size_t  record_shrink_interval;
+
+    /*
+     * Size of the buffer within a writer. If zero, the default size is
+     * used.
+     */
+    size_t  sink_buffer_size;
 };
 
 #define FIELDS_MINIMUM_SOURCE_BUFFER_SIZE (1024)
@@ -361,6 +1412,11 @@ struct fields_settings
 #define FIELDS_MINIMUM_RECORD_MAX_FIELDS (1)
 #define FIELDS_DEFAULT_RECORD_MAX_FIELDS (1023)
 
+#define FIELDS_DEFAULT_RECORD_SHRINK_INTERVAL (1024)
+
+#define FIELDS_MINIMUM_SINK_BUFFER_SIZE (1024)
+#define FIELDS_DEFAULT_SINK_BUFFER_SIZE (1024 * 1024)
+
 /*
  * Check whether the settings are erroneous.
  *
@@ -387,7 +1443,9 @@ enum fields_settings_error
 {
     FIELDS_SETTINGS_ERROR_SOURCE_BUFFER_SIZE = 1,
     FIELDS_SETTINGS_ERROR_RECORD_BUFFER_SIZE = 2,
-    FIELDS_SETTINGS_ERROR_RECORD_MAX_FIELDS  = 3
+    FIELDS_SETTINGS_ERROR_RECORD_MAX_FIELDS  = 3,
+    FIELDS_SETTINGS_ERROR_PROJECTION         = 4,
+    FIELDS_SETTINGS_ERROR_SINK_BUFFER_SIZE   = 5
 };
 
 /*
@@ -431,6 +1489,66 @@ struct fields_reader *fields_reader_alloc(void *, fields_source_read_fn *,
     fields_source_free_fn *, const struct fields_format *,
     const struct fields_settings *);
 
+/*
+ * Reposition the source at the specified offset from where it started, so
+ * that the next read returns the input from there.
+ *
+ * - source: the source object
+ * - offset: an offset
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+typedef int fields_source_seek_fn(void *, uint64_t);
+
+/*
+ * Set the seek method of the source of a reader, which enables seeking the
+ * reader with `fields_reader_seek`.
+ *
+ * - reader: the reader object
+ * - seek:   the seek method
+ */
+void fields_reader_set_source_seek(struct fields_reader *,
+    fields_source_seek_fn *);
+
+/*
+ * Custom Sinks
+ * ------------
+ */
+
+/*
+ * Write to the sink. The operation writes the whole buffer.
+ *
+ * - sink:        the sink object
+ * - buffer:      a buffer
+ * - buffer_size: size of the buffer
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+typedef int fields_sink_write_fn(void *, const char *, size_t);
+
+/*
+ * Deallocate the sink.
+ *
+ * - sink: the sink object
+ */
+typedef void fields_sink_free_fn(void *);
+
+/*
+ * Allocate a writer for the specified sink. The operation fails if the
+ * format or the settings are erroneous.
+ *
+ * - sink:     the sink object
+ * - write:    the write method
+ * - free:     the free method
+ * - format:   the output format
+ * - settings: the settings for the writer
+ *
+ * If successful, returns a writer object. Otherwise returns `NULL`.
+ */
+struct fields_writer *fields_writer_alloc(void *, fields_sink_write_fn *,
+    fields_sink_free_fn *, const struct fields_format *,
+    const struct fields_settings *);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -38,6 +38,11 @@ extern "C" {
  *     https://github.com/jvirtanen/fields
  */
 
+/*
+ * Readers
+ * -------
+ */
+
 /*
  * Allocate a reader that reads from the specified file descriptor. The
  * operation fails if the input format or the settings are erroneous. If
@@ -52,6 +57,217 @@ extern "C" {
 struct fields_reader *fields_read_fd(int, const struct fields_format *,
     const struct fields_settings *);
 
+/*
+ * Allocate a reader that maps the regular file referred to by the specified
+ * file descriptor into memory and reads it from the current file offset to
+ * the end of the file. The file offset is left unchanged. The operation fails
+ * if the file cannot be mapped or if the input format or the settings are
+ * erroneous. If `settings` is `NULL`, the default settings are used.
+ *
+ * The input is not copied into a source buffer, so the source buffer size
+ * has no effect. The file must not be truncated while the reader is in use.
+ *
+ * - fd:       a file descriptor
+ * - format:   the input format
+ * - settings: the settings for the reader
+ *
+ * If successful, returns a reader object. Otherwise returns `NULL`.
+ */
+struct fields_reader *fields_read_mmap(int, const struct fields_format *,
+    const struct fields_settings *);
+
+/*
+ * Allocate a reader that reads from the specified file descriptor ahead of
+ * the parser. An I/O thread fills a ring of `num_buffers` buffers of
+ * `source_buffer_size` bytes each while the reader parses the previous
+ * ones, so that reading and parsing overlap. The operation fails if the
+ * number of buffers is less than two or if the input format or the settings
+ * are erroneous. If `settings` is `NULL`, the default settings are used.
+ *
+ * The I/O thread starts reading immediately and stops at the end of the
+ * input, on an error, or when the reader is freed. The file descriptor must
+ * not be used otherwise until then. Freeing the reader waits for a pending
+ * read to complete.
+ *
+ * - fd:          a file descriptor
+ * - format:      the input format
+ * - settings:    the settings for the reader
+ * - num_buffers: the number of buffers
+ *
+ * If successful, returns a reader object. Otherwise returns `NULL`.
+ */
+struct fields_reader *fields_read_ahead(int, const struct fields_format *,
+    const struct fields_settings *, unsigned int);
+
+/*
+ * Allocate a reader that reads gzip-compressed input from the specified file
+ * descriptor. Like a read-ahead reader, it decompresses the input in an I/O
+ * thread into a ring of `num_buffers` buffers of `source_buffer_size` bytes
+ * each, so that decompression and parsing overlap. Concatenated gzip members
+ * are read one after another. The operation fails if Fields is built
+ * without zlib, if the number of buffers is less than two or if the input
+ * format or the settings are erroneous. If `settings` is `NULL`, the
+ * default settings are used.
+ *
+ * Corrupt or truncated input causes an unreadable source error. The file
+ * descriptor must not be used otherwise until the reader is freed.
+ *
+ * - fd:          a file descriptor
+ * - format:      the input format
+ * - settings:    the settings for the reader
+ * - num_buffers: the number of buffers
+ *
+ * If successful, returns a reader object. Otherwise returns `NULL`.
+ */
+struct fields_reader *fields_read_gzip(int, const struct fields_format *,
+    const struct fields_settings *, unsigned int);
+
+/*
+ * Allocate a reader that reads Zstandard-compressed input from the specified
+ * file descriptor, just like `fields_read_gzip` for gzip-compressed input.
+ * Concatenated frames are read one after another. The operation fails if
+ * Fields is built without libzstd.
+ *
+ * - fd:          a file descriptor
+ * - format:      the input format
+ * - settings:    the settings for the reader
+ * - num_buffers: the number of buffers
+ *
+ * If successful, returns a reader object. Otherwise returns `NULL`.
+ */
+struct fields_reader *fields_read_zstd(int, const struct fields_format *,
+    const struct fields_settings *, unsigned int);
+
+/*
+ * Writers
+ * -------
+ */
+
+/*
+ * Allocate a writer that writes to the specified file descriptor. The
+ * operation fails if the output format or the settings are erroneous. If
+ * `settings` is `NULL`, the default settings are used.
+ *
+ * - fd:       a file descriptor
+ * - format:   the output format
+ * - settings: the settings for the writer
+ *
+ * If successful, returns a writer object. Otherwise returns `NULL`.
+ */
+struct fields_writer *fields_write_fd(int, const struct fields_format *,
+    const struct fields_settings *);
+
+/*
+ * Indexes
+ * -------
+ */
+
+/*
+ * Save an index to a sidecar file at the specified path. The index is
+ * stamped with the size and the modification time of the file referred to
+ * by the specified file descriptor, which should be the input of the index.
+ * The modification time is in nanoseconds, where the system provides them.
+ * The operation replaces an existing file at the path.
+ *
+ * - index: an index object
+ * - path:  the path of the sidecar file
+ * - fd:    a file descriptor of the input
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_index_save_sidecar(const struct fields_index *, const char *, int);
+
+/*
+ * Load an index from a sidecar file at the specified path. The operation
+ * fails if the size or the modification time of the file referred to by the
+ * specified file descriptor differs from when the index was saved, or for
+ * any reason `fields_index_load` fails. If `settings` is `NULL`, the default
+ * settings are used.
+ *
+ * - path:     the path of the sidecar file
+ * - fd:       a file descriptor of the input
+ * - format:   the input format
+ * - settings: the settings for the index
+ *
+ * If successful, returns an index object. Otherwise returns `NULL`.
+ */
+struct fields_index *fields_index_load_sidecar(const char *, int,
+    const struct fields_format *, const struct fields_settings *);
+
+/*
+ * Parallel Readers
+ * ----------------
+ */
+
+/*
+ * A parallel reader reads a buffer using multiple threads. The buffer is
+ * divided into chunks of about `source_buffer_size` bytes, each ending at
+ * the end of a record, and the chunks are parsed concurrently. The records
+ * are returned in their original order.
+ */
+struct fields_parallel;
+
+/*
+ * Allocate a parallel reader that reads from the specified buffer. The
+ * operation fails if the input format or the settings are erroneous. If
+ * `settings` is `NULL`, the default settings are used. If `threads` is zero,
+ * one thread per online processor is used.
+ *
+ * The buffer must stay valid and unchanged until the parallel reader is
+ * freed. It may, for example, be a file mapped into memory.
+ *
+ * - buffer:      a buffer
+ * - buffer_size: the size of the buffer
+ * - format:      the input format
+ * - settings:    the settings for the readers
+ * - threads:     the number of threads
+ *
+ * If successful, returns a parallel reader object. Otherwise returns `NULL`.
+ */
+struct fields_parallel *fields_parallel_alloc(const char *, size_t,
+    const struct fields_format *, const struct fields_settings *,
+    unsigned int);
+
+/*
+ * Free a parallel reader.
+ *
+ * - parallel: a parallel reader object
+ */
+void fields_parallel_free(struct fields_parallel *);
+
+/*
+ * Read a record from a parallel reader. The fields of the record point into
+ * memory owned by the parallel reader and are valid until the next read or
+ * until the parallel reader is freed.
+ *
+ * - parallel: a parallel reader object
+ * - record:   a record object
+ *
+ * If successful, returns zero. Otherwise returns non-zero.
+ */
+int fields_parallel_read(struct fields_parallel *, struct fields_record *);
+
+/*
+ * Get the current position of a parallel reader, just like
+ * `fields_reader_position` for a reader.
+ *
+ * - parallel: a parallel reader object
+ * - position: a position object
+ */
+void fields_parallel_position(const struct fields_parallel *,
+    struct fields_position *);
+
+/*
+ * Get the error code of a parallel reader. The error codes and their string
+ * representations are the same as for a reader.
+ *
+ * - parallel: a parallel reader object
+ *
+ * Returns the error code if the parallel reader is in an error state.
+ * Otherwise returns zero.
+ */
+int fields_parallel_error(const struct fields_parallel *);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,56 @@
+#!/usr/bin/env python
+
+#
+# Measure the throughput of reading comma-separated values in Python with
+# the native extension, through ctypes only and with the csv module.
+#
+
+import csv
+import fields
+import StringIO
+import time
+
+COLUMNS = 20
+RECORDS = 100000
+ROUNDS = 3
+
+
+def generate():
+    seed = 1
+    lines = []
+    for i in xrange(RECORDS):
+        values = []
+        for j in xrange(COLUMNS):
+            seed = (seed * 1103515245 + 12345) % 2 ** 32
+            if j % 2 == 0:
+                values.append('%d.%02d' % ((seed >> 16) % 100000,
+                    (seed >> 8) % 100))
+            else:
+                values.append('"item %d"' % ((seed >> 16) % 100000))
+        lines.append(','.join(values))
+    return '\n'.join(lines) + '\n'
+
+
+def run(name, read, text):
+    best = None
+    for i in xrange(ROUNDS):
+        start = time.time()
+        records = 0
+        for record in read(text):
+            records += 1
+        elapsed = time.time() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    print '%s: %d records, %d bytes, %.2f MB/s' % (name, records, len(text),
+        len(text) / best / 1e6)
+
+
+def main():
+    text = generate()
+    run('native', lambda text: fields.reader(text), text)
+    run('ctypes', lambda text: fields.reader(text, _native=False), text)
+    run('csv', lambda text: csv.reader(StringIO.StringIO(text)), text)
+
+
+if __name__ == '__main__':
+    main()
@@ -3,4 +3,4 @@ This module contains a Python binding to Fields, the fast C library for
 reading CSV and other tabular text formats.
 '''
 
-from .api import Error, reader
+from .api import Error, columns, load_columns, reader
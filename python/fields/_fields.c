@@ -0,0 +1,624 @@
+/*
+ * Copyright (c) 2012 Jussi Virtanen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <Python.h>
+
+#include "fields.h"
+
+/*
+ * Native Records
+ * ==============
+ *
+ * The ctypes binding allocates the readers and the records, and this module
+ * turns the records into Python objects. The objects are passed in as the
+ * addresses that ctypes holds for them.
+ */
+
+static void *
+fields_native_address(PyObject *object)
+{
+    void *address;
+
+    address = PyLong_AsVoidPtr(object);
+    if (address == NULL && !PyErr_Occurred())
+        PyErr_SetString(PyExc_ValueError, "NULL pointer");
+
+    return address;
+}
+
+static PyObject *
+fields_native_record(const struct fields_record *record)
+{
+    struct fields_field field;
+    PyObject *result;
+    size_t size;
+    size_t i;
+
+    size = fields_record_size(record);
+
+    result = PyList_New(size);
+    if (result == NULL)
+        return NULL;
+
+    for (i = 0; i < size; i++) {
+        PyObject *value;
+
+        fields_record_field(record, i, &field);
+
+        value = PyBytes_FromStringAndSize(field.value, field.length);
+        if (value == NULL) {
+            Py_DECREF(result);
+            return NULL;
+        }
+
+        PyList_SET_ITEM(result, i, value);
+    }
+
+    return result;
+}
+
+static PyObject *
+fields_native_fields(PyObject *self, PyObject *args)
+{
+    struct fields_record *record;
+    PyObject *record_address;
+
+    (void)self;
+
+    if (!PyArg_ParseTuple(args, "O", &record_address))
+        return NULL;
+
+    record = fields_native_address(record_address);
+    if (record == NULL)
+        return NULL;
+
+    return fields_native_record(record);
+}
+
+static PyObject *
+fields_native_read(PyObject *self, PyObject *args)
+{
+    struct fields_reader *reader;
+    struct fields_record *record;
+    PyObject *reader_address;
+    PyObject *record_address;
+    Py_ssize_t max_records;
+    PyObject *result;
+
+    (void)self;
+
+    if (!PyArg_ParseTuple(args, "OOn", &reader_address, &record_address,
+        &max_records))
+        return NULL;
+
+    reader = fields_native_address(reader_address);
+    if (reader == NULL)
+        return NULL;
+
+    record = fields_native_address(record_address);
+    if (record == NULL)
+        return NULL;
+
+    result = PyList_New(0);
+    if (result == NULL)
+        return NULL;
+
+    /*
+     * Read up to the maximum number of records in one call. An empty list
+     * tells the end of input or an error, which the reader holds.
+     */
+    while (PyList_GET_SIZE(result) < max_records) {
+        PyObject *fields;
+        int status;
+
+        if (fields_reader_read(reader, record) != 0)
+            break;
+
+        fields = fields_native_record(record);
+        if (fields == NULL) {
+            Py_DECREF(result);
+            return NULL;
+        }
+
+        status = PyList_Append(result, fields);
+        Py_DECREF(fields);
+
+        if (status != 0) {
+            Py_DECREF(result);
+            return NULL;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Native Columns
+ * ==============
+ *
+ * Load records into typed column buffers that NumPy can wrap without
+ * converting the values again. The values are parsed with the global
+ * interpreter lock released. Each buffer is a byte array from the start, so
+ * that the values are never copied into Python. It grows by doubling, which
+ * takes the lock for the moment of the resize, and is trimmed to size when
+ * the input ends.
+ */
+
+enum {
+    FIELDS_NATIVE_INT64     = 0,
+    FIELDS_NATIVE_DOUBLE    = 1,
+    FIELDS_NATIVE_DATE      = 2,
+    FIELDS_NATIVE_TIMESTAMP = 3,
+    FIELDS_NATIVE_BYTES     = 4
+};
+
+#define FIELDS_NATIVE_MISSING   (-1)
+#define FIELDS_NATIVE_NAT       INT64_MIN
+
+struct fields_native_column {
+    size_t  column;
+    size_t  field;
+    int     type;
+
+    /*
+     * The width of a bytes value. If zero, the values are stored end to end
+     * and padded to the widest one at the end.
+     */
+    size_t  width;
+
+    PyObject       *array;
+    PyThreadState **thread;
+
+    char   *data;
+    size_t  size;
+    size_t  capacity;
+
+    size_t *ends;
+    size_t  ends_capacity;
+};
+
+static int
+fields_native_reserve(struct fields_native_column *column, size_t size)
+{
+    size_t capacity;
+    int error;
+
+    if (column->capacity - column->size >= size)
+        return 0;
+
+    capacity = column->capacity > 0 ? column->capacity : 4096;
+    while (capacity - column->size < size) {
+        if (capacity > PY_SSIZE_T_MAX / 2)
+            return FIELDS_CONVERSION_ERROR_MEMORY;
+        capacity *= 2;
+    }
+
+    PyEval_RestoreThread(*column->thread);
+
+    error = PyByteArray_Resize(column->array, capacity);
+    if (error != 0)
+        PyErr_Clear();
+
+    *column->thread = PyEval_SaveThread();
+
+    if (error != 0)
+        return FIELDS_CONVERSION_ERROR_MEMORY;
+
+    column->data = PyByteArray_AS_STRING(column->array);
+    column->capacity = capacity;
+
+    return 0;
+}
+
+static int
+fields_native_append(struct fields_native_column *column, const void *value,
+    size_t size)
+{
+    if (fields_native_reserve(column, size) != 0)
+        return FIELDS_CONVERSION_ERROR_MEMORY;
+
+    memcpy(column->data + column->size, value, size);
+    column->size += size;
+
+    return 0;
+}
+
+static int
+fields_native_append_bytes(struct fields_native_column *column, size_t row,
+    const struct fields_field *field)
+{
+    size_t length;
+
+    if (column->width > 0) {
+        length = field->length < column->width ? field->length : column->width;
+
+        if (fields_native_reserve(column, column->width) != 0)
+            return FIELDS_CONVERSION_ERROR_MEMORY;
+
+        memcpy(column->data + column->size, field->value, length);
+        memset(column->data + column->size + length, 0,
+            column->width - length);
+        column->size += column->width;
+
+        return 0;
+    }
+
+    if (row == column->ends_capacity) {
+        size_t capacity;
+        size_t *ends;
+
+        capacity = column->ends_capacity > 0 ? 2 * column->ends_capacity : 512;
+
+        ends = realloc(column->ends, capacity * sizeof(size_t));
+        if (ends == NULL)
+            return FIELDS_CONVERSION_ERROR_MEMORY;
+
+        column->ends = ends;
+        column->ends_capacity = capacity;
+    }
+
+    if (fields_native_append(column, field->value, field->length) != 0)
+        return FIELDS_CONVERSION_ERROR_MEMORY;
+
+    column->ends[row] = column->size;
+
+    return 0;
+}
+
+/*
+ * Pad the values of a bytes column without a width to the widest value. The
+ * values move in place, starting from the last one, since no value moves
+ * towards the beginning of the buffer.
+ */
+static int
+fields_native_pad(struct fields_native_column *column, size_t num_rows)
+{
+    size_t width = 1;
+    size_t start = 0;
+    size_t i;
+
+    for (i = 0; i < num_rows; i++) {
+        if (column->ends[i] - start > width)
+            width = column->ends[i] - start;
+        start = column->ends[i];
+    }
+
+    if (num_rows > 0 && width > (size_t)-1 / num_rows)
+        return -1;
+
+    if (fields_native_reserve(column, num_rows * width - column->size) != 0)
+        return -1;
+
+    for (i = num_rows; i > 0; i--) {
+        size_t length;
+
+        start = i > 1 ? column->ends[i - 2] : 0;
+        length = column->ends[i - 1] - start;
+
+        memmove(column->data + (i - 1) * width, column->data + start,
+            length);
+        memset(column->data + (i - 1) * width + length, 0, width - length);
+    }
+
+    column->size = num_rows * width;
+    column->width = width;
+
+    return 0;
+}
+
+/*
+ * Append the value of a field to a column. A missing field or an empty
+ * value is NaN or NaT for floating-point and date columns and empty for
+ * bytes columns. An integer column has no such value.
+ *
+ * If successful, returns zero. Otherwise returns a conversion error code or
+ * `FIELDS_NATIVE_MISSING`.
+ */
+static int
+fields_native_convert(struct fields_native_column *column, size_t row,
+    const struct fields_record *record)
+{
+    struct fields_field field = { "", 0 };
+    int64_t integer;
+    int32_t date;
+    double number;
+    int missing;
+    int error;
+
+    missing = column->field >= fields_record_size(record);
+    if (!missing)
+        fields_record_field(record, column->field, &field);
+
+    if (field.length == 0) {
+        if (column->type == FIELDS_NATIVE_INT64 && missing)
+            return FIELDS_NATIVE_MISSING;
+
+        if (column->type == FIELDS_NATIVE_DOUBLE) {
+            number = Py_NAN;
+            return fields_native_append(column, &number, sizeof(number));
+        }
+
+        if (column->type == FIELDS_NATIVE_DATE ||
+            column->type == FIELDS_NATIVE_TIMESTAMP) {
+            integer = FIELDS_NATIVE_NAT;
+            return fields_native_append(column, &integer, sizeof(integer));
+        }
+    }
+
+    switch (column->type) {
+    case FIELDS_NATIVE_INT64:
+        error = fields_field_int64(&field, &integer);
+        if (error != 0)
+            return error;
+        return fields_native_append(column, &integer, sizeof(integer));
+    case FIELDS_NATIVE_DOUBLE:
+        error = fields_field_double(&field, &number);
+        if (error != 0)
+            return error;
+        return fields_native_append(column, &number, sizeof(number));
+    case FIELDS_NATIVE_DATE:
+        error = fields_field_date(&field, &date);
+        if (error != 0)
+            return error;
+        integer = date;
+        return fields_native_append(column, &integer, sizeof(integer));
+    case FIELDS_NATIVE_TIMESTAMP:
+        error = fields_field_timestamp(&field, &integer);
+        if (error != 0)
+            return error;
+        return fields_native_append(column, &integer, sizeof(integer));
+    case FIELDS_NATIVE_BYTES:
+        return fields_native_append_bytes(column, row, &field);
+    default:
+        return FIELDS_CONVERSION_ERROR_MEMORY;
+    }
+}
+
+/*
+ * Read the remaining records into the columns. Runs without the global
+ * interpreter lock.
+ *
+ * If successful, returns zero. Otherwise returns a conversion error code or
+ * `FIELDS_NATIVE_MISSING` and updates the failing column.
+ */
+static int
+fields_native_load_rows(struct fields_reader *reader,
+    struct fields_record *record, struct fields_native_column *columns,
+    size_t num_columns, size_t *num_rows, size_t *failure)
+{
+    size_t i;
+    int error;
+
+    while (fields_reader_read(reader, record) == 0) {
+        for (i = 0; i < num_columns; i++) {
+            error = fields_native_convert(&columns[i], *num_rows, record);
+            if (error != 0) {
+                *failure = i;
+                return error;
+            }
+        }
+
+        *num_rows += 1;
+    }
+
+    for (i = 0; i < num_columns; i++) {
+        if (columns[i].type != FIELDS_NATIVE_BYTES || columns[i].width > 0)
+            continue;
+
+        if (fields_native_pad(&columns[i], *num_rows) != 0) {
+            *failure = i;
+            return FIELDS_CONVERSION_ERROR_MEMORY;
+        }
+    }
+
+    return 0;
+}
+
+static void
+fields_native_free_columns(struct fields_native_column *columns,
+    size_t num_columns)
+{
+    size_t i;
+
+    for (i = 0; i < num_columns; i++) {
+        free(columns[i].ends);
+        Py_XDECREF(columns[i].array);
+    }
+
+    PyMem_Free(columns);
+}
+
+static PyObject *
+fields_native_column_buffers(const struct fields_native_column *columns,
+    size_t num_columns, size_t num_rows)
+{
+    PyObject *result;
+    size_t i;
+
+    result = PyList_New(num_columns);
+    if (result == NULL)
+        return NULL;
+
+    for (i = 0; i < num_columns; i++) {
+        PyObject *item;
+
+        if (PyByteArray_Resize(columns[i].array, columns[i].size) != 0) {
+            Py_DECREF(result);
+            return NULL;
+        }
+
+        item = Py_BuildValue("(On)", columns[i].array,
+            (Py_ssize_t)columns[i].width);
+        if (item == NULL) {
+            Py_DECREF(result);
+            return NULL;
+        }
+
+        PyList_SET_ITEM(result, i, item);
+    }
+
+    return Py_BuildValue("(nN)", (Py_ssize_t)num_rows, result);
+}
+
+static PyObject *
+fields_native_load(PyObject *self, PyObject *args)
+{
+    struct fields_native_column *columns;
+    struct fields_reader *reader;
+    struct fields_record *record;
+    PyObject *reader_address;
+    PyObject *record_address;
+    PyObject *specs;
+    PyObject *result;
+    PyThreadState *thread;
+    size_t num_columns;
+    size_t num_rows = 0;
+    size_t failure = 0;
+    size_t i;
+    int error;
+
+    (void)self;
+
+    if (!PyArg_ParseTuple(args, "OOO!", &reader_address, &record_address,
+        &PyList_Type, &specs))
+        return NULL;
+
+    reader = fields_native_address(reader_address);
+    if (reader == NULL)
+        return NULL;
+
+    record = fields_native_address(record_address);
+    if (record == NULL)
+        return NULL;
+
+    /*
+     * Each column is given as a tuple of the index of the column in the
+     * input, the index of the field in the record, the type and the width
+     * of a bytes value.
+     */
+    num_columns = PyList_GET_SIZE(specs);
+
+    columns = PyMem_Malloc(num_columns > 0 ?
+        num_columns * sizeof(*columns) : 1);
+    if (columns == NULL)
+        return PyErr_NoMemory();
+
+    memset(columns, 0, num_columns * sizeof(*columns));
+
+    for (i = 0; i < num_columns; i++) {
+        Py_ssize_t column, field, width;
+        int type;
+
+        if (!PyArg_ParseTuple(PyList_GET_ITEM(specs, i), "nnin", &column,
+            &field, &type, &width)) {
+            fields_native_free_columns(columns, num_columns);
+            return NULL;
+        }
+
+        if (column < 0 || field < 0 || type < FIELDS_NATIVE_INT64 ||
+            type > FIELDS_NATIVE_BYTES || width < 0) {
+            fields_native_free_columns(columns, num_columns);
+            PyErr_SetString(PyExc_ValueError, "Bad column");
+            return NULL;
+        }
+
+        columns[i].array = PyByteArray_FromStringAndSize(NULL, 0);
+        if (columns[i].array == NULL) {
+            fields_native_free_columns(columns, num_columns);
+            return NULL;
+        }
+
+        columns[i].column = column;
+        columns[i].field = field;
+        columns[i].type = type;
+        columns[i].width = width;
+        columns[i].thread = &thread;
+    }
+
+    /*
+     * This is what Py_BEGIN_ALLOW_THREADS and Py_END_ALLOW_THREADS do, with
+     * the thread state at hand for the columns to resize their arrays.
+     */
+    thread = PyEval_SaveThread();
+    error = fields_native_load_rows(reader, record, columns, num_columns,
+        &num_rows, &failure);
+    PyEval_RestoreThread(thread);
+
+    if (error == FIELDS_CONVERSION_ERROR_MEMORY) {
+        fields_native_free_columns(columns, num_columns);
+        return PyErr_NoMemory();
+    }
+
+    if (error != 0) {
+        PyErr_Format(PyExc_ValueError, "Record %zd, column %zd: %s",
+            (Py_ssize_t)num_rows + 1, (Py_ssize_t)columns[failure].column,
+            error == FIELDS_NATIVE_MISSING ? "Missing value" :
+            fields_conversion_strerror(error));
+        fields_native_free_columns(columns, num_columns);
+        return NULL;
+    }
+
+    result = fields_native_column_buffers(columns, num_columns, num_rows);
+
+    fields_native_free_columns(columns, num_columns);
+
+    return result;
+}
+
+static PyMethodDef fields_native_methods[] = {
+    {
+        "fields", fields_native_fields, METH_VARARGS,
+        "Return the fields of a record as a list of strings."
+    },
+    {
+        "read", fields_native_read, METH_VARARGS,
+        "Read up to a number of records as a list of lists of strings."
+    },
+    {
+        "load", fields_native_load, METH_VARARGS,
+        "Read the remaining records into typed column buffers."
+    },
+    { NULL, NULL, 0, NULL }
+};
+
+#if PY_MAJOR_VERSION >= 3
+
+static struct PyModuleDef fields_native_module = {
+    PyModuleDef_HEAD_INIT, "_fields", NULL, -1, fields_native_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC
+PyInit__fields(void)
+{
+    return PyModule_Create(&fields_native_module);
+}
+
+#else
+
+PyMODINIT_FUNC
+init_fields(void)
+{
+    Py_InitModule("_fields", fields_native_methods);
+}
+
+#endif
@@ -1,5 +1,14 @@
+import ctypes
+
 from . import libfields
 
+# The native extension turns records into lists in C. Without it, the
+# records are converted through ctypes.
+try:
+    from . import _fields
+except ImportError:
+    _fields = None
+
 
 class Error(Exception):
     '''
@@ -24,34 +33,235 @@ def reader(source, **kwargs):
         special characters, such as the `delimiter` or the `quotechar`. It
         defaults to `"`.
 
+      - `compression`: `gzip` or `zstd` to decompress a file object that
+        holds compressed input. The input is decompressed in a separate
+        thread. It defaults to no compression.
+
     The returned object is an iterator. Each iteration returns a record, a
     sequence of fields. Records are implemented as lists of strings.
     '''
     return Reader(source, **kwargs)
 
 
+def columns(source, count, **kwargs):
+    '''
+    Return the records in `source` as a list of `count` columns. `source` can
+    be either a string or a file object, as with `reader`, and the same
+    keyword arguments are accepted.
+
+    Each column is a list of strings with one item per record. If a record
+    has fewer fields than there are columns, the missing fields are `None`.
+    A record with more fields than there are columns is an error.
+    '''
+    fmt = _fmt(kwargs)
+    settings = _settings(kwargs)
+    mmap = bool(kwargs.get('_mmap', False))
+    read_ahead = int(kwargs.get('_read_ahead', 0))
+    compression = kwargs.get('compression')
+    try:
+        reader = libfields.Reader(source, fmt, settings, mmap, read_ahead,
+            compression)
+        batch = libfields.Columns(count, settings)
+    except ValueError as e:
+        raise Error(str(e))
+    result = [[] for _ in xrange(count)]
+    while reader.read_columns(batch, _BATCH_SIZE) == 0:
+        for index, column in enumerate(result):
+            column.extend(batch.column(index))
+    message = reader.error()
+    if message:
+        raise Error(message)
+    return result
+
+
+def load_columns(source, dtypes, usecols=None, **kwargs):
+    '''
+    Return the records in `source` as a dictionary of NumPy arrays, one per
+    column. `source` can be either a string or a file object, as with
+    `reader`, and the same keyword arguments are accepted. The values are
+    parsed in C without holding the global interpreter lock.
+
+    `usecols` is a sequence of column indexes and `dtypes` a sequence of
+    types, one per column. `dtypes` can also be a dictionary from column
+    indexes to types, in which case `usecols` defaults to its keys. The
+    dictionary returned is keyed by the column indexes.
+
+    The supported types are `int64`, `float64`, `datetime64[D]`,
+    `datetime64[us]` and `S<n>`, a byte string of at most `n` bytes. `S`
+    without a width is as wide as the widest value. An empty value is NaN,
+    NaT or an empty string, and a missing value is treated as an empty one.
+    An empty or missing `int64` value is an error.
+    '''
+    try:
+        import numpy
+    except ImportError:
+        raise Error('NumPy is not available')
+    num_rows, buffers = _load_buffers(source, dtypes, usecols, kwargs)
+    result = {}
+    for column, (dtype, width, buf) in buffers.items():
+        if dtype == 'S':
+            dtype = 'S%d' % width
+        if num_rows > 0:
+            result[column] = numpy.frombuffer(buf, dtype=dtype)
+        else:
+            result[column] = numpy.empty(0, dtype=dtype)
+    return result
+
+
 class Reader(object):
 
     def __init__(self, source, **kwargs):
         fmt = _fmt(kwargs)
         settings = _settings(kwargs)
+        mmap = bool(kwargs.get('_mmap', False))
+        read_ahead = int(kwargs.get('_read_ahead', 0))
+        threads = kwargs.get('_threads')
+        push = kwargs.get('_push')
+        scan = kwargs.get('_scan', False)
+        compression = kwargs.get('compression')
+        self.__native = _fields is not None and kwargs.get('_native', True)
+        # Only the plain reader accepts compressed input, or rejects it.
+        in_memory = not hasattr(source, 'fileno') and not compression
         try:
-            self.__reader = libfields.Reader(source, fmt, settings)
-            self.__record = libfields.Record(settings)
+            if push is not None and in_memory:
+                self.__reader = libfields.Parser(fmt, settings)
+                self.__record = libfields.Record(settings)
+                self.__read = self.__read_push
+                self.__chunks = (source[i:i + push]
+                    for i in xrange(0, len(source) + 1, push))
+            elif threads is not None and in_memory:
+                self.__reader = libfields.ParallelReader(source, fmt, settings,
+                    threads)
+                self.__record = libfields.Record(settings)
+                self.__read = self.__read_record
+            else:
+                self.__reader = libfields.Reader(source, fmt, settings, mmap,
+                    read_ahead, compression)
+                if scan:
+                    self.__read = self.__read_scan
+                elif self.__native:
+                    self.__record = libfields.Record(settings)
+                    self.__read = self.__read_native
+                else:
+                    self.__batch = libfields.Batch(settings)
+                    self.__read = self.__read_batch
         except ValueError as e:
             raise Error(str(e))
+        self.__records = []
 
     def __iter__(self):
         return self
 
     def next(self):
+        if not self.__records:
+            self.__records = self.__read()
+            if not self.__records:
+                message = self.__reader.error()
+                raise Error(message) if message else StopIteration
+        return self.__records.pop()
+
+    def __read_record(self):
         result = self.__reader.read(self.__record)
         if result != 0:
-            message = self.__reader.error()
-            raise Error(message) if message else StopIteration
+            return []
+        return [self.__fields()]
+
+    def __read_push(self):
+        while self.__reader.read(self.__record) != 0:
+            if not self.__reader.starved():
+                return []
+            self.__reader.feed(next(self.__chunks, ''))
+        return [self.__fields()]
+
+    def __read_native(self):
+        records = _fields.read(self.__reader.ptr, self.__record.ptr,
+            _BATCH_SIZE)
+        records.reverse()
+        return records
+
+    def __read_scan(self):
+        records = [[]]
+        callbacks = libfields.Callbacks(
+            lambda value, index: records[-1].append(value),
+            lambda: records.append([]))
+        self.__reader.scan(callbacks)
+        records.pop()
+        records.reverse()
+        return records
+
+    def __read_batch(self):
+        result = self.__reader.read_batch(self.__batch, _BATCH_SIZE)
+        if result != 0:
+            return []
+        records = self.__batch.records()
+        records.reverse()
+        return records
+
+    def __fields(self):
+        if self.__native:
+            return _fields.fields(self.__record.ptr)
         return [self.__record.field(i) for i in xrange(self.__record.size())]
 
 
+_BATCH_SIZE = 256
+
+_COLUMN_TYPES = {
+    'int64':          0,
+    'float64':        1,
+    'datetime64[D]':  2,
+    'datetime64[us]': 3,
+    'S':              4,
+}
+
+
+def _load_buffers(source, dtypes, usecols, options):
+    if _fields is None:
+        raise Error('The native extension is not available')
+    if usecols is None:
+        if not isinstance(dtypes, dict):
+            raise Error('No columns')
+        usecols = sorted(dtypes)
+    usecols = list(usecols)
+    if isinstance(dtypes, dict):
+        dtypes = [dtypes[column] for column in usecols]
+    types = [_column_type(dtype) for dtype in dtypes]
+    if len(types) != len(usecols) or len(set(usecols)) != len(usecols) or \
+            any(column < 0 for column in usecols):
+        raise Error('Bad columns')
+    # The record holds the projected fields only, in ascending order.
+    projection = sorted(usecols)
+    specs = [(column, projection.index(column), _COLUMN_TYPES[name], width)
+        for column, (name, width) in zip(usecols, types)]
+    options = dict(options, _projection=projection)
+    fmt = _fmt(options)
+    settings = _settings(options)
+    compression = options.get('compression')
+    try:
+        reader = libfields.Reader(source, fmt, settings, False, 0,
+            compression)
+        record = libfields.Record(settings)
+        num_rows, buffers = _fields.load(reader.ptr, record.ptr, specs)
+    except ValueError as e:
+        raise Error(str(e))
+    message = reader.error()
+    if message:
+        raise Error(message)
+    result = {}
+    for column, (name, _), (buf, width) in zip(usecols, types, buffers):
+        result[column] = (name, width, buf)
+    return num_rows, result
+
+
+def _column_type(dtype):
+    # NumPy dtype objects print as their names, such as `|S8`.
+    name = str(dtype).lstrip('|<=')
+    if name.startswith('S') and name[1:].isdigit() and int(name[1:]) > 0:
+        return 'S', int(name[1:])
+    if name not in _COLUMN_TYPES:
+        raise Error('Bad dtype: %s' % dtype)
+    return name, 0
+
+
 def _fmt(options):
     return libfields.Format(
         delimiter = options.get('delimiter', ',') or '\0',
@@ -59,9 +269,25 @@ def _fmt(options):
     )
 
 def _settings(options):
-    return libfields.Settings(
+    projection = options.get('_projection')
+    if projection is not None:
+        projection = (ctypes.c_size_t * len(projection))(*projection)
+    arena = options.get('_arena')
+    allocator = ctypes.addressof(arena.allocator) if arena else None
+    settings = libfields.Settings(
         expand             = int(options.get('_expand', True)),
         source_buffer_size = options.get('_source_buffer_size', 4 * 1024),
         record_buffer_size = options.get('_record_buffer_size', 1024 * 1024),
         record_max_fields  = options.get('_record_max_fields', 1023),
+        views              = int(options.get('_views', False)),
+        projection         = projection,
+        projection_size    = len(projection) if projection is not None else 0,
+        allocator          = allocator,
+        sink_buffer_size   = options.get('_sink_buffer_size', 64 * 1024),
     )
+    settings.record_shrink_interval = options.get('_record_shrink_interval',
+        1024)
+    # The objects allocated from an arena keep it alive through the
+    # settings.
+    settings.arena = arena
+    return settings
@@ -25,12 +25,82 @@ class Position(ctypes.Structure):
 Position_p = ctypes.POINTER(Position)
 
 
+class Footprint(ctypes.Structure):
+    _fields_ = [
+        ('current', ctypes.c_size_t),
+        ('peak', ctypes.c_size_t)
+    ]
+
+Footprint_p = ctypes.POINTER(Footprint)
+
+
+FieldCallback = ctypes.CFUNCTYPE(None, ctypes.c_void_p,
+    ctypes.POINTER(ctypes.c_char), ctypes.c_size_t, ctypes.c_size_t)
+
+RecordEndCallback = ctypes.CFUNCTYPE(None, ctypes.c_void_p)
+
+
+class Callbacks(ctypes.Structure):
+    _fields_ = [
+        ('on_field', FieldCallback),
+        ('on_record_end', RecordEndCallback)
+    ]
+
+    def __init__(self, on_field, on_record_end):
+        super(Callbacks, self).__init__(
+            FieldCallback(lambda context, value, length, index:
+                on_field(ctypes.string_at(value, length), index)),
+            RecordEndCallback(lambda context: on_record_end()))
+
+Callbacks_p = ctypes.POINTER(Callbacks)
+
+
+class Checkpoint(ctypes.Structure):
+    _fields_ = [
+        ('offset', ctypes.c_uint64),
+        ('row', ctypes.c_uint64),
+        ('cr', ctypes.c_int)
+    ]
+
+    def encode(self):
+        buf = ctypes.create_string_buffer(_CHECKPOINT_SIZE)
+        _so.fields_checkpoint_encode(self, buf)
+        return buf.raw
+
+    @classmethod
+    def decode(cls, value):
+        checkpoint = cls()
+        if _so.fields_checkpoint_decode(checkpoint, value) != 0:
+            return None
+        return checkpoint
+
+Checkpoint_p = ctypes.POINTER(Checkpoint)
+
+_CHECKPOINT_SIZE = 24
+
+
 class Reader(object):
 
-    def __init__(self, source, fmt, settings):
+    def __init__(self, source, fmt, settings, mmap=False, read_ahead=0,
+            compression=None):
+        read_fd = _so.fields_read_mmap if mmap else _so.fields_read_fd
+        self.ptr = None
+        self.settings = settings
+        if compression:
+            read_compressed = _DECOMPRESSORS.get(compression)
+            if read_compressed is None:
+                raise ValueError('Bad compression')
+            if not hasattr(source, 'fileno'):
+                raise ValueError('Compression requires a file')
         try:
             self.source = source
-            self.ptr = _so.fields_read_fd(self.source.fileno(), fmt, settings)
+            fd = self.source.fileno()
+            if compression:
+                self.ptr = read_compressed(fd, fmt, settings, read_ahead or 4)
+            elif read_ahead:
+                self.ptr = _so.fields_read_ahead(fd, fmt, settings, read_ahead)
+            else:
+                self.ptr = read_fd(fd, fmt, settings)
         except AttributeError:
             self.source = str(source)
             self.ptr = _so.fields_read_buffer(self.source, len(self.source),
@@ -42,6 +112,8 @@ class Reader(object):
             message = settings_strerror(settings)
             if message:
                 raise ValueError(message)
+            if compression:
+                raise ValueError('Unsupported compression')
             raise MemoryError
 
     def __del__(self):
@@ -51,6 +123,27 @@ class Reader(object):
     def read(self, record):
         return _so.fields_reader_read(self.ptr, record.ptr)
 
+    def read_batch(self, batch, max_records):
+        return _so.fields_reader_read_batch(self.ptr, batch.ptr, max_records)
+
+    def scan(self, callbacks):
+        return _so.fields_reader_scan(self.ptr, callbacks, None)
+
+    def read_columns(self, columns, max_rows):
+        return _so.fields_reader_read_columns(self.ptr, columns.ptr, max_rows)
+
+    def seek(self, index, record_number):
+        return _so.fields_reader_seek(self.ptr, index.ptr, record_number)
+
+    def checkpoint(self):
+        checkpoint = Checkpoint()
+        if _so.fields_reader_checkpoint(self.ptr, checkpoint) != 0:
+            return None
+        return checkpoint
+
+    def restore(self, checkpoint):
+        return _so.fields_reader_restore(self.ptr, checkpoint)
+
     def error(self):
         message = self.strerror()
         return '%s: %s' % (self.position(), message) if message else None
@@ -68,9 +161,178 @@ class Reader(object):
 Reader_p = ctypes.c_void_p
 
 
+class Index(object):
+
+    def __init__(self, ptr, settings):
+        self.ptr = ptr
+        self.settings = settings
+
+    def __del__(self):
+        if self.ptr:
+            _so.fields_index_free(self.ptr)
+
+    @classmethod
+    def build(cls, reader, interval, settings):
+        ptr = _so.fields_index_build(reader.ptr, interval, settings)
+        return cls(ptr, settings) if ptr else None
+
+    @classmethod
+    def load(cls, path, source, fmt, settings):
+        ptr = _so.fields_index_load_sidecar(path, source.fileno(), fmt,
+            settings)
+        return cls(ptr, settings) if ptr else None
+
+    def save(self, path, source):
+        return _so.fields_index_save_sidecar(self.ptr, path, source.fileno())
+
+    def records(self):
+        return _so.fields_index_records(self.ptr)
+
+
+Index_p = ctypes.c_void_p
+
+
+class ParallelReader(object):
+
+    def __init__(self, source, fmt, settings, threads):
+        self.settings = settings
+        self.source = str(source)
+        self.ptr = _so.fields_parallel_alloc(self.source, len(self.source),
+            fmt, settings, threads)
+        if not self.ptr:
+            message = format_strerror(fmt)
+            if message:
+                raise ValueError(message)
+            message = settings_strerror(settings)
+            if message:
+                raise ValueError(message)
+            raise MemoryError
+
+    def __del__(self):
+        if self.ptr:
+            _so.fields_parallel_free(self.ptr)
+
+    def read(self, record):
+        return _so.fields_parallel_read(self.ptr, record.ptr)
+
+    def error(self):
+        message = self.strerror()
+        return '%s: %s' % (self.position(), message) if message else None
+
+    def position(self):
+        position = Position()
+        _so.fields_parallel_position(self.ptr, position)
+        return '%d:%d' % (position.row, position.column)
+
+    def strerror(self):
+        result = _so.fields_parallel_error(self.ptr)
+        return _so.fields_reader_strerror(result) if result else None
+
+
+ParallelReader_p = ctypes.c_void_p
+
+
+class Parser(object):
+
+    def __init__(self, fmt, settings):
+        self.settings = settings
+        self.chunk = None
+        self.ptr = _so.fields_parser_alloc(fmt, settings)
+        if not self.ptr:
+            message = format_strerror(fmt)
+            if message:
+                raise ValueError(message)
+            message = settings_strerror(settings)
+            if message:
+                raise ValueError(message)
+            raise MemoryError
+
+    def __del__(self):
+        if self.ptr:
+            _so.fields_parser_free(self.ptr)
+
+    def feed(self, chunk):
+        self.chunk = str(chunk)
+        return _so.fields_parser_feed(self.ptr, self.chunk, len(self.chunk))
+
+    def read(self, record):
+        return _so.fields_parser_read(self.ptr, record.ptr)
+
+    def scan(self, callbacks):
+        return _so.fields_parser_scan(self.ptr, callbacks, None)
+
+    def starved(self):
+        return _so.fields_parser_starved(self.ptr)
+
+    def error(self):
+        message = self.strerror()
+        return '%s: %s' % (self.position(), message) if message else None
+
+    def position(self):
+        position = Position()
+        _so.fields_parser_position(self.ptr, position)
+        return '%d:%d' % (position.row, position.column)
+
+    def strerror(self):
+        result = _so.fields_parser_error(self.ptr)
+        return _so.fields_reader_strerror(result) if result else None
+
+
+Parser_p = ctypes.c_void_p
+
+
+class Writer(object):
+
+    def __init__(self, sink, fmt, settings):
+        self.settings = settings
+        try:
+            self.sink = sink
+            self.ptr = _so.fields_write_fd(self.sink.fileno(), fmt, settings)
+        except AttributeError:
+            self.sink = ctypes.create_string_buffer(sink)
+            self.length = ctypes.c_size_t()
+            self.ptr = _so.fields_write_buffer(self.sink, sink, self.length,
+                fmt, settings)
+        if not self.ptr:
+            message = format_strerror(fmt)
+            if message:
+                raise ValueError(message)
+            message = settings_strerror(settings)
+            if message:
+                raise ValueError(message)
+            raise MemoryError
+
+    def __del__(self):
+        if self.ptr:
+            _so.fields_writer_free(self.ptr)
+
+    def write_field(self, value):
+        return _so.fields_writer_write_field(self.ptr, _field(value))
+
+    def end_record(self):
+        return _so.fields_writer_end_record(self.ptr)
+
+    def write_record(self, record):
+        return _so.fields_writer_write_record(self.ptr, record.ptr)
+
+    def flush(self):
+        return _so.fields_writer_flush(self.ptr)
+
+    def value(self):
+        return self.sink.raw[:self.length.value]
+
+    def error(self):
+        result = _so.fields_writer_error(self.ptr)
+        return _so.fields_writer_strerror(result) if result else None
+
+
+Writer_p = ctypes.c_void_p
+
+
 class Record(object):
 
     def __init__(self, settings):
+        self.settings = settings
         self.ptr = _so.fields_record_alloc(settings)
         if not self.ptr:
             raise MemoryError
@@ -89,10 +351,90 @@ class Record(object):
     def size(self):
         return _so.fields_record_size(self.ptr)
 
+    def footprint(self):
+        footprint = Footprint()
+        _so.fields_record_footprint(self.ptr, footprint)
+        return (footprint.current, footprint.peak)
+
 
 Record_p = ctypes.c_void_p
 
 
+class Batch(object):
+
+    def __init__(self, settings):
+        self.settings = settings
+        self.ptr = _so.fields_batch_alloc(settings)
+        if not self.ptr:
+            raise MemoryError
+
+    def __del__(self):
+        if self.ptr:
+            _so.fields_batch_free(self.ptr)
+
+    def records(self):
+        size = _so.fields_batch_size(self.ptr)
+        values = ctypes.POINTER(ctypes.c_char)()
+        fields = ctypes.POINTER(ctypes.c_size_t)()
+        records = ctypes.POINTER(ctypes.c_size_t)()
+        _so.fields_batch_contents(self.ptr, values, fields, records)
+        records = records[:size + 1]
+        fields = fields[:records[size] + 1]
+        values = ctypes.string_at(values, fields[-1])
+        return [[values[fields[i]:fields[i + 1] - 1]
+            for i in xrange(records[j], records[j + 1])] for j in xrange(size)]
+
+    def size(self):
+        return _so.fields_batch_size(self.ptr)
+
+
+Batch_p = ctypes.c_void_p
+
+
+class Column(ctypes.Structure):
+    _fields_ = [
+        ('values', ctypes.POINTER(ctypes.c_char)),
+        ('offsets', ctypes.POINTER(ctypes.c_int32)),
+        ('validity', ctypes.POINTER(ctypes.c_uint8)),
+        ('null_count', ctypes.c_size_t)
+    ]
+
+Column_p = ctypes.POINTER(Column)
+
+
+class Columns(object):
+
+    def __init__(self, num_columns, settings):
+        self.num_columns = num_columns
+        self.settings = settings
+        self.ptr = _so.fields_columns_alloc(num_columns, settings)
+        if not self.ptr:
+            raise MemoryError
+
+    def __del__(self):
+        if self.ptr:
+            _so.fields_columns_free(self.ptr)
+
+    def column(self, index):
+        size = _so.fields_columns_size(self.ptr)
+        column = Column()
+        result = _so.fields_columns_column(self.ptr, index, column)
+        if result != 0:
+            raise IndexError
+        offsets = column.offsets[:size + 1]
+        validity = column.validity[:(size + 7) // 8]
+        values = ctypes.string_at(column.values, offsets[size])
+        return [values[offsets[i]:offsets[i + 1]]
+            if validity[i // 8] & (1 << (i % 8)) else None
+            for i in xrange(size)]
+
+    def size(self):
+        return _so.fields_columns_size(self.ptr)
+
+
+Columns_p = ctypes.c_void_p
+
+
 class Format(ctypes.Structure):
     _fields_ = [
         ('delimiter', ctypes.c_char),
@@ -107,18 +449,88 @@ class Settings(ctypes.Structure):
         ('expand', ctypes.c_int),
         ('source_buffer_size', ctypes.c_size_t),
         ('record_buffer_size', ctypes.c_size_t),
-        ('record_max_fields', ctypes.c_size_t)
+        ('record_max_fields', ctypes.c_size_t),
+        ('views', ctypes.c_int),
+        ('projection', ctypes.POINTER(ctypes.c_size_t)),
+        ('projection_size', ctypes.c_size_t),
+        ('allocator', ctypes.c_void_p),
+        ('record_shrink_interval', ctypes.c_size_t),
+        ('sink_buffer_size', ctypes.c_size_t)
     ]
 
 Settings_p = ctypes.POINTER(Settings)
 
 
+class Allocator(ctypes.Structure):
+    _fields_ = [
+        ('alloc', ctypes.c_void_p),
+        ('realloc', ctypes.c_void_p),
+        ('free', ctypes.c_void_p),
+        ('context', ctypes.c_void_p)
+    ]
+
+Allocator_p = ctypes.POINTER(Allocator)
+
+
+class Arena(object):
+
+    def __init__(self, size):
+        self.ptr = _so.fields_arena_alloc(size)
+        if not self.ptr:
+            raise MemoryError
+        self.allocator = Allocator()
+        _so.fields_arena_allocator(self.ptr, self.allocator)
+
+    def __del__(self):
+        if self.ptr:
+            _so.fields_arena_free(self.ptr)
+
+    def used(self):
+        return _so.fields_arena_used(self.ptr)
+
+
+Arena_p = ctypes.c_void_p
+
+
+def field_int64(value):
+    result = ctypes.c_int64()
+    _convert(_so.fields_field_int64(_field(value), result))
+    return result.value
+
+def field_double(value):
+    result = ctypes.c_double()
+    _convert(_so.fields_field_double(_field(value), result))
+    return result.value
+
+def field_decimal(value, scale):
+    result = ctypes.c_int64()
+    _convert(_so.fields_field_decimal(_field(value), scale, result))
+    return result.value
+
+def field_date(value):
+    result = ctypes.c_int32()
+    _convert(_so.fields_field_date(_field(value), result))
+    return result.value
+
+def field_timestamp(value):
+    result = ctypes.c_int64()
+    _convert(_so.fields_field_timestamp(_field(value), result))
+    return result.value
+
+def _field(value):
+    return Field(ctypes.cast(ctypes.c_char_p(value),
+        ctypes.POINTER(ctypes.c_char)), len(value))
+
+def _convert(result):
+    if result != 0:
+        raise ValueError(_so.fields_conversion_strerror(result))
+
 def format_strerror(fmt):
     result = _so.fields_format_error(fmt)
     return _so.fields_format_strerror(result) if result else None
 
 def settings_strerror(settings):
-    result = _so.settings_strerror(settings)
+    result = _so.fields_settings_error(settings)
     return _so.fields_settings_strerror(result) if result else None
 
 
@@ -133,12 +545,74 @@ _so.fields_read_buffer.restype = Reader_p
 _so.fields_read_fd.argtypes = [ ctypes.c_int, Format_p, Settings_p ]
 _so.fields_read_fd.restype = Reader_p
 
+_so.fields_read_mmap.argtypes = [ ctypes.c_int, Format_p, Settings_p ]
+_so.fields_read_mmap.restype = Reader_p
+
+_so.fields_read_ahead.argtypes = [
+    ctypes.c_int,
+    Format_p,
+    Settings_p,
+    ctypes.c_uint
+]
+_so.fields_read_ahead.restype = Reader_p
+
+_so.fields_read_gzip.argtypes = [
+    ctypes.c_int,
+    Format_p,
+    Settings_p,
+    ctypes.c_uint
+]
+_so.fields_read_gzip.restype = Reader_p
+
+_so.fields_read_zstd.argtypes = [
+    ctypes.c_int,
+    Format_p,
+    Settings_p,
+    ctypes.c_uint
+]
+_so.fields_read_zstd.restype = Reader_p
+
+_DECOMPRESSORS = {
+    'gzip': _so.fields_read_gzip,
+    'zstd': _so.fields_read_zstd
+}
+
 _so.fields_reader_free.argtypes = [ Reader_p ]
 _so.fields_reader_free.restype = None
 
 _so.fields_reader_read.argtypes = [ Reader_p, Record_p ]
 _so.fields_reader_read.restype = ctypes.c_int
 
+_so.fields_reader_read_batch.argtypes = [ Reader_p, Batch_p, ctypes.c_size_t ]
+_so.fields_reader_read_batch.restype = ctypes.c_int
+
+_so.fields_reader_read_columns.argtypes = [ Reader_p, Columns_p, ctypes.c_size_t ]
+_so.fields_reader_read_columns.restype = ctypes.c_int
+
+_so.fields_reader_scan.argtypes = [ Reader_p, Callbacks_p, ctypes.c_void_p ]
+_so.fields_reader_scan.restype = ctypes.c_int
+
+_so.fields_reader_seek.argtypes = [ Reader_p, Index_p, ctypes.c_size_t ]
+_so.fields_reader_seek.restype = ctypes.c_int
+
+_so.fields_reader_checkpoint.argtypes = [ Reader_p, Checkpoint_p ]
+_so.fields_reader_checkpoint.restype = ctypes.c_int
+
+_so.fields_reader_restore.argtypes = [ Reader_p, Checkpoint_p ]
+_so.fields_reader_restore.restype = ctypes.c_int
+
+_so.fields_checkpoint_encode.argtypes = [
+    Checkpoint_p,
+    ctypes.POINTER(ctypes.c_char)
+]
+_so.fields_checkpoint_encode.restype = None
+
+_so.fields_checkpoint_decode.argtypes = [
+    Checkpoint_p,
+    ctypes.POINTER(ctypes.c_char)
+]
+_so.fields_checkpoint_decode.restype = ctypes.c_int
+
 _so.fields_reader_position.argtypes = [ Reader_p, Position_p ]
 _so.fields_reader_position.restype = None
 
@@ -148,6 +622,112 @@ _so.fields_reader_error.restype = ctypes.c_int
 _so.fields_reader_strerror.argtypes = [ ctypes.c_int ]
 _so.fields_reader_strerror.restype = ctypes.c_char_p
 
+_so.fields_index_build.argtypes = [ Reader_p, ctypes.c_size_t, Settings_p ]
+_so.fields_index_build.restype = Index_p
+
+_so.fields_index_free.argtypes = [ Index_p ]
+_so.fields_index_free.restype = None
+
+_so.fields_index_records.argtypes = [ Index_p ]
+_so.fields_index_records.restype = ctypes.c_size_t
+
+_so.fields_index_save_sidecar.argtypes = [
+    Index_p,
+    ctypes.c_char_p,
+    ctypes.c_int
+]
+_so.fields_index_save_sidecar.restype = ctypes.c_int
+
+_so.fields_index_load_sidecar.argtypes = [
+    ctypes.c_char_p,
+    ctypes.c_int,
+    Format_p,
+    Settings_p
+]
+_so.fields_index_load_sidecar.restype = Index_p
+
+_so.fields_parallel_alloc.argtypes = [
+    ctypes.POINTER(ctypes.c_char),
+    ctypes.c_size_t,
+    Format_p,
+    Settings_p,
+    ctypes.c_uint
+]
+_so.fields_parallel_alloc.restype = ParallelReader_p
+
+_so.fields_parallel_free.argtypes = [ ParallelReader_p ]
+_so.fields_parallel_free.restype = None
+
+_so.fields_parallel_read.argtypes = [ ParallelReader_p, Record_p ]
+_so.fields_parallel_read.restype = ctypes.c_int
+
+_so.fields_parallel_position.argtypes = [ ParallelReader_p, Position_p ]
+_so.fields_parallel_position.restype = None
+
+_so.fields_parallel_error.argtypes = [ ParallelReader_p ]
+_so.fields_parallel_error.restype = ctypes.c_int
+
+_so.fields_parser_alloc.argtypes = [ Format_p, Settings_p ]
+_so.fields_parser_alloc.restype = Parser_p
+
+_so.fields_parser_free.argtypes = [ Parser_p ]
+_so.fields_parser_free.restype = None
+
+_so.fields_parser_feed.argtypes = [
+    Parser_p,
+    ctypes.POINTER(ctypes.c_char),
+    ctypes.c_size_t
+]
+_so.fields_parser_feed.restype = ctypes.c_int
+
+_so.fields_parser_read.argtypes = [ Parser_p, Record_p ]
+_so.fields_parser_read.restype = ctypes.c_int
+
+_so.fields_parser_scan.argtypes = [ Parser_p, Callbacks_p, ctypes.c_void_p ]
+_so.fields_parser_scan.restype = ctypes.c_int
+
+_so.fields_parser_starved.argtypes = [ Parser_p ]
+_so.fields_parser_starved.restype = ctypes.c_int
+
+_so.fields_parser_position.argtypes = [ Parser_p, Position_p ]
+_so.fields_parser_position.restype = None
+
+_so.fields_parser_error.argtypes = [ Parser_p ]
+_so.fields_parser_error.restype = ctypes.c_int
+
+_so.fields_write_buffer.argtypes = [
+    ctypes.POINTER(ctypes.c_char),
+    ctypes.c_size_t,
+    ctypes.POINTER(ctypes.c_size_t),
+    Format_p,
+    Settings_p
+]
+_so.fields_write_buffer.restype = Writer_p
+
+_so.fields_write_fd.argtypes = [ ctypes.c_int, Format_p, Settings_p ]
+_so.fields_write_fd.restype = Writer_p
+
+_so.fields_writer_free.argtypes = [ Writer_p ]
+_so.fields_writer_free.restype = None
+
+_so.fields_writer_write_field.argtypes = [ Writer_p, Field_p ]
+_so.fields_writer_write_field.restype = ctypes.c_int
+
+_so.fields_writer_end_record.argtypes = [ Writer_p ]
+_so.fields_writer_end_record.restype = ctypes.c_int
+
+_so.fields_writer_write_record.argtypes = [ Writer_p, Record_p ]
+_so.fields_writer_write_record.restype = ctypes.c_int
+
+_so.fields_writer_flush.argtypes = [ Writer_p ]
+_so.fields_writer_flush.restype = ctypes.c_int
+
+_so.fields_writer_error.argtypes = [ Writer_p ]
+_so.fields_writer_error.restype = ctypes.c_int
+
+_so.fields_writer_strerror.argtypes = [ ctypes.c_int ]
+_so.fields_writer_strerror.restype = ctypes.c_char_p
+
 _so.fields_record_alloc.argtypes = [ Settings_p ]
 _so.fields_record_alloc.restype = Record_p
 
@@ -160,6 +740,75 @@ _so.fields_record_field.restype = ctypes.c_int
 _so.fields_record_size.argtypes = [ Record_p ]
 _so.fields_record_size.restype = ctypes.c_size_t
 
+_so.fields_record_footprint.argtypes = [ Record_p, Footprint_p ]
+_so.fields_record_footprint.restype = None
+
+_so.fields_batch_alloc.argtypes = [ Settings_p ]
+_so.fields_batch_alloc.restype = Batch_p
+
+_so.fields_batch_free.argtypes = [ Batch_p ]
+_so.fields_batch_free.restype = None
+
+_so.fields_batch_size.argtypes = [ Batch_p ]
+_so.fields_batch_size.restype = ctypes.c_size_t
+
+_so.fields_batch_contents.argtypes = [
+    Batch_p,
+    ctypes.POINTER(ctypes.POINTER(ctypes.c_char)),
+    ctypes.POINTER(ctypes.POINTER(ctypes.c_size_t)),
+    ctypes.POINTER(ctypes.POINTER(ctypes.c_size_t))
+]
+_so.fields_batch_contents.restype = None
+
+_so.fields_columns_alloc.argtypes = [ ctypes.c_size_t, Settings_p ]
+_so.fields_columns_alloc.restype = Columns_p
+
+_so.fields_columns_free.argtypes = [ Columns_p ]
+_so.fields_columns_free.restype = None
+
+_so.fields_columns_size.argtypes = [ Columns_p ]
+_so.fields_columns_size.restype = ctypes.c_size_t
+
+_so.fields_columns_column.argtypes = [ Columns_p, ctypes.c_size_t, Column_p ]
+_so.fields_columns_column.restype = ctypes.c_int
+
+_so.fields_field_int64.argtypes = [ Field_p, ctypes.POINTER(ctypes.c_int64) ]
+_so.fields_field_int64.restype = ctypes.c_int
+
+_so.fields_field_double.argtypes = [ Field_p, ctypes.POINTER(ctypes.c_double) ]
+_so.fields_field_double.restype = ctypes.c_int
+
+_so.fields_field_decimal.argtypes = [
+    Field_p,
+    ctypes.c_uint,
+    ctypes.POINTER(ctypes.c_int64)
+]
+_so.fields_field_decimal.restype = ctypes.c_int
+
+_so.fields_field_date.argtypes = [ Field_p, ctypes.POINTER(ctypes.c_int32) ]
+_so.fields_field_date.restype = ctypes.c_int
+
+_so.fields_field_timestamp.argtypes = [
+    Field_p,
+    ctypes.POINTER(ctypes.c_int64)
+]
+_so.fields_field_timestamp.restype = ctypes.c_int
+
+_so.fields_arena_alloc.argtypes = [ ctypes.c_size_t ]
+_so.fields_arena_alloc.restype = Arena_p
+
+_so.fields_arena_free.argtypes = [ Arena_p ]
+_so.fields_arena_free.restype = None
+
+_so.fields_arena_used.argtypes = [ Arena_p ]
+_so.fields_arena_used.restype = ctypes.c_size_t
+
+_so.fields_arena_allocator.argtypes = [ Arena_p, Allocator_p ]
+_so.fields_arena_allocator.restype = None
+
+_so.fields_conversion_strerror.argtypes = [ ctypes.c_int ]
+_so.fields_conversion_strerror.restype = ctypes.c_char_p
+
 _so.fields_format_error.argtypes = [ Format_p ]
 _so.fields_format_error.restype = ctypes.c_int
 
@@ -1,15 +1,35 @@
 #!/usr/bin/env python
 
+import StringIO
 import fields
+import gzip
+import os
+import struct
+import subprocess
 import tempfile
 import unittest
 
+from fields import libfields
+
 
 class TestCase(unittest.TestCase):
 
     def assertParseEqual(self, text, output):
-        self.assertEqual(parse_buffer(encode(text), self.options), output)
-        self.assertEqual(parse_file(encode(text), self.options), output)
+        for options in [self.options, dict(self.options, _views=True)]:
+            self.assertEqual(parse_buffer(encode(text), options), output)
+            self.assertEqual(parse_buffer(encode(text),
+                dict(options, _native=False)), output)
+            self.assertEqual(parse_buffer(encode(text),
+                dict(options, _threads=2)), output)
+            self.assertEqual(parse_buffer(encode(text),
+                dict(options, _push=1)), output)
+            self.assertEqual(parse_file(encode(text),
+                dict(options, _scan=True)), output)
+            self.assertEqual(parse_file(encode(text), options), output)
+            self.assertEqual(parse_file(encode(text),
+                dict(options, _mmap=True)), output)
+            self.assertEqual(parse_file(encode(text),
+                dict(options, _read_ahead=2)), output)
 
 
 class OptionsTest(TestCase):
@@ -29,6 +49,9 @@ class OptionsTest(TestCase):
     def test_equal_delimiter_and_quote(self):
         self.assertFail('Bad quote character', delimiter=',', quotechar=',')
 
+    def test_unordered_projection(self):
+        self.assertFail('Bad projection', _projection=[2, 1])
+
     def assertFail(self, message, **kwargs):
         try:
             fields.reader('', **kwargs)
@@ -51,6 +74,15 @@ class CSVTest(TestCase):
     def test_crlf(self):
         self.assertParseEqual('a,b\r\nc\n', [['a', 'b'], ['c']])
 
+    def test_crlf_at_eof(self):
+        self.assertParseEqual('a,b\r\nc\r\n', [['a', 'b'], ['c']])
+
+    def test_empty_record_after_cr(self):
+        self.assertParseEqual('a\rb\n\nc', [['a'], ['b'], [], ['c']])
+
+    def test_empty_record_after_crlf(self):
+        self.assertParseEqual('a\r\n\n"b"c', '3:4: Unexpected character')
+
     def test_missing_newline_at_eof(self):
         self.assertParseEqual('a,b\nc', [['a', 'b'], ['c']])
 
@@ -104,6 +136,19 @@ class CSVTest(TestCase):
     def test_quoted_among_non_quoted(self):
         self.assertParseEqual('a,"b",c', [['a', 'b', 'c']])
 
+    def test_long_quoted_fields(self):
+        self.assertParseEqual('"%s",  "%s"  \n%s\n' %
+            ('a,\n' * 50, 'b""' * 50, 'c' * 100),
+            [['a,\n' * 50, 'b"' * 50], ['c' * 100]])
+
+    def test_long_quoted_with_trailing_garbage(self):
+        self.assertParseEqual('"%s"  b,c' % ('a' * 200),
+            '1:205: Unexpected character')
+
+    def test_garbage_after_multiline_records(self):
+        self.assertParseEqual('"a\r\nb",c\r\nd\re\n"f"g',
+            '5:4: Unexpected character')
+
     def test_tsv(self):
         self.assertParseEqual('a\tb\nc\n', [['a\tb'], ['c']])
 
@@ -149,6 +194,10 @@ class TSVTest(TestCase):
     def test_csv(self):
         self.assertParseEqual('a,b\nc\n', [['a,b'], ['c']])
 
+    def test_long_fields(self):
+        self.assertParseEqual('%s\t%s\r\n%s' % ('a' * 100, 'b' * 33, 'c' * 64),
+            [['a' * 100, 'b' * 33], ['c' * 64]])
+
     def setUp(self):
         self.options = {
             'delimiter': '\t',
@@ -156,6 +205,26 @@ class TSVTest(TestCase):
         }
 
 
+class OtherFormatsTest(TestCase):
+
+    def test_semicolon(self):
+        self.options = {'delimiter': ';', 'quotechar': '"'}
+        self.assertParseEqual('a;"b;\n""c"""\n', [['a', 'b;\n"c"']])
+
+    def test_pipe(self):
+        self.options = {'delimiter': '|', 'quotechar': None}
+        self.assertParseEqual('a|"b|c\n', [['a', '"b', 'c']])
+
+    def test_custom_quoted(self):
+        self.options = {'delimiter': '\t', 'quotechar': "'"}
+        self.assertParseEqual("a\t 'b\tc' \t'd'e",
+            '1:14: Unexpected character')
+
+    def test_custom_unquoted(self):
+        self.options = {'delimiter': ':', 'quotechar': None}
+        self.assertParseEqual('a:"b:c\n', [['a', '"b', 'c']])
+
+
 class UTF8Test(TestCase):
 
     def test_one_byte(self):
@@ -182,6 +251,12 @@ class UTF8Test(TestCase):
     def test_four_byte_traversal(self):
         self.assertParseEqual(u'\U000103A0"', '1:2: Unexpected character')
 
+    def test_latin1_traversal(self):
+        reader = fields.reader('\xe9\xe9\n\xe9"')
+        self.assertEqual(next(reader), ['\xe9\xe9'])
+        self.assertRaisesRegexp(fields.Error, '^2:2: Unexpected character$',
+            next, reader)
+
     def setUp(self):
         self.options = {
             'delimiter': ',',
@@ -189,6 +264,717 @@ class UTF8Test(TestCase):
         }
 
 
+class FileOffsetTest(TestCase):
+
+    def test_offset_within_page(self):
+        self.assertParseAtEqual('a,b\nc,d\n', 4, [['c', 'd']])
+
+    def test_offset_beyond_page(self):
+        self.assertParseAtEqual('a\n' * 4096 + 'b,c\n', 8192, [['b', 'c']])
+
+    def test_offset_at_end(self):
+        self.assertParseAtEqual('a,b\n', 4, [])
+
+    def assertParseAtEqual(self, text, offset, output):
+        for mmap in [False, True]:
+            with tempfile.TemporaryFile() as outfile:
+                outfile.write(text)
+                outfile.flush()
+                os.lseek(outfile.fileno(), offset, os.SEEK_SET)
+                self.assertEqual(parse(outfile, {'_mmap': mmap}), output)
+
+
+class ParallelTest(TestCase):
+
+    def test_many_chunks(self):
+        text = ''.join('%d,"%s\r\n",%s\r\n' % (i, 'a' * (i % 7), 'b' * (i % 5))
+            for i in xrange(2000))
+        self.assertParseEqual(text, parse_buffer(text, self.options))
+
+    def test_error_in_later_chunk(self):
+        text = 'a,"b\nc"\n' * 1000 + 'd,e"f\n'
+        self.assertParseEqual(text, '2001:4: Unexpected character')
+
+    def setUp(self):
+        self.options = {
+            '_source_buffer_size': 1024,
+            '_threads': 3
+        }
+
+
+class ReadAheadTest(TestCase):
+
+    def test_many_buffers(self):
+        text = ''.join('%d,"%s\r\n",%s\r\n' % (i, 'a' * (i % 7), 'b' * (i % 5))
+            for i in xrange(2000))
+        for read_ahead in [2, 3, 8]:
+            self.assertEqual(parse_file(text,
+                dict(self.options, _read_ahead=read_ahead)),
+                parse_buffer(text, {}))
+
+    def test_error_in_later_buffer(self):
+        text = 'a,"b\nc"\n' * 1000 + 'd,e"f\n'
+        self.assertEqual(parse_file(text, self.options),
+            '2001:4: Unexpected character')
+
+    def setUp(self):
+        self.options = {
+            '_source_buffer_size': 1024,
+            '_read_ahead': 2
+        }
+
+
+class ParserTest(unittest.TestCase):
+
+    def test_chunks(self):
+        text = ''.join('%d,"%s\r\n",%s\r\n' % (i, 'a' * (i % 70),
+            'b' * (i % 50)) for i in xrange(2000))
+        for push in [1, 2, 63, 64, 65, 1000, 4096]:
+            for options in [{}, { '_views': True }, { '_projection': [1] }]:
+                self.assertEqual(parse_buffer(text, dict(options, _push=push)),
+                    parse_buffer(text, options))
+
+    def test_starved(self):
+        settings = fields.api._settings({})
+        parser = libfields.Parser(fields.api._fmt({}), settings)
+        record = libfields.Record(settings)
+        self.assertTrue(parser.starved())
+        self.assertNotEqual(parser.read(record), 0)
+        self.assertEqual(parser.feed('a,"b'), 0)
+        self.assertNotEqual(parser.feed('c'), 0)
+        self.assertNotEqual(parser.read(record), 0)
+        self.assertTrue(parser.starved())
+        self.assertEqual(parser.feed('c",d\ne'), 0)
+        self.assertEqual(parser.read(record), 0)
+        self.assertEqual([record.field(i) for i in xrange(record.size())],
+            ['a', 'bc', 'd'])
+        self.assertNotEqual(parser.read(record), 0)
+        self.assertTrue(parser.starved())
+        self.assertEqual(parser.feed(''), 0)
+        self.assertEqual(parser.read(record), 0)
+        self.assertEqual(record.field(0), 'e')
+        self.assertNotEqual(parser.read(record), 0)
+        self.assertFalse(parser.starved())
+        self.assertNotEqual(parser.feed('f'), 0)
+
+    def test_error(self):
+        self.assertEqual(parse_buffer('a,b\nc,"d"e\n', { '_push': 3 }),
+            '2:6: Unexpected character')
+
+
+class ScanTest(unittest.TestCase):
+
+    def test_scan(self):
+        text = ''.join('%d,"%s\r\n",%s\n%d,%s\r\n\n' % (i, 'a' * (i % 70),
+            'b' * (i % 50), i, 'c' * (i % 3)) for i in xrange(2000))
+        for options in [{}, { '_projection': [1] }, { '_expand': False },
+                { '_source_buffer_size': 1024 }]:
+            self.assertEqual(parse_buffer(text, dict(options, _scan=True)),
+                parse_buffer(text, options))
+
+    def test_erroneous_record(self):
+        events = scan('a,b\nc,d,"e"f\n')
+        self.assertEqual(events, [('a', 0), ('b', 1), None, ('c', 0),
+            ('d', 1), '2:8: Unexpected character'])
+
+    def test_parser(self):
+        settings = fields.api._settings({})
+        parser = libfields.Parser(fields.api._fmt({}), settings)
+        events = []
+        callbacks = libfields.Callbacks(
+            lambda value, index: events.append((value, index)),
+            lambda: events.append(None))
+        for chunk in ['a,b', 'c\nd,"e', '\n",f\n', '']:
+            self.assertEqual(parser.feed(chunk), 0)
+            self.assertEqual(parser.scan(callbacks), 0)
+        self.assertEqual(events, [('a', 0), ('bc', 1), None, ('d', 0),
+            ('e\n', 1), ('f', 2), None])
+
+
+class IndexTest(unittest.TestCase):
+
+    text = ''.join('%d,"%s",%s\r\n' % (i, 'a\nb' * (i % 3), 'c' * (i % 50))
+        for i in xrange(500))
+
+    def test_seek(self):
+        for options in [{}, { '_views': True }, { '_projection': [1] }]:
+            records = seek(self.text, 1000, 0, options)
+            for interval in [1, 7, 64, 1000]:
+                for number in [0, 1, 63, 64, 65, 499, 500]:
+                    self.assertEqual(seek(self.text, interval, number,
+                        options), records[number:])
+
+    def test_position(self):
+        settings = fields.api._settings({})
+        fmt = fields.api._fmt({})
+        reader = libfields.Reader(self.text, fmt, settings)
+        record = libfields.Record(settings)
+        for number in xrange(100):
+            reader.read(record)
+        index = libfields.Index.build(libfields.Reader(self.text, fmt,
+            settings), 64, settings)
+        seeker = libfields.Reader(self.text, fmt, settings)
+        self.assertEqual(seeker.seek(index, 100), 0)
+        self.assertEqual(seeker.position(), reader.position())
+        self.assertEqual(seeker.position(), '200:0')
+
+    def test_out_of_range(self):
+        settings = fields.api._settings({})
+        fmt = fields.api._fmt({})
+        index = libfields.Index.build(libfields.Reader(self.text, fmt,
+            settings), 64, settings)
+        self.assertEqual(index.records(), 500)
+        reader = libfields.Reader(self.text, fmt, settings)
+        self.assertNotEqual(reader.seek(index, 501), 0)
+        self.assertEqual(reader.seek(index, 500), 0)
+        self.assertNotEqual(reader.seek(index, 501), 0)
+        self.assertEqual(reader.seek(index, 499), 0)
+        self.assertEqual(reader.read(libfields.Record(settings)), 0)
+
+    def test_sidecar(self):
+        settings = fields.api._settings({})
+        fmt = fields.api._fmt({})
+        directory = tempfile.mkdtemp()
+        try:
+            path = os.path.join(directory, 'index')
+            with tempfile.TemporaryFile() as source:
+                source.write(self.text)
+                source.seek(0)
+                index = libfields.Index.build(libfields.Reader(source, fmt,
+                    settings), 16, settings)
+                self.assertEqual(index.save(path, source), 0)
+                index = libfields.Index.load(path, source, fmt, settings)
+                self.assertEqual(index.records(), 500)
+                self.assertEqual(libfields.Index.load(path, source,
+                    libfields.Format(delimiter='\t', quote='"'), settings),
+                    None)
+                for mmap in [False, True]:
+                    source.seek(0)
+                    reader = libfields.Reader(source, fmt, settings, mmap)
+                    self.assertEqual(reader.seek(index, 250), 0)
+                    self.assertEqual(read_all(reader, settings),
+                        seek(self.text, 1, 250, {}))
+                source.seek(0, os.SEEK_END)
+                source.write('500,,\r\n')
+                source.flush()
+                self.assertEqual(libfields.Index.load(path, source, fmt,
+                    settings), None)
+        finally:
+            if os.path.exists(path):
+                os.remove(path)
+            os.rmdir(directory)
+
+    def test_unseekable(self):
+        settings = fields.api._settings({})
+        fmt = fields.api._fmt({})
+        index = libfields.Index.build(libfields.Reader(self.text, fmt,
+            settings), 64, settings)
+        with tempfile.TemporaryFile() as source:
+            source.write(self.text)
+            source.seek(0)
+            reader = libfields.Reader(source, fmt, settings, read_ahead=2)
+            self.assertNotEqual(reader.seek(index, 100), 0)
+
+
+class CheckpointTest(unittest.TestCase):
+
+    text = ''.join('%d,"%s"%s' % (i, 'a\r\nb' * (i % 3), '\r\n\r\r\n'[i % 3:])
+        for i in xrange(300))
+
+    def test_restore(self):
+        for options in [{}, { '_views': True }, { '_projection': [1] }]:
+            records = resume(self.text, 0, options)
+            for number in [1, 2, 3, 100, 299, 300]:
+                self.assertEqual(resume(self.text, number, options),
+                    records[number:])
+
+    def test_files(self):
+        settings = fields.api._settings({})
+        fmt = fields.api._fmt({})
+        records = parse_buffer(self.text, {})
+        with tempfile.TemporaryFile() as source:
+            source.write(self.text)
+            for mmap in [False, True]:
+                source.seek(0)
+                reader = libfields.Reader(source, fmt, settings, mmap)
+                record = libfields.Record(settings)
+                for number in xrange(151):
+                    reader.read(record)
+                value = reader.checkpoint().encode()
+                source.seek(0)
+                reader = libfields.Reader(source, fmt, settings, mmap)
+                self.assertEqual(reader.restore(
+                    libfields.Checkpoint.decode(value)), 0)
+                self.assertEqual(read_all(reader, settings), records[151:])
+
+    def test_error(self):
+        settings = fields.api._settings({})
+        fmt = fields.api._fmt({})
+        reader = libfields.Reader('a\n"b"c\nd\n', fmt, settings)
+        record = libfields.Record(settings)
+        self.assertEqual(reader.read(record), 0)
+        checkpoint = reader.checkpoint()
+        self.assertNotEqual(reader.read(record), 0)
+        self.assertEqual(reader.checkpoint(), None)
+        self.assertEqual(reader.restore(checkpoint), 0)
+        self.assertEqual(reader.error(), None)
+        self.assertEqual(read_all(reader, settings),
+            parse_buffer('a\n"b"c\nd\n', {}))
+
+    def test_decode(self):
+        self.assertEqual(libfields.Checkpoint.decode('\0' * 16 + '\2' +
+            '\0' * 7), None)
+
+
+class CompressionTest(unittest.TestCase):
+
+    text = ''.join('%d,"%s\n",%s\n' % (i, 'a' * (i % 70), 'b' * (i % 50))
+        for i in xrange(20000))
+
+    def test_gzip(self):
+        if not supported('gzip'):
+            return
+        self.assertEqual(parse_compressed(gzip_compress(self.text), 'gzip'),
+            parse_buffer(self.text, {}))
+
+    def test_gzip_members(self):
+        if not supported('gzip'):
+            return
+        half = len(self.text) / 2
+        self.assertEqual(parse_compressed(gzip_compress(self.text[:half]) +
+            gzip_compress(self.text[half:]), 'gzip'),
+            parse_buffer(self.text, {}))
+
+    def test_gzip_truncated(self):
+        if not supported('gzip'):
+            return
+        value = gzip_compress(self.text)
+        self.assertTrue(parse_compressed(value[:len(value) / 2],
+            'gzip').endswith(': Unreadable source'))
+
+    def test_zstd(self):
+        if not supported('zstd') or not zstd_available():
+            return
+        half = len(self.text) / 2
+        self.assertEqual(parse_compressed(zstd_compress(self.text[:half]) +
+            zstd_compress(self.text[half:]), 'zstd'),
+            parse_buffer(self.text, {}))
+
+    def test_zstd_truncated(self):
+        if not supported('zstd') or not zstd_available():
+            return
+        value = zstd_compress(self.text)
+        self.assertTrue(parse_compressed(value[:len(value) / 2],
+            'zstd').endswith(': Unreadable source'))
+
+    def test_empty(self):
+        for compression in ['gzip', 'zstd']:
+            if supported(compression):
+                self.assertEqual(parse_compressed('', compression), [])
+
+    def test_bad_compression(self):
+        with tempfile.TemporaryFile() as source:
+            self.assertRaises(fields.Error, fields.reader, source,
+                compression='lzma')
+        self.assertRaisesRegexp(fields.Error, '^Bad compression$',
+            fields.reader, 'a,b\n', compression='lzma')
+
+    def test_compression_without_file(self):
+        for options in [{}, { '_push': 1 }, { '_threads': 2 }]:
+            self.assertRaisesRegexp(fields.Error,
+                '^Compression requires a file$', fields.reader,
+                gzip_compress('a,b\n'), compression='gzip', **options)
+        self.assertRaises(fields.Error, fields.columns, 'a,b\n', 2,
+            compression='gzip')
+
+
+class NativeTest(unittest.TestCase):
+
+    text = ''.join('%d,"%s\n",%s\r\n' % (i, 'a' * (i % 70), 'b' * (i % 50))
+        for i in xrange(2000))
+
+    def test_loaded(self):
+        self.assertNotEqual(fields.api._fields, None)
+
+    def test_read(self):
+        for options in [{}, { '_views': True }, { '_projection': [0, 2] }]:
+            settings = fields.api._settings(options)
+            reader = libfields.Reader(self.text, fields.api._fmt(options),
+                settings)
+            record = libfields.Record(settings)
+            records = []
+            for size in [0, 1, 7, 1000, 5000]:
+                batch = fields.api._fields.read(reader.ptr, record.ptr, size)
+                self.assertTrue(len(batch) <= size)
+                records.extend(batch)
+            self.assertEqual(records, parse_buffer(self.text,
+                dict(options, _native=False)))
+
+    def test_fields(self):
+        settings = fields.api._settings({})
+        reader = libfields.Reader('a,"b\x00c",\n', fields.api._fmt({}),
+            settings)
+        record = libfields.Record(settings)
+        self.assertEqual(reader.read(record), 0)
+        self.assertEqual(fields.api._fields.fields(record.ptr),
+            ['a', 'b\x00c', ''])
+
+
+class ArenaTest(unittest.TestCase):
+
+    def test_read(self):
+        arena = libfields.Arena(4 * 1024 * 1024)
+        text = 'a,b\n"c\n",d\n' * 100
+        options = { '_arena': arena, '_source_buffer_size': 1024 }
+        self.assertEqual(parse_buffer(text, options), parse_buffer(text, {}))
+        self.assertEqual(parse_file(text, options), parse_buffer(text, {}))
+
+    def test_used(self):
+        arena = libfields.Arena(4 * 1024 * 1024)
+        reader = fields.reader('a,b\n', _arena=arena)
+        self.assertEqual(list(reader), [['a', 'b']])
+        self.assertGreater(arena.used(), 1024 * 1024)
+
+    def test_too_small(self):
+        arena = libfields.Arena(64 * 1024)
+        self.assertRaises(MemoryError, fields.reader, 'a,b\n', _arena=arena)
+
+
+class FootprintTest(unittest.TestCase):
+
+    def test_shrink(self):
+        text = 'a' * 100000 + '\n' + 'b,c\n' * 12
+        for options in [self.options, dict(self.options, _views=True)]:
+            footprints = read_footprints(text, options)
+            self.assertGreater(footprints[0][0], 100000)
+            self.assertLess(footprints[-1][0], 4096)
+            self.assertEqual(footprints[-1][1], footprints[0][1])
+
+    def test_no_shrink(self):
+        text = 'a' * 100000 + '\n' + 'b,c\n' * 12
+        footprints = read_footprints(text,
+            dict(self.options, _record_shrink_interval=0))
+        self.assertEqual(footprints[-1][0], footprints[0][0])
+
+    def test_many_fields(self):
+        text = ',' * 10000 + '\n' + 'b,c\n' * 12
+        footprints = read_footprints(text, self.options)
+        self.assertGreater(footprints[0][0], 40000)
+        self.assertLess(footprints[-1][0], 4096)
+
+    def setUp(self):
+        self.options = {
+            '_record_buffer_size': 1024,
+            '_record_max_fields': 15,
+            '_record_shrink_interval': 4
+        }
+
+
+class WriterTest(unittest.TestCase):
+
+    def test_minimal_quoting(self):
+        self.assertWriteEqual([['a', 'b,c', 'd"e', 'f\ng', 'h\ri', '']],
+            'a,"b,c","d""e","f\ng","h\ri",\n')
+
+    def test_quotes(self):
+        self.assertWriteEqual([['"', '""', 'a"b"c"']],
+            '"""","""""","a""b""c"""\n')
+
+    def test_empty_records(self):
+        self.assertWriteEqual([[], [''], ['', '']], '\n""\n,\n')
+
+    def test_tsv(self):
+        options = { 'delimiter': '\t', 'quotechar': '' }
+        self.assertWriteEqual([['a', 'b "c"', 'd,e']], 'a\tb "c"\td,e\n',
+            options)
+        self.assertWriteEqual([['a\tb']], 'Unquotable field', options)
+        self.assertWriteEqual([['a\nb']], 'Unquotable field', options)
+
+    def test_unquotable_field_after_records(self):
+        options = { 'delimiter': '\t', 'quotechar': '' }
+        writer = libfields.Writer(1024, fields.api._fmt(options),
+            fields.api._settings(options))
+        for record in [['a', 'b'], ['c', 'd\te']]:
+            for value in record:
+                writer.write_field(value)
+            writer.end_record()
+        self.assertNotEqual(writer.flush(), 0)
+        self.assertEqual(writer.error(), 'Unquotable field')
+        self.assertEqual(writer.value(), 'a\tb\n')
+
+    def test_custom_format(self):
+        options = { 'delimiter': ';', 'quotechar': "'" }
+        self.assertWriteEqual([["a'b", 'c;d', 'e,"f"']],
+            "'a''b';'c;d';e,\"f\"\n", options)
+
+    def test_long_fields(self):
+        records = [['a' * 5000, '"' * 3000, 'b,' * 2000], ['c'] * 1000]
+        options = { '_sink_buffer_size': 1024 }
+        text = write(records, options)
+        self.assertEqual(parse_buffer(text, {}), records)
+
+    def test_too_small_buffer(self):
+        self.assertWriteEqual([['abc', 'def']], 'Unwritable sink', {}, 4)
+
+    def test_too_low_sink_buffer_size(self):
+        self.assertRaises(ValueError, write, [], { '_sink_buffer_size': 1023 })
+
+    def test_zero_sink_buffer_size(self):
+        options = { '_sink_buffer_size': 0 }
+        self.assertEqual(parse_buffer('a,b\n', options), [['a', 'b']])
+        self.assertWriteEqual([['a', 'b']], 'a,b\n', options)
+
+    def test_round_trip(self):
+        text = ''.join('%d,"%s\r\n",%s,"x""y"\r\n' % (i, 'a' * (i % 7),
+            'b' * (i % 5)) for i in xrange(2000)) + '""\n\n'
+        for options in [{}, { '_views': True }, { '_sink_buffer_size': 1024 }]:
+            self.assertEqual(parse_buffer(write_file(text, options), {}),
+                parse_buffer(text, {}))
+
+    def assertWriteEqual(self, records, output, options={}, capacity=None):
+        self.assertEqual(write(records, options, capacity), output)
+
+
+class ProjectionTest(TestCase):
+
+    def test_projection(self):
+        self.assertParseEqual('a,b,c,d\ne,f,g,h\n', [['a', 'c'], ['e', 'g']])
+
+    def test_missing_fields(self):
+        self.assertParseEqual('a,b\nc\n\n', [['a'], ['c'], []])
+
+    def test_quoted_skipped_fields(self):
+        self.assertParseEqual('a,"b,\n""",c\n', [['a', 'c']])
+
+    def test_quoted_trailing_fields(self):
+        self.assertParseEqual('a,b,c,"d\n,"\ne,f,g\n', [['a', 'c'], ['e', 'g']])
+
+    def test_empty_fields(self):
+        self.assertParseEqual(',b,\n', [['', '']])
+
+    def test_garbage_in_skipped_field(self):
+        self.assertParseEqual('a,"b"x,c\n', '1:6: Unexpected character')
+
+    def test_garbage_in_trailing_field(self):
+        self.assertParseEqual('a,b,c,"d"x\n', [['a', 'c']])
+
+    def test_tsv(self):
+        self.options.update(delimiter='\t', quotechar=None)
+        self.assertParseEqual('a\t"b\tc\td\n', [['a', 'c']])
+
+    def setUp(self):
+        self.options = {
+            '_projection': [0, 2]
+        }
+
+
+class BatchTest(TestCase):
+
+    def test_many_batches(self):
+        records = [[str(i)] * (i % 4) for i in xrange(1000)]
+        text = ''.join(','.join(record) + '\n' for record in records)
+        self.assertParseEqual(text, records)
+
+    def test_error_after_full_batch(self):
+        text = 'a,b\n' * 256 + '"c"d\n'
+        self.assertParseEqual(text, '257:4: Unexpected character')
+
+    def setUp(self):
+        self.options = {}
+
+
+class ColumnsTest(unittest.TestCase):
+
+    def test_columns(self):
+        self.assertColumnsEqual('a,b\nc,d\n', 2, [['a', 'c'], ['b', 'd']])
+
+    def test_missing_fields(self):
+        self.assertColumnsEqual('a,b,c\nd\n\ne,f\n', 3,
+            [['a', 'd', None, 'e'], ['b', None, None, 'f'],
+             ['c', None, None, None]])
+
+    def test_empty_fields(self):
+        self.assertColumnsEqual('a,\n,\n', 2, [['a', ''], ['', '']])
+
+    def test_quoted(self):
+        self.assertColumnsEqual('"a\nb","c""d"\n', 2, [['a\nb'], ['c"d']])
+
+    def test_many_rows(self):
+        text = ''.join('%d,%s\n' % (i, 'x' * (i % 3)) for i in xrange(2000))
+        self.assertColumnsEqual(text, 3,
+            [[str(i) for i in xrange(2000)],
+             ['x' * (i % 3) for i in xrange(2000)], [None] * 2000])
+
+    def test_too_many_fields(self):
+        self.assertColumnsEqual('a,b\nc,d,e\n', 2, '3:0: Too many fields')
+
+    def assertColumnsEqual(self, text, count, output):
+        try:
+            result = fields.columns(encode(text), count)
+        except fields.Error as e:
+            result = str(e)
+        self.assertEqual(result, output)
+
+
+class LoadColumnsTest(unittest.TestCase):
+
+    def test_types(self):
+        text = '1,2.5,2000-02-29,1970-01-02 00:00:01,ab\n-3,,,,\n'
+        self.assertEqual(load(text, ['int64', 'float64', 'datetime64[D]',
+            'datetime64[us]', 'S'], range(5)), {
+                0: ('int64', [1, -3]),
+                1: ('float64', [2.5, 'nan']),
+                2: ('datetime64[D]', [11016, NAT]),
+                3: ('datetime64[us]', [86401000000, NAT]),
+                4: ('S', ['ab', '\0\0']),
+            })
+
+    def test_usecols(self):
+        text = 'a,1,b,2\nc,3\n'
+        self.assertEqual(load(text, ['float64', 'S3', 'int64'], [3, 2, 1]), {
+            1: ('int64', [1, 3]),
+            2: ('S', ['b\0\0', '\0\0\0']),
+            3: ('float64', [2.0, 'nan']),
+        })
+
+    def test_dtype_dict(self):
+        self.assertEqual(load('x,"a\nb",1\n', { 2: 'int64', 1: 'S1' }),
+            { 1: ('S', ['a']), 2: ('int64', [1]) })
+
+    def test_many_rows(self):
+        text = ''.join('%d,%s\n' % (i, 'x' * (i % 7)) for i in xrange(20000))
+        self.assertEqual(load(text, ['int64', 'S'], [0, 1]), {
+            0: ('int64', range(20000)),
+            1: ('S', [('x' * (i % 7)).ljust(6, '\0')
+                for i in xrange(20000)]),
+        })
+
+    def test_empty(self):
+        self.assertEqual(load('', ['int64', 'S'], [0, 1]),
+            { 0: ('int64', []), 1: ('S', []) })
+
+    def test_conversion_error(self):
+        self.assertEqual(load('1,2\n3,x\n', ['int64'], [1]),
+            'Record 2, column 1: Bad number')
+        self.assertEqual(load('1,2\n3\n', ['int64'], [1]),
+            'Record 2, column 1: Missing value')
+
+    def test_parse_error(self):
+        self.assertEqual(load('1\n"2"x\n', ['int64'], [0]),
+            '2:4: Unexpected character')
+
+    def test_bad_columns(self):
+        self.assertEqual(load('1\n', ['int8'], [0]), 'Bad dtype: int8')
+        self.assertEqual(load('1\n', ['int64'], [0, 1]), 'Bad columns')
+        self.assertEqual(load('1\n', ['int64'], [-1]), 'Bad columns')
+        self.assertEqual(load('1\n', ['int64'], None), 'No columns')
+
+    def test_numpy(self):
+        try:
+            import numpy
+        except ImportError:
+            self.skipTest('NumPy is not available')
+        result = fields.load_columns('1,2012-03-04,a\n', ['int64',
+            'datetime64[D]', 'S'], [0, 1, 2])
+        self.assertEqual(result[0].tolist(), [1])
+        self.assertEqual(str(result[1][0]), '2012-03-04')
+        self.assertEqual(result[2].dtype, numpy.dtype('S1'))
+        result = fields.load_columns('1,a,2.5\n2,bc,\n', ['int64', 'S',
+            'float64'], usecols=[0, 1, 2])
+        self.assertEqual(result[0].tolist(), [1, 2])
+        self.assertEqual(result[1].tolist(), ['a', 'bc'])
+        self.assertEqual(result[2][0], 2.5)
+        self.assertTrue(numpy.isnan(result[2][1]))
+
+
+class ConversionTest(unittest.TestCase):
+
+    def test_int64(self):
+        self.assertEqual(libfields.field_int64('-0012345678901234567'),
+            -12345678901234567)
+
+    def test_int64_limits(self):
+        self.assertEqual(libfields.field_int64('9223372036854775807'),
+            9223372036854775807)
+        self.assertEqual(libfields.field_int64('-9223372036854775808'),
+            -9223372036854775808)
+
+    def test_int64_out_of_range(self):
+        self.assertFail('Number out of range', libfields.field_int64,
+            '9223372036854775808')
+
+    def test_int64_syntax(self):
+        for value in ['', '-', '1.0', ' 1', '1 ', '0x1']:
+            self.assertFail('Bad number', libfields.field_int64, value)
+
+    def test_double(self):
+        for value in ['0', '-0.5', '123.45', '.5', '5.', '1e10', '1.5E-7',
+            '0.1', '9007199254740993', '12e30', '4.9e-324', '1e-400',
+            '1.7976931348623157e308', '3.14159265358979323846264338']:
+            self.assertEqual(libfields.field_double(value), float(value))
+
+    def test_double_out_of_range(self):
+        self.assertFail('Number out of range', libfields.field_double, '1e309')
+
+    def test_double_syntax(self):
+        for value in ['', '.', '-', '1e', 'e1', '1,5', 'inf', 'nan', '0x1']:
+            self.assertFail('Bad number', libfields.field_double, value)
+
+    def test_decimal(self):
+        self.assertEqual(libfields.field_decimal('123.45', 2), 12345)
+        self.assertEqual(libfields.field_decimal('-1.5', 2), -150)
+        self.assertEqual(libfields.field_decimal('7', 3), 7000)
+        self.assertEqual(libfields.field_decimal('0.100', 1), 1)
+
+    def test_decimal_precision(self):
+        self.assertFail('Too many decimals', libfields.field_decimal,
+            '0.125', 2)
+
+    def test_decimal_out_of_range(self):
+        self.assertFail('Number out of range', libfields.field_decimal,
+            '92233720368547758.08', 2)
+
+    def test_decimal_syntax(self):
+        for value in ['', '.', '1e2', '1.2.3']:
+            self.assertFail('Bad number', libfields.field_decimal, value, 2)
+
+    def test_date(self):
+        self.assertEqual(libfields.field_date('1970-01-01'), 0)
+        self.assertEqual(libfields.field_date('2000-02-29'), 11016)
+        self.assertEqual(libfields.field_date('1969-12-31'), -1)
+        self.assertEqual(libfields.field_date('0000-03-01'), -719468)
+
+    def test_date_syntax(self):
+        for value in ['', '1970-1-01', '1970/01/01', '1970-01-01 00:00:00',
+            '1970-00-01', '1970-13-01', '1970-01-00', '1970-04-31',
+            '1900-02-29', '197O-01-01']:
+            self.assertFail('Bad date', libfields.field_date, value)
+
+    def test_timestamp(self):
+        self.assertEqual(libfields.field_timestamp('1970-01-02'), 86400000000)
+        self.assertEqual(libfields.field_timestamp('2012-03-04 05:06:07'),
+            1330837567000000)
+        self.assertEqual(libfields.field_timestamp('2012-03-04T05:06:07.5'),
+            1330837567500000)
+        self.assertEqual(
+            libfields.field_timestamp('1969-12-31 23:59:59.999999'), -1)
+
+    def test_timestamp_syntax(self):
+        for value in ['1970-01-01 ', '1970-01-01 00:00',
+            '1970-01-01_00:00:00', '1970-01-01 24:00:00',
+            '1970-01-01 00:60:00', '1970-01-01 00:00:60',
+            '1970-01-01 00:00:00.', '1970-01-01 00:00:00.1234567',
+            '1970-01-01 00:00:00,5']:
+            self.assertFail('Bad date', libfields.field_timestamp, value)
+
+    def assertFail(self, message, function, *args):
+        try:
+            function(*args)
+            self.fail()
+        except ValueError as e:
+            self.assertEqual(str(e), message)
+
+
 class LimitsWithoutExpansionTest(TestCase):
 
     def test_full_buffer(self):
@@ -247,6 +1033,135 @@ def parse_file(text, options):
         outfile.seek(0)
         return parse(outfile, options)
 
+def read_footprints(text, options):
+    settings = fields.api._settings(options)
+    reader = libfields.Reader(text, fields.api._fmt(options), settings)
+    record = libfields.Record(settings)
+    footprints = []
+    while reader.read(record) == 0:
+        footprints.append(record.footprint())
+    return footprints
+
+def write(records, options, capacity=None):
+    settings = fields.api._settings(options)
+    writer = libfields.Writer(capacity or 1024 * 1024,
+        fields.api._fmt(options), settings)
+    for record in records:
+        for value in record:
+            writer.write_field(value)
+        writer.end_record()
+    writer.flush()
+    return writer.error() or writer.value()
+
+def write_file(text, options):
+    settings = fields.api._settings(options)
+    fmt = fields.api._fmt(options)
+    reader = libfields.Reader(text, fmt, settings)
+    record = libfields.Record(settings)
+    with tempfile.TemporaryFile() as outfile:
+        writer = libfields.Writer(outfile, fmt, settings)
+        while reader.read(record) == 0:
+            writer.write_record(record)
+        writer.flush()
+        outfile.seek(0)
+        return outfile.read()
+
+NAT = -2 ** 63
+
+def load(text, dtypes, usecols=None):
+    try:
+        num_rows, buffers = fields.api._load_buffers(text, dtypes, usecols, {})
+    except fields.Error as e:
+        return str(e)
+    result = {}
+    for column, (dtype, width, buf) in buffers.items():
+        if dtype == 'S':
+            values = [str(buf[i:i + width])
+                for i in xrange(0, num_rows * width, width)]
+        else:
+            code = 'd' if dtype == 'float64' else 'q'
+            values = list(struct.unpack('<%d%s' % (num_rows, code), str(buf)))
+            values = ['nan' if value != value else value for value in values]
+        result[column] = (dtype, values)
+    return result
+
+def scan(text):
+    settings = fields.api._settings({})
+    reader = libfields.Reader(text, fields.api._fmt({}), settings)
+    events = []
+    callbacks = libfields.Callbacks(
+        lambda value, index: events.append((value, index)),
+        lambda: events.append(None))
+    if reader.scan(callbacks) != 0:
+        events.append(reader.error())
+    return events
+
+def seek(text, interval, number, options):
+    settings = fields.api._settings(options)
+    fmt = fields.api._fmt(options)
+    index = libfields.Index.build(libfields.Reader(text, fmt, settings),
+        interval, settings)
+    reader = libfields.Reader(text, fmt, settings)
+    if reader.seek(index, number) != 0:
+        return reader.error()
+    return read_all(reader, settings)
+
+def read_all(reader, settings):
+    record = libfields.Record(settings)
+    records = []
+    while reader.read(record) == 0:
+        records.append([record.field(i) for i in xrange(record.size())])
+    return reader.error() or records
+
+def resume(text, number, options):
+    settings = fields.api._settings(options)
+    fmt = fields.api._fmt(options)
+    reader = libfields.Reader(text, fmt, settings)
+    record = libfields.Record(settings)
+    for i in xrange(number):
+        reader.read(record)
+    checkpoint = libfields.Checkpoint.decode(reader.checkpoint().encode())
+    reader = libfields.Reader(text, fmt, settings)
+    if reader.restore(checkpoint) != 0:
+        return reader.error()
+    records = []
+    while reader.read(record) == 0:
+        records.append(([record.field(i) for i in xrange(record.size())],
+            reader.position()))
+    return reader.error() or records
+
+def supported(compression):
+    try:
+        with tempfile.TemporaryFile() as source:
+            fields.reader(source, compression=compression)
+        return True
+    except fields.Error:
+        return False
+
+def parse_compressed(value, compression):
+    return parse_file(value, { 'compression': compression,
+        '_source_buffer_size': 64 * 1024 })
+
+def gzip_compress(text):
+    output = StringIO.StringIO()
+    outfile = gzip.GzipFile(fileobj=output, mode='wb')
+    outfile.write(text)
+    outfile.close()
+    return output.getvalue()
+
+def zstd_available():
+    with open(os.devnull, 'w') as devnull:
+        try:
+            return subprocess.call(['zstd', '--version'], stdout=devnull,
+                stderr=devnull) == 0
+        except OSError:
+            return False
+
+def zstd_compress(text):
+    process = subprocess.Popen(['zstd', '-c', '-q'], stdin=subprocess.PIPE,
+        stdout=subprocess.PIPE)
+    return process.communicate(text)[0]
+
 def parse(source, options):
     reader = fields.reader(source, **options)
     try:
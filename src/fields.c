@@ -20,12 +20,41 @@
  * THE SOFTWARE.
  */
 
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if !defined(FIELDS_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define FIELDS_AVX2
+#elif !defined(FIELDS_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define FIELDS_SSE2
+#endif
+
+#if defined(FIELDS_SSE2) && defined(__PCLMUL__)
+#include <wmmintrin.h>
+#endif
+
+#if defined(FIELDS_AVX2) || defined(FIELDS_SSE2)
+#define FIELDS_BLOCK_SIZE 64
+#endif
 
 #include "fields.h"
+#include "fields_private.h"
 
 #define FIELDS_FAILURE (-1)
+#define FIELDS_SUSPEND (1)
+
+#ifdef __GNUC__
+#define FIELDS_INLINE inline __attribute__((always_inline))
+#else
+#define FIELDS_INLINE inline
+#endif
 
 #define FIELDS_HT  9
 #define FIELDS_CR 13
@@ -36,7 +65,16 @@ typedef int fields_parse_fn(struct fields_reader *, struct fields_record *);
 
 static int fields_parse_unquoted(struct fields_reader *,
     struct fields_record *);
+static int fields_parse_tsv(struct fields_reader *, struct fields_record *);
+static int fields_parse_psv(struct fields_reader *, struct fields_record *);
 static int fields_parse_quoted(struct fields_reader *, struct fields_record *);
+static int fields_parse_csv(struct fields_reader *, struct fields_record *);
+static int fields_parse_ssv(struct fields_reader *, struct fields_record *);
+static int fields_parse_projected(struct fields_reader *,
+    struct fields_record *);
+static int fields_parse_view(struct fields_reader *, struct fields_record *);
+static int fields_parse_scan(struct fields_reader *,
+    const struct fields_callbacks *, void *);
 static int fields_parse_start(struct fields_reader *, struct fields_record *);
 
 /*
@@ -44,28 +82,14 @@ static int fields_parse_start(struct fields_reader *, struct fields_record *);
  * =========
  */
 
-static inline size_t
-fields_charlen(char byte)
+static inline bool
+fields_continuation(char byte)
 {
     /*
-     * This function calculates the length of a character in bytes in UTF-8
-     * assuming this byte is the initial byte. See RFC 3629 for details.
+     * This function checks whether this byte is a continuation byte of a
+     * multibyte character in UTF-8. See RFC 3629 for details.
      */
-
-    if ((byte & 0x80) == 0x00)
-        return 1;
-
-    if ((byte & 0xE0) == 0xC0)
-        return 2;
-
-    if ((byte & 0xF0) == 0xE0)
-        return 3;
-
-    if ((byte & 0xF8) == 0xF0)
-        return 4;
-
-    /* This byte is not the initial byte or the encoding is not UTF-8. */
-    return 0;
+    return (byte & 0xC0) == 0x80;
 }
 
 static inline bool
@@ -74,636 +98,4598 @@ fields_crlf(char ch)
     return (ch == FIELDS_CR) || (ch == FIELDS_LF);
 }
 
-static inline bool
-fields_whitespace(char ch)
+/*
+ * Serialized integers are stored as eight bytes in little-endian order, so
+ * that they can be loaded on any platform.
+ */
+static void
+fields_store_uint64(unsigned char *bytes, uint64_t value)
+{
+    size_t i;
+
+    for (i = 0; i < 8; i++) {
+        bytes[i] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+static uint64_t
+fields_load_uint64(const unsigned char *bytes)
 {
-    return (ch == FIELDS_HT) || (ch == FIELDS_SP);
+    uint64_t value = 0;
+    size_t i;
+
+    for (i = 8; i > 0; i--)
+        value = value << 8 | bytes[i - 1];
+
+    return value;
 }
 
 /*
- * Buffer Sources
- * ==============
+ * Vectors
+ * =======
  */
 
-struct fields_buffer {
-    const char *buffer;
-    size_t      buffer_size;
-};
+#if defined(FIELDS_AVX2)
 
-static struct fields_buffer *
-fields_buffer_alloc(const char *buffer, size_t buffer_size)
+#define FIELDS_VECTOR_SIZE 32
+
+typedef __m256i fields_vector;
+
+static inline fields_vector
+fields_vector_load(const char *p)
 {
-    struct fields_buffer *self;
+    return _mm256_loadu_si256((const __m256i *)p);
+}
 
-    self = malloc(sizeof(*self));
-    if (self == NULL)
-        return NULL;
+static inline void
+fields_vector_store(char *p, fields_vector v)
+{
+    _mm256_storeu_si256((__m256i *)p, v);
+}
 
-    self->buffer = buffer;
-    self->buffer_size = buffer_size;
+static inline fields_vector
+fields_vector_set(char ch)
+{
+    return _mm256_set1_epi8(ch);
+}
 
-    return self;
+static inline uint32_t
+fields_vector_eq(fields_vector v, fields_vector ch)
+{
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, ch));
 }
 
-static int
-fields_buffer_read(void *source, const char **buffer, size_t *buffer_size)
+static inline uint32_t
+fields_vector_high(fields_vector v)
 {
-    struct fields_buffer *self = source;
+    return (uint32_t)_mm256_movemask_epi8(v);
+}
 
-    *buffer = self->buffer;
-    *buffer_size = self->buffer_size;
+#elif defined(FIELDS_SSE2)
 
-    self->buffer = NULL;
-    self->buffer_size = 0;
+#define FIELDS_VECTOR_SIZE 16
 
-    return 0;
+typedef __m128i fields_vector;
+
+static inline fields_vector
+fields_vector_load(const char *p)
+{
+    return _mm_loadu_si128((const __m128i *)p);
 }
 
-static void
-fields_buffer_free(void *source)
+static inline void
+fields_vector_store(char *p, fields_vector v)
 {
-    struct fields_buffer *self = source;
+    _mm_storeu_si128((__m128i *)p, v);
+}
 
-    free(self);
+static inline fields_vector
+fields_vector_set(char ch)
+{
+    return _mm_set1_epi8(ch);
+}
+
+static inline uint32_t
+fields_vector_eq(fields_vector v, fields_vector ch)
+{
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, ch));
+}
+
+static inline uint32_t
+fields_vector_high(fields_vector v)
+{
+    return (uint32_t)_mm_movemask_epi8(v);
 }
 
+#endif
+
 /*
- * File Sources
- * ============
+ * Scanning
+ * ========
  */
 
-struct fields_file {
-    FILE *  file;
-    char *  buffer;
-    size_t  buffer_size;
-};
-
-static struct fields_file *
-fields_file_alloc(FILE *file, size_t buffer_size)
+static inline size_t
+fields_scan(char *wp, const char *rp, size_t n, char delimiter)
 {
-    struct fields_file *self;
-    char *buffer;
+    /*
+     * This function copies the bytes preceding the first delimiter, CR or LF
+     * within the first `n` bytes at `rp` to `wp` and returns the number of
+     * bytes copied. Up to `n` bytes may be written to `wp`.
+     */
+    size_t i = 0;
 
-    buffer = malloc(buffer_size);
-    if (buffer == NULL)
-        return NULL;
+#ifdef FIELDS_VECTOR_SIZE
+    fields_vector d = fields_vector_set(delimiter);
+    fields_vector cr = fields_vector_set(FIELDS_CR);
+    fields_vector lf = fields_vector_set(FIELDS_LF);
 
-    self = malloc(sizeof(*self));
-    if (self == NULL) {
-        free(buffer);
-        return NULL;
+    while (n - i >= FIELDS_VECTOR_SIZE) {
+        fields_vector v = fields_vector_load(rp + i);
+        uint32_t mask;
+
+        fields_vector_store(wp + i, v);
+
+        mask = fields_vector_eq(v, d) | fields_vector_eq(v, cr) |
+            fields_vector_eq(v, lf);
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+
+        i += FIELDS_VECTOR_SIZE;
     }
+#endif
 
-    self->file = file;
-    self->buffer = buffer;
-    self->buffer_size = buffer_size;
+    while ((i != n) && (rp[i] != delimiter) && !fields_crlf(rp[i])) {
+        wp[i] = rp[i];
+        i++;
+    }
 
-    return self;
+    return i;
 }
 
-static int
-fields_file_read(void *source, const char **buffer, size_t *buffer_size)
+static inline size_t
+fields_find(const char *p, size_t n, char delimiter, char quote)
 {
-    struct fields_file *self = source;
-    size_t size;
+    /*
+     * This function returns the index of the first delimiter, quote, CR or
+     * LF within the first `n` bytes at `p`.
+     */
+    size_t i = 0;
 
-    size = fread(self->buffer, 1, self->buffer_size, self->file);
-    if (size != self->buffer_size) {
-        if (ferror(self->file))
-            return FIELDS_FAILURE;
+#ifdef FIELDS_VECTOR_SIZE
+    fields_vector d = fields_vector_set(delimiter);
+    fields_vector q = fields_vector_set(quote);
+    fields_vector cr = fields_vector_set(FIELDS_CR);
+    fields_vector lf = fields_vector_set(FIELDS_LF);
+
+    while (n - i >= FIELDS_VECTOR_SIZE) {
+        fields_vector v = fields_vector_load(p + i);
+        uint32_t mask;
+
+        mask = fields_vector_eq(v, d) | fields_vector_eq(v, q) |
+            fields_vector_eq(v, cr) | fields_vector_eq(v, lf);
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+
+        i += FIELDS_VECTOR_SIZE;
     }
+#endif
 
-    *buffer = self->buffer;
-    *buffer_size = size;
+    while ((i != n) && (p[i] != delimiter) && (p[i] != quote) &&
+        !fields_crlf(p[i]))
+        i++;
 
-    return 0;
+    return i;
 }
 
-static void
-fields_file_free(void *source)
+size_t
+fields_find_break(const char *p, size_t n, char quote)
 {
-    struct fields_file *self = source;
+    /*
+     * Without a quote character, look for LF in its place.
+     */
+    if (quote == '\0')
+        quote = FIELDS_LF;
 
-    free(self->buffer);
-    free(self);
+    return fields_find(p, n, quote, quote);
+}
+
+size_t
+fields_count(const char *p, size_t n, char ch)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+#ifdef FIELDS_VECTOR_SIZE
+    fields_vector c = fields_vector_set(ch);
+
+    while (n - i >= FIELDS_VECTOR_SIZE) {
+        count += __builtin_popcount(fields_vector_eq(fields_vector_load(p + i),
+            c));
+        i += FIELDS_VECTOR_SIZE;
+    }
+#endif
+
+    for (; i < n; i++)
+        count += p[i] == ch;
+
+    return count;
 }
 
 /*
- * Records
- * =======
+ * Blocks
+ * ======
  */
 
-struct fields_record
+#ifdef FIELDS_BLOCK_SIZE
+
+/*
+ * A block holds the classification of 64 consecutive bytes of input. Bit `n`
+ * of each mask refers to byte `n` of the block.
+ */
+struct fields_block
 {
-    char *  buffer;
-    size_t  buffer_size;
-    char ** fields;
-    size_t  num_fields;
-    size_t  max_fields;
-    bool    expand;
+    uint64_t    quotes;
+    uint64_t    delimiters;
+    uint64_t    crlfs;
+    uint64_t    spaces;
 };
 
-struct fields_record *
-fields_record_alloc(const struct fields_settings *settings)
+static inline void
+fields_block_classify(struct fields_block *self, const char *p,
+    char delimiter, char quote)
 {
-    struct fields_record *self;
-    char *buffer;
-    size_t buffer_size;
-    char **fields;
-    size_t max_fields;
+    fields_vector q = fields_vector_set(quote);
+    fields_vector d = fields_vector_set(delimiter);
+    fields_vector cr = fields_vector_set(FIELDS_CR);
+    fields_vector lf = fields_vector_set(FIELDS_LF);
+    fields_vector ht = fields_vector_set(FIELDS_HT);
+    fields_vector sp = fields_vector_set(FIELDS_SP);
+    unsigned i;
+
+    self->quotes = 0;
+    self->delimiters = 0;
+    self->crlfs = 0;
+    self->spaces = 0;
+
+    for (i = 0; i < FIELDS_BLOCK_SIZE; i += FIELDS_VECTOR_SIZE) {
+        fields_vector v = fields_vector_load(p + i);
+
+        self->quotes |= (uint64_t)fields_vector_eq(v, q) << i;
+        self->delimiters |= (uint64_t)fields_vector_eq(v, d) << i;
+        self->crlfs |= (uint64_t)(fields_vector_eq(v, cr) |
+            fields_vector_eq(v, lf)) << i;
+        self->spaces |= (uint64_t)(fields_vector_eq(v, ht) |
+            fields_vector_eq(v, sp)) << i;
+    }
+}
 
-    if (settings == NULL)
-        settings = &fields_defaults;
+static inline uint64_t
+fields_prefix_xor(uint64_t bits)
+{
+    /*
+     * This function sets each bit to the parity of the bits up to and
+     * including it. Applied to the quote characters, the result is the set
+     * of bytes inside quoted regions, each region including its opening
+     * quote character.
+     */
+#ifdef __PCLMUL__
+    __m128i ones = _mm_set1_epi8(-1);
+
+    return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(
+        _mm_set_epi64x(0, (long long)bits), ones, 0));
+#else
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+
+    return bits;
+#endif
+}
 
-    buffer_size = settings->record_buffer_size;
-    max_fields = settings->record_max_fields;
+static inline uint64_t
+fields_bits(unsigned from, unsigned to)
+{
+    uint64_t below;
 
-    buffer = malloc(buffer_size);
-    if (buffer == NULL)
-        return NULL;
+    below = to == 64 ? ~UINT64_C(0) : (UINT64_C(1) << to) - 1;
 
-    /*
-     * `buffer` stores the fields separated by single `NUL` characters. Note
-     * that also the fields themselves may contain `NUL` characters.
-     *
-     * `fields` stores a pointer to the beginning of each field. The pointer
-     * to the beginning of field `n + 1` is used for calculating the length
-     * of field `n`. The last field is no exception: the value at the index
-     * `num_fields` stores a pointer pointing to where the next field would
-     * start. Hence the size of `fields` is `max_fields + 1`.
-     */
-    fields = malloc((max_fields + 1) * sizeof(char *));
-    if (fields == NULL) {
-        free(buffer);
-        return NULL;
-    }
+    return below & ~((UINT64_C(1) << from) - 1);
+}
 
-    self = malloc(sizeof(*self));
-    if (self == NULL) {
-        free(buffer);
-        free(fields);
-        return NULL;
-    }
+#endif
 
-    self->buffer = buffer;
-    self->buffer_size = buffer_size;
-    self->fields = fields;
-    self->num_fields = 0;
-    self->max_fields = max_fields;
-    self->expand = settings->expand;
+/*
+ * Allocators
+ * ==========
+ */
 
-    return self;
+static void *
+fields_stdlib_alloc(void *context, size_t size)
+{
+    (void)context;
+
+    return malloc(size);
 }
 
-void
-fields_record_free(struct fields_record *self)
+static void *
+fields_stdlib_realloc(void *context, void *ptr, size_t size)
 {
-    free(self->buffer);
-    free(self->fields);
-    free(self);
+    (void)context;
+
+    return realloc(ptr, size);
 }
 
-int
-fields_record_field(const struct fields_record *self, unsigned int index,
-    struct fields_field *field)
+static void
+fields_stdlib_free(void *context, void *ptr)
 {
-    if (index >= self->num_fields)
-        return FIELDS_FAILURE;
+    (void)context;
 
-    field->value = self->fields[index];
-    field->length = self->fields[index + 1] - self->fields[index] - 1;
-    return 0;
+    free(ptr);
 }
 
-size_t
-fields_record_size(const struct fields_record *self)
+const struct fields_allocator fields_stdlib_allocator =
 {
-    return self->num_fields;
-}
+    .alloc   = &fields_stdlib_alloc,
+    .realloc = &fields_stdlib_realloc,
+    .free    = &fields_stdlib_free,
+    .context = NULL
+};
 
-static const char *
-fields_record_end(const struct fields_record *self)
+const struct fields_allocator *
+fields_allocator(const struct fields_settings *settings)
 {
-    return self->buffer + self->buffer_size;
+    if (settings->allocator == NULL)
+        return &fields_stdlib_allocator;
+
+    return settings->allocator;
 }
 
-static void
-fields_record_init(struct fields_record *self)
+void *
+fields_alloc(const struct fields_allocator *allocator, size_t size)
 {
-    self->num_fields = 0;
+    return allocator->alloc(allocator->context, size);
 }
 
-static char *
-fields_record_expand(struct fields_record *self, char *cursor)
+void *
+fields_calloc(const struct fields_allocator *allocator, size_t count,
+    size_t size)
 {
-    char *      buffer;
-    size_t      buffer_size;
-    unsigned    i;
-    size_t      offset;
+    void *result;
 
-    if (!self->expand)
+    if (size != 0 && count > SIZE_MAX / size)
         return NULL;
 
-    offset = cursor - self->buffer;
-
-    buffer_size = self->buffer_size * 2;
-
-    buffer = realloc(self->buffer, buffer_size);
-    if (buffer == NULL)
+    result = fields_alloc(allocator, count * size);
+    if (result == NULL)
         return NULL;
 
-    for (i = 0; i < self->num_fields; i++)
-        self->fields[i] = self->fields[i] - self->buffer + buffer;
+    memset(result, 0, count * size);
 
-    self->buffer = buffer;
-    self->buffer_size = buffer_size;
+    return result;
+}
 
-    return self->buffer + offset;
+void *
+fields_realloc(const struct fields_allocator *allocator, void *ptr,
+    size_t size)
+{
+    return allocator->realloc(allocator->context, ptr, size);
 }
 
-static int
-fields_record_push(struct fields_record *self, char *cursor)
+void
+fields_free(const struct fields_allocator *allocator, void *ptr)
 {
-    if (self->num_fields == self->max_fields) {
-        size_t  max_fields;
-        char ** fields;
+    if (ptr != NULL)
+        allocator->free(allocator->context, ptr);
+}
 
-        if (!self->expand)
-            return FIELDS_FAILURE;
+/*
+ * Arenas
+ * ======
+ */
 
-        max_fields = self->max_fields * 2;
+/*
+ * An arena hands out blocks from one slab by bumping an offset. Each block
+ * is preceded by a header that holds its size and the offset of the
+ * previous block, so that the most recent block can be resized in place
+ * and freeing it returns its space to the arena. Freeing any other block
+ * has no effect until the arena is cleared.
+ */
+#define FIELDS_ARENA_ALIGNMENT (16)
 
-        fields = realloc(self->fields, (max_fields + 1) * sizeof(char *));
-        if (fields == NULL)
-            return FIELDS_FAILURE;
+struct fields_arena
+{
+    char *  buffer;
+    size_t  buffer_size;
+    size_t  used;
+    size_t  last;
+};
 
-        self->fields = fields;
-        self->max_fields = max_fields;
-    }
+struct fields_arena_header
+{
+    size_t  size;
+    size_t  previous;
+};
 
-    self->fields[self->num_fields++] = cursor;
-    return 0;
-}
+#define FIELDS_ARENA_HEADER_SIZE (((sizeof(struct fields_arena_header) + \
+    FIELDS_ARENA_ALIGNMENT - 1) / FIELDS_ARENA_ALIGNMENT) * \
+    FIELDS_ARENA_ALIGNMENT)
 
-static char *
-fields_record_pop(struct fields_record *self)
+static bool
+fields_arena_fits(const struct fields_arena *self, size_t offset,
+    size_t size, size_t *end)
 {
-    if (self->num_fields == 0)
-        return self->buffer;
+    size_t available = self->buffer_size - offset;
 
-    self->num_fields--;
+    if (available < FIELDS_ARENA_HEADER_SIZE)
+        return false;
 
-    return self->fields[self->num_fields];
-}
+    available -= FIELDS_ARENA_HEADER_SIZE;
 
-static void
-fields_record_finish(struct fields_record *self, char *cursor)
-{
-    self->fields[self->num_fields] = cursor;
+    if (size > available)
+        return false;
 
     /*
-     * Prefer a record containing no fields to a record containing one field
-     * of zero length.
+     * Round the end up to the alignment of the next block.
      */
-    if (fields_record_size(self) == 1) {
-        struct fields_field field;
-
-        fields_record_field(self, 0, &field);
+    size += FIELDS_ARENA_HEADER_SIZE;
+    size += (FIELDS_ARENA_ALIGNMENT - size % FIELDS_ARENA_ALIGNMENT) %
+        FIELDS_ARENA_ALIGNMENT;
 
-        if (field.length == 0)
-            fields_record_pop(self);
-    }
-}
-
-/*
- * Positions
- * =========
- */
+    *end = size <= self->buffer_size - offset ? offset + size :
+        self->buffer_size;
 
-static void
-fields_position_init(struct fields_position *self)
-{
-    self->row = 1;
-    self->column = 0;
+    return true;
 }
 
-static inline void
-fields_position_advance(struct fields_position *self)
+static struct fields_arena_header *
+fields_arena_header(void *ptr)
 {
-    self->column++;
+    return (struct fields_arena_header *)((char *)ptr -
+        FIELDS_ARENA_HEADER_SIZE);
 }
 
-static inline void
-fields_position_return(struct fields_position *self)
+static void *
+fields_arena_alloc_block(void *context, size_t size)
 {
-    self->row++;
-    self->column = 0;
-}
+    struct fields_arena *self = context;
+    struct fields_arena_header *header;
+    size_t end;
 
-/*
- * Contexts
- * ========
- */
+    if (!fields_arena_fits(self, self->used, size, &end))
+        return NULL;
 
-struct fields_context
-{
-    struct fields_position  position;
-    size_t                  length;
-    char                    last;
-};
+    header = (struct fields_arena_header *)(self->buffer + self->used);
+    header->size = size;
+    header->previous = self->last;
 
-static void
-fields_context_init(struct fields_context *self)
-{
-    fields_position_init(&self->position);
+    self->last = self->used;
+    self->used = end;
 
-    self->length = 1;
-    self->last = '\0';
+    return (char *)header + FIELDS_ARENA_HEADER_SIZE;
 }
 
-static inline void
-fields_context_update(struct fields_context *self, char byte)
+static void *
+fields_arena_realloc_block(void *context, void *ptr, size_t size)
 {
-    self->length--;
+    struct fields_arena *self = context;
+    struct fields_arena_header *header;
+    void *result;
+    size_t end;
 
-    if (self->length != 0)
-        return;
+    if (ptr == NULL)
+        return fields_arena_alloc_block(context, size);
 
-    self->length = fields_charlen(byte);
+    header = fields_arena_header(ptr);
 
-    switch (byte) {
-    case FIELDS_CR:
-        fields_position_return(&self->position);
-        break;
+    if ((char *)header == self->buffer + self->last) {
+        if (!fields_arena_fits(self, self->last, size, &end))
+            return NULL;
 
-    case FIELDS_LF:
-        if (self->last != FIELDS_CR)
-            fields_position_return(&self->position);
-        break;
+        header->size = size;
+        self->used = end;
 
-    default:
-        fields_position_advance(&self->position);
+        return ptr;
     }
 
-    self->last = byte;
+    result = fields_arena_alloc_block(context, size);
+    if (result == NULL)
+        return NULL;
+
+    memcpy(result, ptr, header->size < size ? header->size : size);
+
+    return result;
 }
 
 static void
-fields_context_position(const struct fields_context *self,
-    struct fields_position *position)
+fields_arena_free_block(void *context, void *ptr)
 {
-    *position = self->position;
-}
+    struct fields_arena *self = context;
+    struct fields_arena_header *header = fields_arena_header(ptr);
 
-/*
- * Formats
- * =======
- */
+    if ((char *)header != self->buffer + self->last)
+        return;
 
-const struct fields_format fields_csv =
-{
-    .delimiter  = ',',
-    .quote      = '"'
-};
+    self->used = self->last;
+    self->last = header->previous;
+}
 
-const struct fields_format fields_tsv =
+struct fields_arena *
+fields_arena_alloc(size_t size)
 {
-    .delimiter  = '\t',
-    .quote      = '\0'
-};
+    struct fields_arena *self;
 
-int
-fields_format_error(const struct fields_format *format)
-{
-    if (format->delimiter == FIELDS_CR)
-        return FIELDS_FORMAT_ERROR_DELIMITER;
+    self = malloc(sizeof(*self));
+    if (self == NULL)
+        return NULL;
 
-    if (format->delimiter == FIELDS_LF)
-        return FIELDS_FORMAT_ERROR_DELIMITER;
+    self->buffer = malloc(size > 0 ? size : 1);
+    if (self->buffer == NULL) {
+        free(self);
+        return NULL;
+    }
 
-    if (format->quote == FIELDS_CR)
-        return FIELDS_FORMAT_ERROR_QUOTE;
+    self->buffer_size = size;
 
-    if (format->quote == FIELDS_LF)
-        return FIELDS_FORMAT_ERROR_QUOTE;
+    fields_arena_clear(self);
 
-    if (format->quote == format->delimiter)
-        return FIELDS_FORMAT_ERROR_QUOTE;
+    return self;
+}
 
-    return 0;
+void
+fields_arena_free(struct fields_arena *self)
+{
+    free(self->buffer);
+    free(self);
 }
 
-const char *
-fields_format_strerror(int error)
+void
+fields_arena_clear(struct fields_arena *self)
 {
-    switch (error) {
-    case FIELDS_FORMAT_ERROR_DELIMITER:
-        return "Bad field delimiter";
-    case FIELDS_FORMAT_ERROR_QUOTE:
-        return "Bad quote character";
-    case 0:
-        return "";
-    default:
-        break;
-    }
+    self->used = 0;
+    self->last = 0;
+}
 
-    return "Unknown error";
+size_t
+fields_arena_used(const struct fields_arena *self)
+{
+    return self->used;
 }
 
-static fields_parse_fn *
-fields_format_parser(const struct fields_format *format)
+void
+fields_arena_allocator(struct fields_arena *self,
+    struct fields_allocator *allocator)
 {
-    if (format->quote != '\0')
-        return &fields_parse_quoted;
-    else
-        return &fields_parse_unquoted;
+    allocator->alloc = &fields_arena_alloc_block;
+    allocator->realloc = &fields_arena_realloc_block;
+    allocator->free = &fields_arena_free_block;
+    allocator->context = self;
 }
 
 /*
- * Readers
- * =======
+ * Buffer Sources
+ * ==============
  */
 
-struct fields_reader
-{
-    void *                  source;
-    fields_source_read_fn * source_read;
-    fields_source_free_fn * source_free;
-    char                    delimiter;
-    char                    quote;
-    fields_parse_fn *       parse;
-    const char *            buffer;
-    size_t                  buffer_size;
-    const char *            cursor;
-    char                    skip;
-    int                     error;
-    struct fields_context   context;
+struct fields_buffer {
+    const char *                    origin;
+    size_t                          origin_size;
+    const char *                    buffer;
+    size_t                          buffer_size;
+    const struct fields_allocator * allocator;
 };
 
-struct fields_reader *
-fields_read_buffer(const char *buffer, size_t buffer_size,
-    const struct fields_format *format, const struct fields_settings *settings)
-{
-    struct fields_reader *reader;
-    struct fields_buffer *source;
-
-    if (settings == NULL)
-        settings = &fields_defaults;
-
-    source = fields_buffer_alloc(buffer, buffer_size);
-    if (source == NULL)
-        return NULL;
-
-    reader = fields_reader_alloc(source, &fields_buffer_read,
-        &fields_buffer_free, format, settings);
-    if (reader == NULL) {
-        fields_buffer_free(source);
-        return NULL;
-    }
-
-    return reader;
-}
-
-struct fields_reader *
-fields_read_file(FILE *file, const struct fields_format *format,
-    const struct fields_settings *settings)
+static struct fields_buffer *
+fields_buffer_alloc(const char *buffer, size_t buffer_size,
+    const struct fields_allocator *allocator)
 {
-    struct fields_reader *reader;
-    struct fields_file *source;
-
-    if (settings == NULL)
-        settings = &fields_defaults;
+    struct fields_buffer *self;
 
-    source = fields_file_alloc(file, settings->source_buffer_size);
-    if (source == NULL)
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
         return NULL;
 
-    reader = fields_reader_alloc(source, &fields_file_read, &fields_file_free,
-        format, settings);
-    if (reader == NULL) {
-        fields_file_free(source);
-        return NULL;
-    }
+    self->origin = buffer;
+    self->origin_size = buffer_size;
+    self->buffer = buffer;
+    self->buffer_size = buffer_size;
+    self->allocator = allocator;
 
-    return reader;
+    return self;
 }
 
-struct fields_reader *
-fields_reader_alloc(void *source, fields_source_read_fn *read_fn,
-    fields_source_free_fn *free_fn, const struct fields_format *format,
-    const struct fields_settings *settings)
+static int
+fields_buffer_read(void *source, const char **buffer, size_t *buffer_size)
 {
-    struct fields_reader *self;
-
-    if (fields_format_error(format) != 0)
-        return NULL;
-
-    if (fields_settings_error(settings) != 0)
-        return NULL;
+    struct fields_buffer *self = source;
 
-    self = malloc(sizeof(*self));
-    if (self == NULL)
-        return NULL;
+    *buffer = self->buffer;
+    *buffer_size = self->buffer_size;
 
-    self->source = source;
-    self->source_read = read_fn;
-    self->source_free = free_fn;
-    self->delimiter = format->delimiter;
-    self->quote = format->quote;
-    self->parse = fields_format_parser(format);
     self->buffer = NULL;
     self->buffer_size = 0;
-    self->cursor = NULL;
-    self->skip = '\0';
-    self->error = 0;
-
-    fields_context_init(&self->context);
 
-    return self;
-}
-
-void
-fields_reader_free(struct fields_reader *self)
-{
-    self->source_free(self->source);
-
-    free(self);
-}
-
-static const char *
-fields_reader_end(const struct fields_reader *self)
-{
-    return self->buffer + self->buffer_size;
+    return 0;
 }
 
 static int
-fields_reader_fill(struct fields_reader *self)
+fields_buffer_seek(void *source, uint64_t offset)
 {
-    int result;
-
-    result = self->source_read(self->source, &self->buffer, &self->buffer_size);
-    self->cursor = self->buffer;
+    struct fields_buffer *self = source;
 
-    if (result != 0) {
-        self->error = FIELDS_READER_ERROR_UNREADABLE_SOURCE;
+    if (offset > self->origin_size)
         return FIELDS_FAILURE;
-    }
+
+    self->buffer = self->origin + offset;
+    self->buffer_size = self->origin_size - offset;
 
     return 0;
 }
 
 static void
-fields_reader_skip(struct fields_reader *self)
+fields_buffer_free(void *source)
 {
-    if (self->skip == '\0')
-        return;
+    struct fields_buffer *self = source;
 
-    if (self->cursor == fields_reader_end(self))
-        return;
+    fields_free(self->allocator, self);
+}
 
-    if (self->skip != *self->cursor)
+/*
+ * File Sources
+ * ============
+ */
+
+struct fields_file {
+    FILE *                          file;
+    long                            start;
+    char *                          buffer;
+    size_t                          buffer_size;
+    const struct fields_allocator * allocator;
+};
+
+static struct fields_file *
+fields_file_alloc(FILE *file, size_t buffer_size,
+    const struct fields_allocator *allocator)
+{
+    struct fields_file *self;
+    char *buffer;
+
+    buffer = fields_alloc(allocator, buffer_size);
+    if (buffer == NULL)
+        return NULL;
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL) {
+        fields_free(allocator, buffer);
+        return NULL;
+    }
+
+    /*
+     * The offsets to seek to are relative to the file position at which
+     * reading starts. A file that cannot tell its position cannot seek.
+     */
+    self->file = file;
+    self->start = ftell(file);
+    self->buffer = buffer;
+    self->buffer_size = buffer_size;
+    self->allocator = allocator;
+
+    return self;
+}
+
+static int
+fields_file_read(void *source, const char **buffer, size_t *buffer_size)
+{
+    struct fields_file *self = source;
+    size_t size;
+
+    size = fread(self->buffer, 1, self->buffer_size, self->file);
+    if (size != self->buffer_size) {
+        if (ferror(self->file))
+            return FIELDS_FAILURE;
+    }
+
+    *buffer = self->buffer;
+    *buffer_size = size;
+
+    return 0;
+}
+
+static int
+fields_file_seek(void *source, uint64_t offset)
+{
+    struct fields_file *self = source;
+
+    if (self->start == -1)
+        return FIELDS_FAILURE;
+
+    if (offset > (uint64_t)(LONG_MAX - self->start))
+        return FIELDS_FAILURE;
+
+    if (fseek(self->file, self->start + (long)offset, SEEK_SET) != 0)
+        return FIELDS_FAILURE;
+
+    return 0;
+}
+
+static void
+fields_file_free(void *source)
+{
+    struct fields_file *self = source;
+    const struct fields_allocator *allocator = self->allocator;
+    char *buffer = self->buffer;
+
+    /*
+     * Free the blocks in the reverse order of allocation, so that an arena
+     * can reclaim them.
+     */
+    fields_free(allocator, self);
+    fields_free(allocator, buffer);
+}
+
+/*
+ * Buffer Sinks
+ * ============
+ */
+
+struct fields_buffer_sink {
+    char *                          buffer;
+    size_t                          buffer_size;
+    size_t *                        length;
+    const struct fields_allocator * allocator;
+};
+
+static struct fields_buffer_sink *
+fields_buffer_sink_alloc(char *buffer, size_t buffer_size, size_t *length,
+    const struct fields_allocator *allocator)
+{
+    struct fields_buffer_sink *self;
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->buffer = buffer;
+    self->buffer_size = buffer_size;
+    self->length = length;
+    self->allocator = allocator;
+
+    *length = 0;
+
+    return self;
+}
+
+static int
+fields_buffer_sink_write(void *sink, const char *buffer, size_t buffer_size)
+{
+    struct fields_buffer_sink *self = sink;
+
+    if (buffer_size > self->buffer_size - *self->length)
+        return FIELDS_FAILURE;
+
+    memcpy(self->buffer + *self->length, buffer, buffer_size);
+    *self->length += buffer_size;
+
+    return 0;
+}
+
+static void
+fields_buffer_sink_free(void *sink)
+{
+    struct fields_buffer_sink *self = sink;
+
+    fields_free(self->allocator, self);
+}
+
+/*
+ * File Sinks
+ * ==========
+ */
+
+struct fields_file_sink {
+    FILE *                          file;
+    const struct fields_allocator * allocator;
+};
+
+static struct fields_file_sink *
+fields_file_sink_alloc(FILE *file, const struct fields_allocator *allocator)
+{
+    struct fields_file_sink *self;
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->file = file;
+    self->allocator = allocator;
+
+    return self;
+}
+
+static int
+fields_file_sink_write(void *sink, const char *buffer, size_t buffer_size)
+{
+    struct fields_file_sink *self = sink;
+
+    if (fwrite(buffer, 1, buffer_size, self->file) != buffer_size)
+        return FIELDS_FAILURE;
+
+    return 0;
+}
+
+static void
+fields_file_sink_free(void *sink)
+{
+    struct fields_file_sink *self = sink;
+
+    fields_free(self->allocator, self);
+}
+
+/*
+ * Records
+ * =======
+ */
+
+struct fields_record
+{
+    char *  buffer;
+    size_t  buffer_size;
+    char *  base;
+    union {
+        uint32_t *  narrow;
+        uint64_t *  wide;
+    } fields;
+    size_t  num_fields;
+    size_t  max_fields;
+    size_t  start;
+    size_t  first;
+    bool    wide;
+    bool    expand;
+    bool    views;
+
+    const struct fields_allocator * allocator;
+
+    size_t  initial_buffer_size;
+    size_t  initial_max_fields;
+    size_t  shrink_interval;
+    size_t  shrink_buffer_size;
+    size_t  shrink_max_fields;
+    size_t  window_records;
+    size_t  window_size;
+    size_t  window_fields;
+    size_t  peak_footprint;
+};
+
+static inline size_t
+fields_record_offset(const struct fields_record *self, size_t index)
+{
+    return self->wide ? self->fields.wide[index] : self->fields.narrow[index];
+}
+
+static inline void
+fields_record_set(struct fields_record *self, size_t index, const char *cursor)
+{
+    size_t offset = cursor - self->base;
+
+    if (self->wide)
+        self->fields.wide[index] = offset;
+    else
+        self->fields.narrow[index] = offset;
+}
+
+static size_t
+fields_record_current_footprint(const struct fields_record *self)
+{
+    size_t size = self->wide ? sizeof(uint64_t) : sizeof(uint32_t);
+
+    return sizeof(*self) + self->buffer_size + (self->max_fields + 1) * size;
+}
+
+static void
+fields_record_track(struct fields_record *self)
+{
+    size_t footprint = fields_record_current_footprint(self);
+
+    if (footprint > self->peak_footprint)
+        self->peak_footprint = footprint;
+}
+
+static int
+fields_record_widen(struct fields_record *self)
+{
+    uint64_t *fields;
+    size_t i;
+
+    fields = fields_alloc(self->allocator,
+        (self->max_fields + 1) * sizeof(uint64_t));
+    if (fields == NULL)
+        return FIELDS_FAILURE;
+
+    for (i = 0; i < self->num_fields; i++)
+        fields[i] = self->fields.narrow[i];
+
+    fields_free(self->allocator, self->fields.narrow);
+
+    self->fields.wide = fields;
+    self->wide = true;
+
+    fields_record_track(self);
+
+    return 0;
+}
+
+/*
+ * Allocate a record that takes over the specified buffer. The record frees
+ * the buffer when it is deallocated, but not if the operation fails.
+ */
+static struct fields_record *
+fields_record_adopt(const struct fields_settings *settings, char *buffer,
+    size_t buffer_size)
+{
+    const struct fields_allocator *allocator;
+    struct fields_record *self;
+    uint32_t *fields;
+    size_t max_fields;
+
+    allocator = fields_allocator(settings);
+
+    max_fields = settings->record_max_fields;
+
+    /*
+     * `buffer` stores the fields separated by single `NUL` characters. Note
+     * that also the fields themselves may contain `NUL` characters.
+     *
+     * `fields` stores the offset of the beginning of each field from `base`,
+     * which is the beginning of `buffer` unless the record is a view. The
+     * offset of field `n + 1` is used for calculating the length of field
+     * `n`. The last field is no exception: the value at the index
+     * `num_fields` stores the offset where the next field would start.
+     * Hence the size of `fields` is `max_fields + 1`.
+     *
+     * The offsets are 32-bit integers unless the record buffer grows larger
+     * than 4 GB, in which case they are widened to 64-bit integers. As they
+     * are relative to `base`, expanding the buffer does not change them.
+     *
+     * `start` and `first` tell where the record begins in `buffer` and in
+     * `fields`. They are zero unless the record is the arena of a batch, in
+     * which case the records are read one after another into the same
+     * buffer. See `fields_reader_read_batch`.
+     */
+    fields = fields_alloc(allocator, (max_fields + 1) * sizeof(uint32_t));
+    if (fields == NULL)
+        return NULL;
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL) {
+        fields_free(allocator, fields);
+        return NULL;
+    }
+
+    self->buffer = buffer;
+    self->buffer_size = buffer_size;
+    self->base = buffer;
+    self->fields.narrow = fields;
+    self->num_fields = 0;
+    self->max_fields = max_fields;
+    self->start = 0;
+    self->first = 0;
+    self->wide = false;
+    self->expand = settings->expand;
+    self->views = settings->views;
+    self->allocator = allocator;
+
+    /*
+     * An expanding record shrinks back to fit the records it has seen, once
+     * every `shrink_interval` records. See `fields_record_observe`. A record
+     * that does not expand keeps its initial size.
+     */
+    self->initial_buffer_size = settings->record_buffer_size;
+    self->initial_max_fields = max_fields;
+    self->shrink_interval = settings->record_shrink_interval;
+    self->shrink_buffer_size = 0;
+    self->shrink_max_fields = 0;
+    self->window_records = 0;
+    self->window_size = 0;
+    self->window_fields = 0;
+    self->peak_footprint = 0;
+
+    fields_record_track(self);
+
+    if (buffer_size > UINT32_MAX && fields_record_widen(self) != 0) {
+        self->buffer = NULL;
+        fields_record_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+struct fields_record *
+fields_record_alloc(const struct fields_settings *settings)
+{
+    const struct fields_allocator *allocator;
+    struct fields_record *self;
+    char *buffer;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    allocator = fields_allocator(settings);
+
+    buffer = fields_alloc(allocator, settings->record_buffer_size);
+    if (buffer == NULL)
+        return NULL;
+
+    self = fields_record_adopt(settings, buffer, settings->record_buffer_size);
+    if (self == NULL) {
+        fields_free(allocator, buffer);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+fields_record_free(struct fields_record *self)
+{
+    const struct fields_allocator *allocator = self->allocator;
+    char *buffer = self->buffer;
+    void *fields = self->fields.narrow;
+
+    fields_free(allocator, self);
+    fields_free(allocator, fields);
+    fields_free(allocator, buffer);
+}
+
+int
+fields_record_field(const struct fields_record *self, unsigned int index,
+    struct fields_field *field)
+{
+    size_t offset;
+
+    if (index >= self->num_fields)
+        return FIELDS_FAILURE;
+
+    offset = fields_record_offset(self, index);
+
+    field->value = self->base + offset;
+    field->length = fields_record_offset(self, index + 1) - offset - 1;
+    return 0;
+}
+
+size_t
+fields_record_size(const struct fields_record *self)
+{
+    return self->num_fields;
+}
+
+void
+fields_record_footprint(const struct fields_record *self,
+    struct fields_footprint *footprint)
+{
+    footprint->current = fields_record_current_footprint(self);
+    footprint->peak = self->peak_footprint;
+}
+
+static const char *
+fields_record_end(const struct fields_record *self)
+{
+    if (!self->expand)
+        return self->buffer + self->start + self->initial_buffer_size;
+
+    return self->buffer + self->buffer_size;
+}
+
+static void
+fields_record_init(struct fields_record *self)
+{
+    self->base = self->buffer;
+    self->num_fields = self->first;
+}
+
+static char *
+fields_record_expand(struct fields_record *self, char *cursor)
+{
+    char *      buffer;
+    size_t      buffer_size;
+    size_t      offset;
+
+    if (!self->expand)
+        return NULL;
+
+    offset = cursor - self->buffer;
+
+    buffer_size = self->buffer_size * 2;
+
+    if (buffer_size > UINT32_MAX && !self->wide &&
+        fields_record_widen(self) != 0)
+        return NULL;
+
+    buffer = fields_realloc(self->allocator, self->buffer, buffer_size);
+    if (buffer == NULL)
+        return NULL;
+
+    self->buffer = buffer;
+    self->buffer_size = buffer_size;
+    self->base = buffer;
+
+    fields_record_track(self);
+
+    return self->buffer + offset;
+}
+
+static int
+fields_record_push(struct fields_record *self, char *cursor)
+{
+    if (!self->expand &&
+        self->num_fields - self->first == self->initial_max_fields)
+        return FIELDS_FAILURE;
+
+    if (self->num_fields == self->max_fields) {
+        size_t  max_fields;
+        size_t  size;
+        void *  fields;
+
+        if (!self->expand)
+            return FIELDS_FAILURE;
+
+        max_fields = self->max_fields * 2;
+        size = self->wide ? sizeof(uint64_t) : sizeof(uint32_t);
+
+        fields = fields_realloc(self->allocator, self->fields.narrow,
+            (max_fields + 1) * size);
+        if (fields == NULL)
+            return FIELDS_FAILURE;
+
+        self->fields.narrow = fields;
+        self->max_fields = max_fields;
+
+        fields_record_track(self);
+    }
+
+    fields_record_set(self, self->num_fields++, cursor);
+    return 0;
+}
+
+static char *
+fields_record_pop(struct fields_record *self)
+{
+    if (self->num_fields == self->first)
+        return self->buffer + self->start;
+
+    self->num_fields--;
+
+    return self->base + fields_record_offset(self, self->num_fields);
+}
+
+static void
+fields_record_finish(struct fields_record *self, char *cursor)
+{
+    fields_record_set(self, self->num_fields, cursor);
+
+    /*
+     * Prefer a record containing no fields to a record containing one field
+     * of zero length.
+     */
+    if (self->num_fields - self->first == 1 &&
+        fields_record_offset(self, self->first + 1) -
+        fields_record_offset(self, self->first) == 1)
+        fields_record_pop(self);
+}
+
+/*
+ * Make room for a record of the initial size after the records already read
+ * into the arena of a batch. Only a record that does not expand needs this,
+ * as the others expand as they are read.
+ */
+static int
+fields_record_reserve(struct fields_record *self)
+{
+    size_t buffer_size = self->buffer_size;
+    size_t max_fields = self->max_fields;
+
+    while (buffer_size < self->start + self->initial_buffer_size)
+        buffer_size *= 2;
+
+    while (max_fields < self->first + self->initial_max_fields)
+        max_fields *= 2;
+
+    if (buffer_size != self->buffer_size) {
+        char *buffer;
+
+        if (buffer_size > UINT32_MAX && !self->wide &&
+            fields_record_widen(self) != 0)
+            return FIELDS_FAILURE;
+
+        buffer = fields_realloc(self->allocator, self->buffer, buffer_size);
+        if (buffer == NULL)
+            return FIELDS_FAILURE;
+
+        self->buffer = buffer;
+        self->buffer_size = buffer_size;
+        self->base = buffer;
+    }
+
+    if (max_fields != self->max_fields) {
+        size_t size = self->wide ? sizeof(uint64_t) : sizeof(uint32_t);
+        void *fields;
+
+        fields = fields_realloc(self->allocator, self->fields.narrow,
+            (max_fields + 1) * size);
+        if (fields == NULL)
+            return FIELDS_FAILURE;
+
+        self->fields.narrow = fields;
+        self->max_fields = max_fields;
+    }
+
+    fields_record_track(self);
+
+    return 0;
+}
+
+static void
+fields_record_observe(struct fields_record *self)
+{
+    size_t buffer_size;
+    size_t max_fields;
+    size_t size;
+
+    if (!self->expand || self->shrink_interval == 0)
+        return;
+
+    /*
+     * Track the largest record and the largest number of fields within a
+     * window of `shrink_interval` records.
+     */
+    size = fields_record_offset(self, self->num_fields);
+
+    if (size > self->window_size)
+        self->window_size = size;
+
+    if (self->num_fields > self->window_fields)
+        self->window_fields = self->num_fields;
+
+    if (++self->window_records < self->shrink_interval)
+        return;
+
+    /*
+     * At the end of a window, plan to shrink the record buffer to twice the
+     * size of the largest record, rounded up to a power of two, and the
+     * field table back towards its initial size. Shrink only by half or
+     * more, so that a record does not oscillate between two sizes.
+     */
+    buffer_size = FIELDS_MINIMUM_RECORD_BUFFER_SIZE;
+    while (buffer_size < self->window_size * 2)
+        buffer_size *= 2;
+
+    max_fields = self->initial_max_fields;
+    while (max_fields < self->window_fields)
+        max_fields *= 2;
+
+    if (buffer_size <= self->buffer_size / 2)
+        self->shrink_buffer_size = buffer_size;
+
+    if (max_fields <= self->max_fields / 2)
+        self->shrink_max_fields = max_fields;
+
+    self->window_records = 0;
+    self->window_size = 0;
+    self->window_fields = 0;
+}
+
+static void
+fields_record_shrink(struct fields_record *self)
+{
+    size_t max_fields;
+    void *fields;
+
+    /*
+     * The record is shrunk only before it is read into again, as its fields
+     * remain valid until then. Neither the buffer nor the field table have
+     * to be preserved.
+     */
+    if (self->shrink_buffer_size != 0) {
+        char *buffer;
+
+        buffer = fields_realloc(self->allocator, self->buffer,
+            self->shrink_buffer_size);
+        if (buffer != NULL) {
+            self->buffer = buffer;
+            self->buffer_size = self->shrink_buffer_size;
+        }
+
+        self->shrink_buffer_size = 0;
+    }
+
+    max_fields = self->shrink_max_fields != 0 ? self->shrink_max_fields :
+        self->max_fields;
+
+    self->shrink_max_fields = 0;
+
+    if (self->wide && self->buffer_size <= UINT32_MAX) {
+        fields = fields_alloc(self->allocator,
+            (max_fields + 1) * sizeof(uint32_t));
+        if (fields == NULL)
+            return;
+
+        fields_free(self->allocator, self->fields.wide);
+
+        self->fields.narrow = fields;
+        self->max_fields = max_fields;
+        self->wide = false;
+    }
+    else if (max_fields != self->max_fields) {
+        size_t size = self->wide ? sizeof(uint64_t) : sizeof(uint32_t);
+
+        fields = fields_realloc(self->allocator, self->fields.narrow,
+            (max_fields + 1) * size);
+        if (fields == NULL)
+            return;
+
+        self->fields.narrow = fields;
+        self->max_fields = max_fields;
+    }
+}
+
+/*
+ * Batches
+ * =======
+ */
+
+#define FIELDS_BATCH_BUFFER_SIZE (64 * 1024)
+#define FIELDS_BATCH_MAX_FIELDS  (4 * 1024)
+#define FIELDS_BATCH_MAX_RECORDS (1024)
+
+struct fields_batch
+{
+    char *      buffer;
+    size_t      buffer_size;
+    size_t      length;
+    size_t *    fields;
+    size_t      num_fields;
+    size_t      max_fields;
+    size_t *    records;
+    size_t      num_records;
+    size_t      max_records;
+
+    struct fields_settings          settings;
+    struct fields_record *          record;
+    const struct fields_allocator * allocator;
+};
+
+struct fields_batch *
+fields_batch_alloc(const struct fields_settings *settings)
+{
+    const struct fields_allocator *allocator;
+    struct fields_batch *self;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    allocator = fields_allocator(settings);
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->allocator = allocator;
+
+    /*
+     * `record` is the arena that a reader parses records into. It shares
+     * `buffer` with the batch and is allocated on the first read, as batches
+     * that are only pushed to never need it.
+     */
+    self->settings = *settings;
+    self->record = NULL;
+
+    /*
+     * `buffer` stores the fields of all records, each field followed by a
+     * `NUL` character.
+     *
+     * `fields` stores the offset of the beginning of each field in `buffer`
+     * and `records` the index of the first field of each record in `fields`.
+     * Like in a record, the value at the index `num_fields` or `num_records`
+     * tells where the next field or record would start, so that the size of
+     * the last field or record can be calculated. The sizes of `fields` and
+     * `records` include these values.
+     */
+    self->buffer = fields_alloc(allocator, FIELDS_BATCH_BUFFER_SIZE);
+    self->fields = fields_alloc(allocator,
+        FIELDS_BATCH_MAX_FIELDS * sizeof(size_t));
+    self->records = fields_alloc(allocator,
+        FIELDS_BATCH_MAX_RECORDS * sizeof(size_t));
+
+    if (self->buffer == NULL || self->fields == NULL ||
+        self->records == NULL) {
+        fields_batch_free(self);
+        return NULL;
+    }
+
+    self->buffer_size = FIELDS_BATCH_BUFFER_SIZE;
+    self->max_fields = FIELDS_BATCH_MAX_FIELDS;
+    self->max_records = FIELDS_BATCH_MAX_RECORDS;
+
+    fields_batch_clear(self);
+
+    return self;
+}
+
+void
+fields_batch_free(struct fields_batch *self)
+{
+    if (self->record != NULL) {
+        self->record->buffer = NULL;
+        fields_record_free(self->record);
+    }
+
+    fields_free(self->allocator, self->records);
+    fields_free(self->allocator, self->fields);
+    fields_free(self->allocator, self->buffer);
+    fields_free(self->allocator, self);
+}
+
+void
+fields_batch_clear(struct fields_batch *self)
+{
+    self->length = 0;
+    self->num_fields = 0;
+    self->num_records = 0;
+
+    self->fields[0] = 0;
+    self->records[0] = 0;
+}
+
+static void *
+fields_array_expand(const struct fields_allocator *allocator, void *array,
+    size_t *max, size_t needed, size_t size)
+{
+    size_t max_new;
+    void *result;
+
+    max_new = *max;
+    while (max_new < needed)
+        max_new *= 2;
+
+    result = fields_realloc(allocator, array, max_new * size);
+    if (result == NULL)
+        return NULL;
+
+    *max = max_new;
+
+    return result;
+}
+
+int
+fields_batch_push(struct fields_batch *self, const struct fields_record *record)
+{
+    const char *start;
+    size_t first;
+    size_t length;
+    size_t i;
+
+    first = fields_record_offset(record, 0);
+    start = record->base + first;
+    length = fields_record_offset(record, record->num_fields) - first;
+
+    if (self->length + length > self->buffer_size) {
+        char *buffer;
+
+        buffer = fields_array_expand(self->allocator, self->buffer,
+            &self->buffer_size, self->length + length, 1);
+        if (buffer == NULL)
+            return FIELDS_FAILURE;
+
+        self->buffer = buffer;
+    }
+
+    if (self->num_fields + record->num_fields + 1 > self->max_fields) {
+        size_t *fields;
+
+        fields = fields_array_expand(self->allocator, self->fields,
+            &self->max_fields, self->num_fields + record->num_fields + 1,
+            sizeof(size_t));
+        if (fields == NULL)
+            return FIELDS_FAILURE;
+
+        self->fields = fields;
+    }
+
+    if (self->num_records + 2 > self->max_records) {
+        size_t *records;
+
+        records = fields_array_expand(self->allocator, self->records,
+            &self->max_records, self->num_records + 2, sizeof(size_t));
+        if (records == NULL)
+            return FIELDS_FAILURE;
+
+        self->records = records;
+    }
+
+    /*
+     * The fields of a record are adjacent, each followed by one character.
+     * In a view, that character is a delimiter or a record separator instead
+     * of a `NUL` character.
+     */
+    memcpy(self->buffer + self->length, start, length);
+
+    for (i = 0; i < record->num_fields; i++) {
+        size_t offset = self->length + fields_record_offset(record, i) - first;
+        size_t end = self->length + fields_record_offset(record, i + 1) -
+            first - 1;
+
+        self->fields[self->num_fields++] = offset;
+        self->buffer[end] = '\0';
+    }
+
+    self->length += length;
+
+    self->fields[self->num_fields] = self->length;
+
+    self->records[++self->num_records] = self->num_fields;
+
+    return 0;
+}
+
+/*
+ * Get the arena for reading records into the batch. The records are parsed
+ * straight into the buffer of the batch, each one after the previous one.
+ */
+static struct fields_record *
+fields_batch_arena(struct fields_batch *self)
+{
+    struct fields_record *record = self->record;
+
+    if (record == NULL) {
+        struct fields_settings settings = self->settings;
+
+        settings.views = false;
+        settings.record_shrink_interval = 0;
+
+        record = fields_record_adopt(&settings, self->buffer,
+            self->buffer_size);
+        if (record == NULL)
+            return NULL;
+
+        self->record = record;
+    }
+
+    /*
+     * Pushing records to the batch may have moved its buffer.
+     */
+    record->buffer = self->buffer;
+    record->buffer_size = self->buffer_size;
+    record->start = 0;
+    record->first = 0;
+
+    if (record->buffer_size > UINT32_MAX && !record->wide &&
+        fields_record_widen(record) != 0)
+        return NULL;
+
+    fields_record_init(record);
+
+    return record;
+}
+
+/*
+ * Append the record just read into the arena. Its values are in place
+ * already, and only its field offsets are copied.
+ */
+static int
+fields_batch_append(struct fields_batch *self,
+    const struct fields_record *record)
+{
+    size_t i;
+
+    if (record->num_fields + 1 > self->max_fields) {
+        size_t *fields;
+
+        fields = fields_array_expand(self->allocator, self->fields,
+            &self->max_fields, record->num_fields + 1, sizeof(size_t));
+        if (fields == NULL)
+            return FIELDS_FAILURE;
+
+        self->fields = fields;
+    }
+
+    if (self->num_records + 2 > self->max_records) {
+        size_t *records;
+
+        records = fields_array_expand(self->allocator, self->records,
+            &self->max_records, self->num_records + 2, sizeof(size_t));
+        if (records == NULL)
+            return FIELDS_FAILURE;
+
+        self->records = records;
+    }
+
+    for (i = self->num_fields; i < record->num_fields; i++)
+        self->fields[i] = fields_record_offset(record, i);
+
+    self->num_fields = record->num_fields;
+    self->length = fields_record_offset(record, record->num_fields);
+
+    self->fields[self->num_fields] = self->length;
+
+    self->records[++self->num_records] = self->num_fields;
+
+    return 0;
+}
+
+size_t
+fields_batch_size(const struct fields_batch *self)
+{
+    return self->num_records;
+}
+
+int
+fields_batch_record(const struct fields_batch *self, size_t index,
+    struct fields_record *record)
+{
+    size_t first;
+    size_t last;
+    size_t i;
+
+    if (index >= self->num_records)
+        return FIELDS_FAILURE;
+
+    first = self->records[index];
+    last = self->records[index + 1];
+
+    fields_record_init(record);
+
+    /*
+     * The fields of the record point into the batch.
+     */
+    if (self->fields[last] - self->fields[first] > UINT32_MAX &&
+        !record->wide && fields_record_widen(record) != 0)
+        return FIELDS_FAILURE;
+
+    record->base = self->buffer + self->fields[first];
+
+    for (i = first; i < last; i++) {
+        if (fields_record_push(record, self->buffer + self->fields[i]) != 0)
+            return FIELDS_FAILURE;
+    }
+
+    fields_record_set(record, record->num_fields,
+        self->buffer + self->fields[last]);
+
+    return 0;
+}
+
+void
+fields_batch_contents(const struct fields_batch *self, const char **values,
+    const size_t **fields, const size_t **records)
+{
+    *values = self->buffer;
+    *fields = self->fields;
+    *records = self->records;
+}
+
+/*
+ * Columns
+ * =======
+ */
+
+#define FIELDS_COLUMNS_VALUES_SIZE (4 * 1024)
+#define FIELDS_COLUMNS_MAX_ROWS    (1024)
+
+struct fields_column_buffer
+{
+    char *      values;
+    size_t      values_size;
+    size_t      length;
+    int32_t *   offsets;
+    uint8_t *   validity;
+    size_t      null_count;
+};
+
+struct fields_columns
+{
+    struct fields_column_buffer *   columns;
+    size_t                          num_columns;
+    size_t                          num_rows;
+    size_t                          max_rows;
+
+    size_t                          row_fields;
+    int                             row_error;
+
+    const struct fields_allocator * allocator;
+};
+
+static size_t
+fields_validity_size(size_t num_rows)
+{
+    return (num_rows + 7) / 8;
+}
+
+struct fields_columns *
+fields_columns_alloc(size_t num_columns, const struct fields_settings *settings)
+{
+    const struct fields_allocator *allocator;
+    struct fields_columns *self;
+    size_t i;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    allocator = fields_allocator(settings);
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->columns = fields_calloc(allocator, num_columns,
+        sizeof(*self->columns));
+    if (self->columns == NULL && num_columns > 0) {
+        fields_free(allocator, self);
+        return NULL;
+    }
+
+    self->allocator = allocator;
+    self->num_columns = num_columns;
+    self->max_rows = FIELDS_COLUMNS_MAX_ROWS;
+
+    /*
+     * Each column follows the layout of an Apache Arrow string column.
+     * `values` stores the values one after another, with no separators.
+     * `offsets` stores the offset of the beginning of each value in
+     * `values`, followed by the length of `values`. Hence the size of
+     * `offsets` is `max_rows + 1`. `validity` stores one bit per row, least
+     * significant bit first, and the bit is set unless the value is null.
+     */
+    for (i = 0; i < num_columns; i++) {
+        struct fields_column_buffer *column = &self->columns[i];
+
+        column->values = fields_alloc(allocator,
+            FIELDS_COLUMNS_VALUES_SIZE);
+        column->offsets = fields_alloc(allocator,
+            (self->max_rows + 1) * sizeof(int32_t));
+        column->validity = fields_alloc(allocator,
+            fields_validity_size(self->max_rows));
+
+        if (column->values == NULL || column->offsets == NULL ||
+            column->validity == NULL) {
+            fields_columns_free(self);
+            return NULL;
+        }
+
+        column->values_size = FIELDS_COLUMNS_VALUES_SIZE;
+    }
+
+    fields_columns_clear(self);
+
+    return self;
+}
+
+void
+fields_columns_free(struct fields_columns *self)
+{
+    size_t i;
+
+    for (i = self->num_columns; i > 0; i--) {
+        struct fields_column_buffer *column = &self->columns[i - 1];
+
+        fields_free(self->allocator, column->validity);
+        fields_free(self->allocator, column->offsets);
+        fields_free(self->allocator, column->values);
+    }
+
+    fields_free(self->allocator, self->columns);
+    fields_free(self->allocator, self);
+}
+
+void
+fields_columns_clear(struct fields_columns *self)
+{
+    size_t i;
+
+    self->num_rows = 0;
+
+    for (i = 0; i < self->num_columns; i++) {
+        self->columns[i].length = 0;
+        self->columns[i].offsets[0] = 0;
+        self->columns[i].null_count = 0;
+    }
+}
+
+static int
+fields_columns_reserve_row(struct fields_columns *self)
+{
+    size_t max_rows = self->max_rows * 2;
+    size_t i;
+
+    if (self->num_rows < self->max_rows)
+        return 0;
+
+    for (i = 0; i < self->num_columns; i++) {
+        struct fields_column_buffer *column = &self->columns[i];
+        int32_t *offsets;
+        uint8_t *validity;
+
+        offsets = fields_realloc(self->allocator, column->offsets,
+            (max_rows + 1) * sizeof(int32_t));
+        if (offsets == NULL)
+            return FIELDS_FAILURE;
+
+        column->offsets = offsets;
+
+        validity = fields_realloc(self->allocator, column->validity,
+            fields_validity_size(max_rows));
+        if (validity == NULL)
+            return FIELDS_FAILURE;
+
+        column->validity = validity;
+    }
+
+    self->max_rows = max_rows;
+
+    return 0;
+}
+
+static int
+fields_columns_reserve_value(struct fields_columns *self, size_t index,
+    size_t length)
+{
+    struct fields_column_buffer *column = &self->columns[index];
+    char *values;
+
+    if (column->length + length > INT32_MAX)
+        return FIELDS_FAILURE;
+
+    if (column->length + length <= column->values_size)
+        return 0;
+
+    values = fields_array_expand(self->allocator, column->values,
+        &column->values_size, column->length + length, 1);
+    if (values == NULL)
+        return FIELDS_FAILURE;
+
+    column->values = values;
+
+    return 0;
+}
+
+static int
+fields_columns_reserve(struct fields_columns *self,
+    const struct fields_record *record)
+{
+    size_t i;
+
+    if (fields_columns_reserve_row(self) != 0)
+        return FIELDS_FAILURE;
+
+    for (i = 0; i < record->num_fields; i++) {
+        size_t length = fields_record_offset(record, i + 1) -
+            fields_record_offset(record, i) - 1;
+
+        if (fields_columns_reserve_value(self, i, length) != 0)
+            return FIELDS_FAILURE;
+    }
+
+    return 0;
+}
+
+/*
+ * Complete the row whose values have been appended to the first `num_fields`
+ * columns. The other columns get a null value.
+ */
+static void
+fields_columns_end_row(struct fields_columns *self, size_t num_fields)
+{
+    size_t row = self->num_rows;
+    size_t i;
+
+    for (i = 0; i < self->num_columns; i++) {
+        struct fields_column_buffer *column = &self->columns[i];
+
+        if (row % 8 == 0)
+            column->validity[row / 8] = 0;
+
+        if (i < num_fields)
+            column->validity[row / 8] |= 1 << (row % 8);
+        else
+            column->null_count++;
+
+        column->offsets[row + 1] = column->length;
+    }
+
+    self->num_rows++;
+}
+
+/*
+ * Remove the values of an incomplete row.
+ */
+static void
+fields_columns_rollback(struct fields_columns *self)
+{
+    size_t i;
+
+    for (i = 0; i < self->num_columns; i++)
+        self->columns[i].length = self->columns[i].offsets[self->num_rows];
+}
+
+int
+fields_columns_push(struct fields_columns *self,
+    const struct fields_record *record)
+{
+    size_t i;
+
+    if (record->num_fields > self->num_columns)
+        return FIELDS_FAILURE;
+
+    /*
+     * Reserve space in all columns first, so that a failure leaves no
+     * partial row behind.
+     */
+    if (fields_columns_reserve(self, record) != 0)
+        return FIELDS_FAILURE;
+
+    for (i = 0; i < record->num_fields; i++) {
+        struct fields_column_buffer *column = &self->columns[i];
+        struct fields_field field;
+
+        fields_record_field(record, i, &field);
+
+        memcpy(column->values + column->length, field.value, field.length);
+        column->length += field.length;
+    }
+
+    fields_columns_end_row(self, record->num_fields);
+
+    return 0;
+}
+
+/*
+ * The callbacks through which a reader appends a row. A field that does not
+ * fit fails the row, which the reader then removes.
+ */
+static void
+fields_columns_on_field(void *context, const char *value, size_t length,
+    size_t index)
+{
+    struct fields_columns *self = context;
+    struct fields_column_buffer *column;
+
+    self->row_fields = index + 1;
+
+    if (index >= self->num_columns || self->row_error != 0)
+        return;
+
+    if (fields_columns_reserve_value(self, index, length) != 0) {
+        self->row_error = FIELDS_READER_ERROR_TOO_BIG_RECORD;
+        return;
+    }
+
+    column = &self->columns[index];
+
+    memcpy(column->values + column->length, value, length);
+    column->length += length;
+}
+
+static void
+fields_columns_on_record_end(void *context)
+{
+    struct fields_columns *self = context;
+
+    if (self->row_fields > self->num_columns && self->row_error == 0)
+        self->row_error = FIELDS_READER_ERROR_TOO_MANY_FIELDS;
+
+    if (self->row_error == 0)
+        fields_columns_end_row(self, self->row_fields);
+}
+
+size_t
+fields_columns_size(const struct fields_columns *self)
+{
+    return self->num_rows;
+}
+
+int
+fields_columns_column(const struct fields_columns *self, size_t index,
+    struct fields_column *column)
+{
+    if (index >= self->num_columns)
+        return FIELDS_FAILURE;
+
+    column->values = self->columns[index].values;
+    column->offsets = self->columns[index].offsets;
+    column->validity = self->columns[index].validity;
+    column->null_count = self->columns[index].null_count;
+
+    return 0;
+}
+
+/*
+ * Conversions
+ * ===========
+ */
+
+#define FIELDS_MAX_EXACT_INTEGER (UINT64_C(1) << 53)
+#define FIELDS_MAX_EXACT_POWER   (22)
+
+static const double fields_powers_of_ten[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const uint64_t fields_integer_powers_of_ten[] =
+{
+    UINT64_C(1),
+    UINT64_C(10),
+    UINT64_C(100),
+    UINT64_C(1000),
+    UINT64_C(10000),
+    UINT64_C(100000),
+    UINT64_C(1000000),
+    UINT64_C(10000000),
+    UINT64_C(100000000),
+    UINT64_C(1000000000),
+    UINT64_C(10000000000),
+    UINT64_C(100000000000),
+    UINT64_C(1000000000000),
+    UINT64_C(10000000000000),
+    UINT64_C(100000000000000),
+    UINT64_C(1000000000000000),
+    UINT64_C(10000000000000000),
+    UINT64_C(100000000000000000),
+    UINT64_C(1000000000000000000)
+};
+
+static inline bool
+fields_digit(char ch)
+{
+    return (ch >= '0') && (ch <= '9');
+}
+
+static inline uint64_t
+fields_load(const char *p)
+{
+    uint64_t word;
+
+    memcpy(&word, p, sizeof(word));
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+
+    return word;
+}
+
+static inline bool
+fields_swar_digits(uint64_t word)
+{
+    /*
+     * This function checks whether all eight bytes are digits. A byte is a
+     * digit if its high nibble is 3 both before and after adding 6.
+     */
+    return ((word & UINT64_C(0xF0F0F0F0F0F0F0F0)) |
+        (((word + UINT64_C(0x0606060606060606)) &
+        UINT64_C(0xF0F0F0F0F0F0F0F0)) >> 4)) ==
+        UINT64_C(0x3333333333333333);
+}
+
+static inline uint64_t
+fields_swar_value(uint64_t word)
+{
+    /*
+     * This function combines eight digits, the first one in the least
+     * significant byte, into their value by pairing adjacent digits, then
+     * adjacent pairs and finally adjacent quads.
+     */
+    word = ((word & UINT64_C(0x0F0F0F0F0F0F0F0F)) * 2561) >> 8;
+    word = ((word & UINT64_C(0x00FF00FF00FF00FF)) * 6553601) >> 16;
+
+    return ((word & UINT64_C(0x0000FFFF0000FFFF)) *
+        UINT64_C(42949672960001)) >> 32;
+}
+
+static const char *
+fields_digits(const char *p, const char *end, uint64_t *value)
+{
+    /*
+     * This function accumulates the digits at `p` into `value` and returns a
+     * pointer to the first byte that is not a digit. The value wraps around
+     * if there are more than 19 digits.
+     */
+    uint64_t result = *value;
+
+    while ((end - p >= 8) && fields_swar_digits(fields_load(p))) {
+        result = result * 100000000 + fields_swar_value(fields_load(p));
+        p += 8;
+    }
+
+    while ((p != end) && fields_digit(*p)) {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+
+    *value = result;
+
+    return p;
+}
+
+static const char *
+fields_zeros(const char *p, const char *end)
+{
+    while ((p != end) && (*p == '0'))
+        p++;
+
+    return p;
+}
+
+static const char *
+fields_sign(const char *p, const char *end, bool *negative)
+{
+    *negative = (p != end) && (*p == '-');
+
+    if ((p != end) && (*p == '-' || *p == '+'))
+        p++;
+
+    return p;
+}
+
+static int
+fields_integer(uint64_t value, bool negative, int64_t *result)
+{
+    if (value > (uint64_t)INT64_MAX + negative)
+        return FIELDS_CONVERSION_ERROR_RANGE;
+
+    *result = negative ? -(int64_t)(value - 1) - 1 : (int64_t)value;
+
+    return 0;
+}
+
+int
+fields_field_int64(const struct fields_field *field, int64_t *result)
+{
+    const char *p = field->value;
+    const char *end = field->value + field->length;
+    const char *start;
+    const char *significant;
+    uint64_t value = 0;
+    bool negative;
+
+    p = fields_sign(p, end, &negative);
+
+    start = p;
+    significant = p = fields_zeros(p, end);
+    p = fields_digits(p, end, &value);
+
+    if ((p == start) || (p != end))
+        return FIELDS_CONVERSION_ERROR_SYNTAX;
+
+    if (p - significant > 19)
+        return FIELDS_CONVERSION_ERROR_RANGE;
+
+    return fields_integer(value, negative, result);
+}
+
+static int
+fields_strtod(const char *value, size_t length, long exponent,
+    double *result)
+{
+    char local[64];
+    char digits[24];
+    char *buffer;
+    char *end;
+    unsigned long magnitude;
+    size_t i;
+    size_t j;
+    size_t k;
+    int error;
+
+    /*
+     * Hand the value over to `strtod` as an integer mantissa followed by the
+     * exponent, as in 12345e-2 for 123.45. `strtod` reads the locale, but a
+     * value without a decimal point is parsed the same way in every locale.
+     * Substituting the decimal point of the locale instead would require
+     * `localeconv`, which is not safe while other threads run.
+     */
+    magnitude = exponent < 0 ? -(unsigned long)exponent :
+        (unsigned long)exponent;
+
+    k = 0;
+    do {
+        digits[k++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    buffer = local;
+    if (length + k + 3 > sizeof(local)) {
+        buffer = malloc(length + k + 3);
+        if (buffer == NULL)
+            return FIELDS_CONVERSION_ERROR_MEMORY;
+    }
+
+    for (i = 0, j = 0; i < length; i++) {
+        if (value[i] == 'e' || value[i] == 'E')
+            break;
+
+        if (value[i] != '.')
+            buffer[j++] = value[i];
+    }
+
+    buffer[j++] = 'e';
+    if (exponent < 0)
+        buffer[j++] = '-';
+
+    while (k > 0)
+        buffer[j++] = digits[--k];
+
+    buffer[j] = '\0';
+
+    errno = 0;
+
+    *result = strtod(buffer, &end);
+
+    /*
+     * Underflow yields a zero or a subnormal number, which is fine.
+     */
+    error = 0;
+    if ((size_t)(end - buffer) != j)
+        error = FIELDS_CONVERSION_ERROR_SYNTAX;
+    else if ((errno == ERANGE) && (*result > 1 || *result < -1))
+        error = FIELDS_CONVERSION_ERROR_RANGE;
+
+    if (buffer != local)
+        free(buffer);
+
+    return error;
+}
+
+int
+fields_field_double(const struct fields_field *field, double *result)
+{
+    const char *p = field->value;
+    const char *end = field->value + field->length;
+    const char *start;
+    const char *q;
+    uint64_t mantissa = 0;
+    size_t digits = 0;
+    size_t fraction = 0;
+    long exponent = 0;
+    bool negative;
+    double value;
+
+    p = fields_sign(p, end, &negative);
+
+    start = p;
+    p = fields_zeros(p, end);
+
+    q = p;
+    p = fields_digits(p, end, &mantissa);
+    digits = p - q;
+
+    if ((p != end) && (*p == '.')) {
+        p++;
+
+        q = p;
+        if (digits == 0)
+            p = fields_zeros(p, end);
+
+        fraction = p - q;
+
+        q = p;
+        p = fields_digits(p, end, &mantissa);
+        digits += p - q;
+        fraction += p - q;
+
+        if (p - start == 1)
+            return FIELDS_CONVERSION_ERROR_SYNTAX;
+    }
+
+    if (p == start)
+        return FIELDS_CONVERSION_ERROR_SYNTAX;
+
+    if ((p != end) && (*p == 'e' || *p == 'E')) {
+        bool exponent_negative;
+
+        p = fields_sign(p + 1, end, &exponent_negative);
+
+        if ((p == end) || !fields_digit(*p))
+            return FIELDS_CONVERSION_ERROR_SYNTAX;
+
+        /*
+         * The exponent saturates far beyond the range of a double but not
+         * below the number of decimals of any practical field, which are
+         * subtracted from it.
+         */
+        while ((p != end) && fields_digit(*p)) {
+            if (exponent < 100000000)
+                exponent = exponent * 10 + (*p - '0');
+            p++;
+        }
+
+        if (exponent_negative)
+            exponent = -exponent;
+    }
+
+    if (p != end)
+        return FIELDS_CONVERSION_ERROR_SYNTAX;
+
+    exponent -= (long)fraction;
+
+    if (mantissa == 0 && digits == 0) {
+        *result = negative ? -0.0 : 0.0;
+        return 0;
+    }
+
+    /*
+     * If the mantissa and the power of ten are both exactly representable,
+     * a single multiplication or division yields the correctly rounded
+     * result. This requires that the arithmetic is done in double precision.
+     */
+#if FLT_EVAL_METHOD == 0
+    if ((digits <= 19) && (mantissa <= FIELDS_MAX_EXACT_INTEGER)) {
+        if ((exponent >= -FIELDS_MAX_EXACT_POWER) &&
+            (exponent <= FIELDS_MAX_EXACT_POWER)) {
+            value = (double)mantissa;
+
+            if (exponent < 0)
+                value /= fields_powers_of_ten[-exponent];
+            else
+                value *= fields_powers_of_ten[exponent];
+
+            *result = negative ? -value : value;
+            return 0;
+        }
+
+        /*
+         * A larger exponent works too if the surplus keeps the mantissa
+         * exact, as in 12e30.
+         */
+        if ((exponent > FIELDS_MAX_EXACT_POWER) &&
+            (exponent <= FIELDS_MAX_EXACT_POWER + 15)) {
+            uint64_t power = fields_integer_powers_of_ten[exponent -
+                FIELDS_MAX_EXACT_POWER];
+
+            if (mantissa <= FIELDS_MAX_EXACT_INTEGER / power) {
+                value = (double)(mantissa * power) *
+                    fields_powers_of_ten[FIELDS_MAX_EXACT_POWER];
+
+                *result = negative ? -value : value;
+                return 0;
+            }
+        }
+    }
+#endif
+
+    return fields_strtod(field->value, field->length, exponent, result);
+}
+
+int
+fields_field_decimal(const struct fields_field *field, unsigned int scale,
+    int64_t *result)
+{
+    const char *p = field->value;
+    const char *end = field->value + field->length;
+    const char *start;
+    const char *significant;
+    const char *q;
+    uint64_t value = 0;
+    uint64_t fraction = 0;
+    uint64_t power;
+    bool negative;
+    bool inexact = false;
+
+    if (scale > 18)
+        return FIELDS_CONVERSION_ERROR_RANGE;
+
+    power = fields_integer_powers_of_ten[scale];
+
+    p = fields_sign(p, end, &negative);
+
+    start = p;
+    significant = p = fields_zeros(p, end);
+    p = fields_digits(p, end, &value);
+
+    if (p - significant > 19)
+        return FIELDS_CONVERSION_ERROR_RANGE;
+
+    if ((p != end) && (*p == '.')) {
+        p++;
+
+        q = p;
+        p = fields_digits(p, (size_t)(end - p) > scale ? p + scale : end,
+            &fraction);
+
+        /*
+         * Digits beyond the scale are fine as long as they are zeros.
+         */
+        while ((p != end) && fields_digit(*p)) {
+            if (*p != '0')
+                inexact = true;
+            p++;
+        }
+
+        if (p - start == 1)
+            return FIELDS_CONVERSION_ERROR_SYNTAX;
+
+        fraction *= fields_integer_powers_of_ten[scale - (p - q < scale ?
+            (size_t)(p - q) : scale)];
+    }
+
+    if ((p == start) || (p != end))
+        return FIELDS_CONVERSION_ERROR_SYNTAX;
+
+    if (inexact)
+        return FIELDS_CONVERSION_ERROR_PRECISION;
+
+    if (value > (UINT64_MAX - fraction) / power)
+        return FIELDS_CONVERSION_ERROR_RANGE;
+
+    return fields_integer(value * power + fraction, negative, result);
+}
+
+static inline bool
+fields_swar_match(uint64_t word, uint64_t pattern, uint64_t digits)
+{
+    /*
+     * This function checks that the bytes selected by `digits` are decimal
+     * digits and that the other bytes equal those in `pattern`, in which the
+     * digits are zeros. XOR maps the digits to their values and the matching
+     * bytes to zeros.
+     */
+    uint64_t x = word ^ pattern;
+
+    return (((x | (x + UINT64_C(0x0606060606060606))) &
+        UINT64_C(0xF0F0F0F0F0F0F0F0)) == 0) && ((x & ~digits) == 0);
+}
+
+static inline unsigned
+fields_swar_digit(uint64_t word, unsigned index)
+{
+    return (word >> (8 * index)) & 0x0F;
+}
+
+static bool
+fields_leap_year(long year)
+{
+    return (year % 4 == 0) && (year % 100 != 0 || year % 400 == 0);
+}
+
+static long
+fields_days(long year, unsigned month, unsigned day)
+{
+    long era;
+    long year_of_era;
+    long day_of_year;
+    long day_of_era;
+
+    /*
+     * This function returns the number of days since 1970-01-01 in the
+     * proleptic Gregorian calendar. The years start in March, so that the
+     * leap day is the last day of a year.
+     */
+    if (month <= 2)
+        year--;
+
+    era = (year >= 0 ? year : year - 399) / 400;
+    year_of_era = year - era * 400;
+    day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+        day - 1;
+    day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 +
+        day_of_year;
+
+    return era * 146097 + day_of_era - 719468;
+}
+
+static int
+fields_date(const char *p, long *result)
+{
+    static const unsigned char days_in_month[] =
+        { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    uint64_t word;
+    uint64_t tail;
+    unsigned year;
+    unsigned month;
+    unsigned day;
+
+    /*
+     * Match YYYY-MM- and YY-MM-DD, which overlap, against the patterns
+     * "0000-00-" and "00-00-00".
+     */
+    word = fields_load(p);
+    tail = fields_load(p + 2);
+
+    if (!fields_swar_match(word, UINT64_C(0x2D30302D30303030),
+        UINT64_C(0x00FFFF00FFFFFFFF)))
+        return FIELDS_CONVERSION_ERROR_DATE;
+
+    if (!fields_swar_match(tail, UINT64_C(0x30302D30302D3030),
+        UINT64_C(0xFFFF00FFFF00FFFF)))
+        return FIELDS_CONVERSION_ERROR_DATE;
+
+    word ^= UINT64_C(0x2D30302D30303030);
+    tail ^= UINT64_C(0x30302D30302D3030);
+
+    year = fields_swar_digit(word, 0) * 1000 +
+        fields_swar_digit(word, 1) * 100 +
+        fields_swar_digit(word, 2) * 10 +
+        fields_swar_digit(word, 3);
+    month = fields_swar_digit(word, 5) * 10 + fields_swar_digit(word, 6);
+    day = fields_swar_digit(tail, 6) * 10 + fields_swar_digit(tail, 7);
+
+    if (month < 1 || month > 12 || day < 1)
+        return FIELDS_CONVERSION_ERROR_DATE;
+
+    if (day > days_in_month[month - 1] +
+        (unsigned)(month == 2 && fields_leap_year(year)))
+        return FIELDS_CONVERSION_ERROR_DATE;
+
+    *result = fields_days(year, month, day);
+
+    return 0;
+}
+
+static int
+fields_time(const char *p, size_t length, int64_t *result)
+{
+    uint64_t word;
+    unsigned hour;
+    unsigned minute;
+    unsigned second;
+    int64_t microsecond;
+    size_t i;
+
+    /*
+     * Match HH:MM:SS against the pattern "00:00:00".
+     */
+    word = fields_load(p);
+
+    if (!fields_swar_match(word, UINT64_C(0x30303A30303A3030),
+        UINT64_C(0xFFFF00FFFF00FFFF)))
+        return FIELDS_CONVERSION_ERROR_DATE;
+
+    word ^= UINT64_C(0x30303A30303A3030);
+
+    hour = fields_swar_digit(word, 0) * 10 + fields_swar_digit(word, 1);
+    minute = fields_swar_digit(word, 3) * 10 + fields_swar_digit(word, 4);
+    second = fields_swar_digit(word, 6) * 10 + fields_swar_digit(word, 7);
+
+    if (hour > 23 || minute > 59 || second > 59)
+        return FIELDS_CONVERSION_ERROR_DATE;
+
+    /*
+     * The fraction of a second has one to six digits.
+     */
+    microsecond = 0;
+
+    if (length > 8) {
+        if (p[8] != '.' || length == 9 || length > 15)
+            return FIELDS_CONVERSION_ERROR_DATE;
+
+        for (i = 9; i < 15; i++) {
+            if (i < length && !fields_digit(p[i]))
+                return FIELDS_CONVERSION_ERROR_DATE;
+
+            microsecond = microsecond * 10 + (i < length ? p[i] - '0' : 0);
+        }
+    }
+
+    *result = ((hour * 60 + minute) * 60 + second) * INT64_C(1000000) +
+        microsecond;
+
+    return 0;
+}
+
+int
+fields_field_date(const struct fields_field *field, int32_t *result)
+{
+    long days;
+    int error;
+
+    if (field->length != 10)
+        return FIELDS_CONVERSION_ERROR_DATE;
+
+    error = fields_date(field->value, &days);
+    if (error != 0)
+        return error;
+
+    *result = days;
+
+    return 0;
+}
+
+int
+fields_field_timestamp(const struct fields_field *field, int64_t *result)
+{
+    const char *p = field->value;
+    long days;
+    int64_t microseconds;
+    int error;
+
+    if (field->length < 10)
+        return FIELDS_CONVERSION_ERROR_DATE;
+
+    error = fields_date(p, &days);
+    if (error != 0)
+        return error;
+
+    microseconds = 0;
+
+    if (field->length > 10) {
+        if ((field->length < 19) || (p[10] != ' ' && p[10] != 'T'))
+            return FIELDS_CONVERSION_ERROR_DATE;
+
+        error = fields_time(p + 11, field->length - 11, &microseconds);
+        if (error != 0)
+            return error;
+    }
+
+    *result = (int64_t)days * INT64_C(86400000000) + microseconds;
+
+    return 0;
+}
+
+static int
+fields_column_field(const struct fields_column *column, size_t row,
+    struct fields_field *field)
+{
+    if ((column->validity[row / 8] & (1 << (row % 8))) == 0)
+        return FIELDS_FAILURE;
+
+    field->value = column->values + column->offsets[row];
+    field->length = column->offsets[row + 1] - column->offsets[row];
+
+    return 0;
+}
+
+int
+fields_column_int64(const struct fields_column *column, size_t num_rows,
+    int64_t *values, size_t *row)
+{
+    size_t i;
+
+    for (i = 0; i < num_rows; i++) {
+        struct fields_field field;
+        int error;
+
+        values[i] = 0;
+
+        if (fields_column_field(column, i, &field) != 0)
+            continue;
+
+        error = fields_field_int64(&field, &values[i]);
+        if (error != 0) {
+            *row = i;
+            return error;
+        }
+    }
+
+    return 0;
+}
+
+int
+fields_column_double(const struct fields_column *column, size_t num_rows,
+    double *values, size_t *row)
+{
+    size_t i;
+
+    for (i = 0; i < num_rows; i++) {
+        struct fields_field field;
+        int error;
+
+        values[i] = 0;
+
+        if (fields_column_field(column, i, &field) != 0)
+            continue;
+
+        error = fields_field_double(&field, &values[i]);
+        if (error != 0) {
+            *row = i;
+            return error;
+        }
+    }
+
+    return 0;
+}
+
+int
+fields_column_decimal(const struct fields_column *column, size_t num_rows,
+    unsigned int scale, int64_t *values, size_t *row)
+{
+    size_t i;
+
+    for (i = 0; i < num_rows; i++) {
+        struct fields_field field;
+        int error;
+
+        values[i] = 0;
+
+        if (fields_column_field(column, i, &field) != 0)
+            continue;
+
+        error = fields_field_decimal(&field, scale, &values[i]);
+        if (error != 0) {
+            *row = i;
+            return error;
+        }
+    }
+
+    return 0;
+}
+
+int
+fields_column_date(const struct fields_column *column, size_t num_rows,
+    int32_t *values, size_t *row)
+{
+    size_t i;
+
+    for (i = 0; i < num_rows; i++) {
+        struct fields_field field;
+        int error;
+
+        values[i] = 0;
+
+        if (fields_column_field(column, i, &field) != 0)
+            continue;
+
+        error = fields_field_date(&field, &values[i]);
+        if (error != 0) {
+            *row = i;
+            return error;
+        }
+    }
+
+    return 0;
+}
+
+int
+fields_column_timestamp(const struct fields_column *column, size_t num_rows,
+    int64_t *values, size_t *row)
+{
+    size_t i;
+
+    for (i = 0; i < num_rows; i++) {
+        struct fields_field field;
+        int error;
+
+        values[i] = 0;
+
+        if (fields_column_field(column, i, &field) != 0)
+            continue;
+
+        error = fields_field_timestamp(&field, &values[i]);
+        if (error != 0) {
+            *row = i;
+            return error;
+        }
+    }
+
+    return 0;
+}
+
+const char *
+fields_conversion_strerror(int error)
+{
+    switch (error) {
+    case FIELDS_CONVERSION_ERROR_SYNTAX:
+        return "Bad number";
+    case FIELDS_CONVERSION_ERROR_RANGE:
+        return "Number out of range";
+    case FIELDS_CONVERSION_ERROR_PRECISION:
+        return "Too many decimals";
+    case FIELDS_CONVERSION_ERROR_MEMORY:
+        return "Out of memory";
+    case FIELDS_CONVERSION_ERROR_DATE:
+        return "Bad date";
+    case 0:
+        return "";
+    default:
+        break;
+    }
+
+    return "Unknown error";
+}
+
+/*
+ * Positions
+ * =========
+ */
+
+static void
+fields_position_init(struct fields_position *self)
+{
+    self->row = 1;
+    self->column = 0;
+}
+
+static inline void
+fields_position_advance(struct fields_position *self)
+{
+    self->column++;
+}
+
+static inline void
+fields_position_return(struct fields_position *self)
+{
+    self->row++;
+    self->column = 0;
+}
+
+/*
+ * Contexts
+ * ========
+ */
+
+struct fields_context
+{
+    struct fields_position  position;
+    char                    last;
+};
+
+static void
+fields_context_init(struct fields_context *self)
+{
+    fields_position_init(&self->position);
+
+    self->last = '\0';
+}
+
+static inline void
+fields_context_update(struct fields_context *self, char byte)
+{
+    if (fields_continuation(byte))
+        return;
+
+    switch (byte) {
+    case FIELDS_CR:
+        fields_position_return(&self->position);
+        break;
+
+    case FIELDS_LF:
+        if (self->last != FIELDS_CR)
+            fields_position_return(&self->position);
+        break;
+
+    default:
+        fields_position_advance(&self->position);
+    }
+
+    self->last = byte;
+}
+
+static void
+fields_context_scan(struct fields_context *self, const char *p, size_t n)
+{
+    size_t i = 0;
+
+#ifdef FIELDS_VECTOR_SIZE
+    fields_vector cr = fields_vector_set(FIELDS_CR);
+    fields_vector lf = fields_vector_set(FIELDS_LF);
+
+    /*
+     * A run of ASCII characters containing no CR or LF only advances the
+     * column.
+     */
+    while (n - i >= FIELDS_VECTOR_SIZE) {
+        fields_vector v = fields_vector_load(p + i);
+        size_t j;
+
+        if ((fields_vector_eq(v, cr) | fields_vector_eq(v, lf) |
+            fields_vector_high(v)) == 0) {
+            self->position.column += FIELDS_VECTOR_SIZE;
+            self->last = p[i + FIELDS_VECTOR_SIZE - 1];
+            i += FIELDS_VECTOR_SIZE;
+            continue;
+        }
+
+        for (j = 0; j < FIELDS_VECTOR_SIZE; j++)
+            fields_context_update(self, p[i++]);
+    }
+#endif
+
+    while (i != n)
+        fields_context_update(self, p[i++]);
+}
+
+static void
+fields_context_position(const struct fields_context *self,
+    struct fields_position *position)
+{
+    *position = self->position;
+}
+
+/*
+ * Classes
+ * =======
+ */
+
+/*
+ * The quoted parser looks up the class of each input byte from a table of
+ * 256 entries. Any byte not listed here is of class `FIELDS_CLASS_OTHER`.
+ */
+enum fields_class {
+    FIELDS_CLASS_OTHER,
+    FIELDS_CLASS_SPACE,
+    FIELDS_CLASS_CRLF,
+    FIELDS_CLASS_DELIMITER,
+    FIELDS_CLASS_QUOTE
+};
+
+#define FIELDS_CLASSES(delimiter, quote)                        \
+    {                                                           \
+        [FIELDS_HT]                 = FIELDS_CLASS_SPACE,       \
+        [FIELDS_SP]                 = FIELDS_CLASS_SPACE,       \
+        [FIELDS_CR]                 = FIELDS_CLASS_CRLF,        \
+        [FIELDS_LF]                 = FIELDS_CLASS_CRLF,        \
+        [(unsigned char)delimiter]  = FIELDS_CLASS_DELIMITER,   \
+        [(unsigned char)quote]      = FIELDS_CLASS_QUOTE        \
+    }
+
+static const unsigned char fields_csv_classes[256] = FIELDS_CLASSES(',', '"');
+
+static const unsigned char fields_ssv_classes[256] = FIELDS_CLASSES(';', '"');
+
+static void
+fields_classes_init(unsigned char *classes, char delimiter, char quote)
+{
+    memset(classes, FIELDS_CLASS_OTHER, 256);
+
+    classes[FIELDS_HT] = FIELDS_CLASS_SPACE;
+    classes[FIELDS_SP] = FIELDS_CLASS_SPACE;
+    classes[FIELDS_CR] = FIELDS_CLASS_CRLF;
+    classes[FIELDS_LF] = FIELDS_CLASS_CRLF;
+
+    /*
+     * The delimiter takes precedence over whitespace and the quote character
+     * over the delimiter, just like in the parser.
+     */
+    classes[(unsigned char)delimiter] = FIELDS_CLASS_DELIMITER;
+
+    if (quote != '\0')
+        classes[(unsigned char)quote] = FIELDS_CLASS_QUOTE;
+}
+
+/*
+ * Formats
+ * =======
+ */
+
+const struct fields_format fields_csv =
+{
+    .delimiter  = ',',
+    .quote      = '"'
+};
+
+const struct fields_format fields_tsv =
+{
+    .delimiter  = '\t',
+    .quote      = '\0'
+};
+
+int
+fields_format_error(const struct fields_format *format)
+{
+    if (format->delimiter == FIELDS_CR)
+        return FIELDS_FORMAT_ERROR_DELIMITER;
+
+    if (format->delimiter == FIELDS_LF)
+        return FIELDS_FORMAT_ERROR_DELIMITER;
+
+    if (format->quote == FIELDS_CR)
+        return FIELDS_FORMAT_ERROR_QUOTE;
+
+    if (format->quote == FIELDS_LF)
+        return FIELDS_FORMAT_ERROR_QUOTE;
+
+    if (format->quote == format->delimiter)
+        return FIELDS_FORMAT_ERROR_QUOTE;
+
+    return 0;
+}
+
+const char *
+fields_format_strerror(int error)
+{
+    switch (error) {
+    case FIELDS_FORMAT_ERROR_DELIMITER:
+        return "Bad field delimiter";
+    case FIELDS_FORMAT_ERROR_QUOTE:
+        return "Bad quote character";
+    case 0:
+        return "";
+    default:
+        break;
+    }
+
+    return "Unknown error";
+}
+
+static fields_parse_fn *
+fields_format_parser(const struct fields_format *format)
+{
+    /*
+     * Common formats have parsers of their own, specialized for their
+     * delimiter and quote characters.
+     */
+    if (format->quote == '\0') {
+        switch (format->delimiter) {
+        case '\t':
+            return &fields_parse_tsv;
+        case '|':
+            return &fields_parse_psv;
+        default:
+            return &fields_parse_unquoted;
+        }
+    }
+
+    if (format->quote == '"') {
+        switch (format->delimiter) {
+        case ',':
+            return &fields_parse_csv;
+        case ';':
+            return &fields_parse_ssv;
+        default:
+            break;
+        }
+    }
+
+    return &fields_parse_quoted;
+}
+
+/*
+ * Readers
+ * =======
+ */
+
+enum fields_state {
+    FIELDS_STATE_MAYBE_INSIDE_FIELD,
+    FIELDS_STATE_INSIDE_FIELD,
+    FIELDS_STATE_INSIDE_QUOTED_FIELD,
+    FIELDS_STATE_MAYBE_BEYOND_QUOTED_FIELD,
+    FIELDS_STATE_BEYOND_QUOTED_FIELD
+};
+
+/*
+ * A parser that runs out of input in the middle of a record leaves the
+ * record as it is and saves its state, so that it can resume where it left
+ * off once there is more input.
+ */
+struct fields_suspension
+{
+    bool                active;
+    enum fields_state   state;
+    size_t              offset;
+    size_t              index;
+    bool                quoted;
+};
+
+struct fields_reader
+{
+    void *                  source;
+    fields_source_read_fn * source_read;
+    fields_source_free_fn * source_free;
+    fields_source_seek_fn * source_seek;
+    char                    delimiter;
+    char                    quote;
+    fields_parse_fn *       parse;
+    const char *            buffer;
+    size_t                  buffer_size;
+    uint64_t                offset;
+    const char *            cursor;
+    char                    skip;
+    int                     error;
+    const char *            mark;
+    bool                    rescan;
+    struct fields_context   context;
+    unsigned char           classes[256];
+    bool *                  projection;
+    size_t                  projection_size;
+    bool                    starved;
+    struct fields_suspension suspension;
+    struct fields_settings  settings;
+    struct fields_record *  record;
+    size_t                  scanned;
+
+    const struct fields_allocator * allocator;
+};
+
+struct fields_reader *
+fields_read_buffer(const char *buffer, size_t buffer_size,
+    const struct fields_format *format, const struct fields_settings *settings)
+{
+    struct fields_reader *reader;
+    struct fields_buffer *source;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    source = fields_buffer_alloc(buffer, buffer_size,
+        fields_allocator(settings));
+    if (source == NULL)
+        return NULL;
+
+    reader = fields_reader_alloc(source, &fields_buffer_read,
+        &fields_buffer_free, format, settings);
+    if (reader == NULL) {
+        fields_buffer_free(source);
+        return NULL;
+    }
+
+    fields_reader_set_source_seek(reader, &fields_buffer_seek);
+
+    return reader;
+}
+
+struct fields_reader *
+fields_read_file(FILE *file, const struct fields_format *format,
+    const struct fields_settings *settings)
+{
+    struct fields_reader *reader;
+    struct fields_file *source;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    source = fields_file_alloc(file, settings->source_buffer_size,
+        fields_allocator(settings));
+    if (source == NULL)
+        return NULL;
+
+    reader = fields_reader_alloc(source, &fields_file_read, &fields_file_free,
+        format, settings);
+    if (reader == NULL) {
+        fields_file_free(source);
+        return NULL;
+    }
+
+    fields_reader_set_source_seek(reader, &fields_file_seek);
+
+    return reader;
+}
+
+static int
+fields_reader_project(struct fields_reader *self,
+    const struct fields_settings *settings)
+{
+    size_t size;
+    size_t i;
+
+    /*
+     * `projection` tells for each field up to the last one to read whether
+     * the field is to be read.
+     */
+    size = settings->projection_size > 0 ?
+        settings->projection[settings->projection_size - 1] + 1 : 0;
+
+    self->projection = fields_calloc(self->allocator, size > 0 ? size : 1,
+        sizeof(bool));
+    if (self->projection == NULL)
+        return FIELDS_FAILURE;
+
+    for (i = 0; i < settings->projection_size; i++)
+        self->projection[settings->projection[i]] = true;
+
+    self->projection_size = size;
+    self->parse = &fields_parse_projected;
+
+    return 0;
+}
+
+struct fields_reader *
+fields_reader_alloc(void *source, fields_source_read_fn *read_fn,
+    fields_source_free_fn *free_fn, const struct fields_format *format,
+    const struct fields_settings *settings)
+{
+    const struct fields_allocator *allocator;
+    struct fields_reader *self;
+
+    if (fields_format_error(format) != 0)
+        return NULL;
+
+    if (fields_settings_error(settings) != 0)
+        return NULL;
+
+    allocator = fields_allocator(settings);
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->allocator = allocator;
+    self->source = source;
+    self->source_read = read_fn;
+    self->source_free = free_fn;
+    self->source_seek = NULL;
+    self->delimiter = format->delimiter;
+    self->quote = format->quote;
+    self->parse = fields_format_parser(format);
+    self->buffer = NULL;
+    self->buffer_size = 0;
+    self->offset = 0;
+    self->cursor = NULL;
+    self->skip = '\0';
+    self->error = 0;
+    self->mark = NULL;
+    self->rescan = false;
+
+    fields_context_init(&self->context);
+
+    fields_classes_init(self->classes, self->delimiter, self->quote);
+
+    self->projection = NULL;
+    self->projection_size = 0;
+    self->starved = false;
+    self->suspension.active = false;
+    self->settings = *settings;
+    self->record = NULL;
+    self->scanned = 0;
+
+    if (settings->projection != NULL &&
+        fields_reader_project(self, settings) != 0) {
+        fields_free(allocator, self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+fields_reader_set_source_seek(struct fields_reader *self,
+    fields_source_seek_fn *seek_fn)
+{
+    self->source_seek = seek_fn;
+}
+
+void
+fields_reader_free(struct fields_reader *self)
+{
+    const struct fields_allocator *allocator = self->allocator;
+    fields_source_free_fn *source_free = self->source_free;
+    void *source = self->source;
+
+    if (self->record != NULL)
+        fields_record_free(self->record);
+
+    fields_free(allocator, self->projection);
+    fields_free(allocator, self);
+
+    source_free(source);
+}
+
+static const char *
+fields_reader_end(const struct fields_reader *self)
+{
+    return self->buffer + self->buffer_size;
+}
+
+static int
+fields_reader_fill(struct fields_reader *self)
+{
+    const char *buffer;
+    size_t buffer_size;
+    int result;
+
+    /*
+     * The context holds the position at the mark. Before the buffer goes
+     * away, move the mark to its end.
+     */
+    fields_context_scan(&self->context, self->mark,
+        fields_reader_end(self) - self->mark);
+
+    self->cursor = fields_reader_end(self);
+    self->mark = self->cursor;
+
+    /*
+     * A parser source that has no input yet starves the reader instead.
+     * The buffer stays in place until the next attempt.
+     */
+    result = self->source_read(self->source, &buffer, &buffer_size);
+    if (self->starved)
+        return FIELDS_SUSPEND;
+
+    self->offset += self->buffer_size;
+    self->buffer = buffer;
+    self->buffer_size = buffer_size;
+    self->cursor = self->buffer;
+    self->mark = self->buffer;
+
+    if (result != 0) {
+        self->error = FIELDS_READER_ERROR_UNREADABLE_SOURCE;
+        return FIELDS_FAILURE;
+    }
+
+    return 0;
+}
+
+static void
+fields_reader_return(struct fields_reader *self, const char *separator)
+{
+    /*
+     * Move the mark past the record separator ending the current record. If
+     * the record contains no CR or LF before the separator, only the last
+     * byte before the separator is needed to update the context.
+     */
+    if (self->rescan) {
+        fields_context_scan(&self->context, self->mark,
+            separator - self->mark);
+        self->rescan = false;
+    }
+    else if (separator != self->mark)
+        self->context.last = separator[-1];
+
+    fields_context_update(&self->context, *separator);
+
+    self->mark = separator + 1;
+}
+
+static void
+fields_reader_skip(struct fields_reader *self)
+{
+    if (self->skip == '\0')
+        return;
+
+    if (self->cursor == fields_reader_end(self))
         return;
 
-    self->cursor++;
-    self->skip = '\0';
+    if (self->skip == *self->cursor)
+        self->cursor++;
+
+    self->skip = '\0';
+}
+
+static struct fields_record *
+fields_reader_record(struct fields_reader *self)
+{
+    /*
+     * The reader reads into a record of its own to scan, index and seek.
+     */
+    if (self->record == NULL)
+        self->record = fields_record_alloc(&self->settings);
+
+    return self->record;
+}
+
+static int
+fields_reader_parse(struct fields_reader *self, struct fields_record *record)
+{
+    if (record->shrink_buffer_size != 0 || record->shrink_max_fields != 0)
+        fields_record_shrink(record);
+
+    fields_record_init(record);
+
+    if (!record->views || self->projection != NULL ||
+        fields_parse_view(self, record) != 0) {
+        if (self->parse(self, record) != 0)
+            return FIELDS_FAILURE;
+    }
+
+    fields_record_observe(record);
+
+    return 0;
+}
+
+int
+fields_reader_read(struct fields_reader *self, struct fields_record *record)
+{
+    /*
+     * A suspended parser resumes the record it was reading.
+     */
+    if (self->suspension.active) {
+        if (self->parse(self, record) != 0)
+            return FIELDS_FAILURE;
+
+        fields_record_observe(record);
+
+        return 0;
+    }
+
+    if (fields_parse_start(self, record) != 0)
+        return FIELDS_FAILURE;
+
+    return fields_reader_parse(self, record);
+}
+
+int
+fields_reader_read_batch(struct fields_reader *self,
+    struct fields_batch *batch, size_t max_records)
+{
+    fields_parse_fn *parse = self->parse;
+    struct fields_record *record;
+
+    fields_batch_clear(batch);
+
+    record = fields_batch_arena(batch);
+    if (record == NULL)
+        return FIELDS_FAILURE;
+
+    /*
+     * Parse the records one after another into the arena, which starts each
+     * record where the previous one ends. The dispatch is resolved once per
+     * batch rather than once per record.
+     */
+    while (batch->num_records < max_records) {
+        if (fields_parse_start(self, record) != 0)
+            break;
+
+        record->start = batch->length;
+        record->first = batch->num_fields;
+
+        if (!record->expand && fields_record_reserve(record) != 0) {
+            self->error = FIELDS_READER_ERROR_TOO_BIG_RECORD;
+            break;
+        }
+
+        fields_record_init(record);
+
+        if (parse(self, record) != 0)
+            break;
+
+        if (fields_batch_append(batch, record) != 0) {
+            self->error = FIELDS_READER_ERROR_TOO_BIG_RECORD;
+            break;
+        }
+    }
+
+    /*
+     * The arena may have expanded the buffer.
+     */
+    batch->buffer = record->buffer;
+    batch->buffer_size = record->buffer_size;
+
+    return batch->num_records > 0 ? 0 : FIELDS_FAILURE;
+}
+
+/*
+ * Scan the next record into the callbacks, using the record of the reader
+ * for records that cannot be scanned straight from the source buffer.
+ */
+static int
+fields_reader_scan_record(struct fields_reader *self,
+    struct fields_record *record, const struct fields_callbacks *callbacks,
+    void *context)
+{
+    size_t i;
+
+    if (!self->suspension.active) {
+        if (fields_parse_start(self, record) != 0)
+            return FIELDS_FAILURE;
+
+        /*
+         * Most records are passed to the callbacks straight from the source
+         * buffer. The others are read into the record first. The fields
+         * passed to the callbacks already are skipped.
+         */
+        self->scanned = 0;
+
+        if (self->projection == NULL &&
+            fields_parse_scan(self, callbacks, context) == 0)
+            return 0;
+
+        if (record->shrink_buffer_size != 0 || record->shrink_max_fields != 0)
+            fields_record_shrink(record);
+
+        fields_record_init(record);
+    }
+
+    if (self->parse(self, record) != 0)
+        return FIELDS_FAILURE;
+
+    fields_record_observe(record);
+
+    for (i = self->scanned; i < record->num_fields; i++) {
+        size_t offset = fields_record_offset(record, i);
+
+        if (callbacks->on_field != NULL)
+            callbacks->on_field(context, record->base + offset,
+                fields_record_offset(record, i + 1) - offset - 1, i);
+    }
+
+    if (callbacks->on_record_end != NULL)
+        callbacks->on_record_end(context);
+
+    return 0;
+}
+
+int
+fields_reader_read_columns(struct fields_reader *self,
+    struct fields_columns *columns, size_t max_rows)
+{
+    static const struct fields_callbacks callbacks = {
+        fields_columns_on_field,
+        fields_columns_on_record_end
+    };
+    struct fields_record *record;
+
+    fields_columns_clear(columns);
+
+    record = fields_reader_record(self);
+    if (record == NULL)
+        return FIELDS_FAILURE;
+
+    /*
+     * Scan the records so that the values of most fields are copied straight
+     * from the source buffer into the columns.
+     */
+    while (columns->num_rows < max_rows) {
+        if (fields_columns_reserve_row(columns) != 0) {
+            self->error = FIELDS_READER_ERROR_TOO_BIG_RECORD;
+            break;
+        }
+
+        columns->row_fields = 0;
+        columns->row_error = 0;
+
+        if (fields_reader_scan_record(self, record, &callbacks, columns) != 0)
+            break;
+
+        if (columns->row_error != 0) {
+            self->error = columns->row_error;
+            break;
+        }
+    }
+
+    fields_columns_rollback(columns);
+
+    return columns->num_rows > 0 ? 0 : FIELDS_FAILURE;
+}
+
+int
+fields_reader_scan(struct fields_reader *self,
+    const struct fields_callbacks *callbacks, void *context)
+{
+    struct fields_record *record;
+
+    record = fields_reader_record(self);
+    if (record == NULL)
+        return FIELDS_FAILURE;
+
+    while (true) {
+        if (fields_reader_scan_record(self, record, callbacks, context) != 0)
+            return self->error != 0 ? FIELDS_FAILURE : 0;
+    }
+}
+
+static int
+fields_reader_reposition(struct fields_reader *self, uint64_t offset,
+    unsigned long row, bool cr)
+{
+    if (self->source_seek(self->source, offset) != 0) {
+        self->error = FIELDS_READER_ERROR_UNREADABLE_SOURCE;
+        return FIELDS_FAILURE;
+    }
+
+    /*
+     * Continue as if the input began at the offset, in the specified row.
+     * If the previous record ended with a CR, a line feed at the offset
+     * still belongs to its record separator.
+     */
+    self->buffer = NULL;
+    self->buffer_size = 0;
+    self->offset = offset;
+    self->cursor = NULL;
+    self->skip = cr ? FIELDS_LF : '\0';
+    self->error = 0;
+    self->mark = NULL;
+    self->rescan = false;
+    self->starved = false;
+    self->suspension.active = false;
+
+    fields_context_init(&self->context);
+
+    self->context.position.row = row;
+    self->context.last = cr ? FIELDS_CR : '\0';
+
+    return 0;
+}
+
+void
+fields_reader_position(const struct fields_reader *self,
+    struct fields_position *position)
+{
+    struct fields_context context;
+
+    /*
+     * The context holds the position at the mark. Calculate the current
+     * position by scanning the bytes between the mark and the cursor.
+     */
+    context = self->context;
+
+    fields_context_scan(&context, self->mark, self->cursor - self->mark);
+
+    fields_context_position(&context, position);
+}
+
+int
+fields_reader_error(const struct fields_reader *self)
+{
+    return self->error;
+}
+
+const char *
+fields_reader_strerror(int error)
+{
+    switch (error) {
+    case FIELDS_READER_ERROR_TOO_BIG_RECORD:
+        return "Too big record";
+    case FIELDS_READER_ERROR_TOO_MANY_FIELDS:
+        return "Too many fields";
+    case FIELDS_READER_ERROR_UNEXPECTED_CHARACTER:
+        return "Unexpected character";
+    case FIELDS_READER_ERROR_UNREADABLE_SOURCE:
+        return "Unreadable source";
+    case 0:
+        return "";
+    default:
+        break;
+    }
+
+    return "Unknown error";
+}
+
+/*
+ * Indexes
+ * =======
+ */
+
+#define FIELDS_INDEX_MAGIC "FIELDSIX"
+#define FIELDS_INDEX_VERSION 1
+
+/*
+ * An index entry tells where a record starts: the offset from the start of
+ * the input and the row of the position there.
+ */
+struct fields_index_entry
+{
+    uint64_t                offset;
+    uint64_t                row;
+};
+
+struct fields_index
+{
+    char                        delimiter;
+    char                        quote;
+    size_t                      interval;
+    size_t                      num_records;
+    struct fields_index_entry * entries;
+    size_t                      num_entries;
+    size_t                      max_entries;
+
+    const struct fields_allocator * allocator;
+};
+
+static struct fields_index *
+fields_index_alloc(char delimiter, char quote, size_t interval,
+    size_t max_entries, const struct fields_settings *settings)
+{
+    const struct fields_allocator *allocator;
+    struct fields_index *self;
+    struct fields_index_entry *entries;
+
+    allocator = fields_allocator(settings);
+
+    entries = fields_calloc(allocator, max_entries, sizeof(*entries));
+    if (entries == NULL)
+        return NULL;
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL) {
+        fields_free(allocator, entries);
+        return NULL;
+    }
+
+    self->delimiter = delimiter;
+    self->quote = quote;
+    self->interval = interval;
+    self->num_records = 0;
+    self->entries = entries;
+    self->num_entries = 0;
+    self->max_entries = max_entries;
+    self->allocator = allocator;
+
+    return self;
+}
+
+void
+fields_index_free(struct fields_index *self)
+{
+    const struct fields_allocator *allocator = self->allocator;
+    struct fields_index_entry *entries = self->entries;
+
+    fields_free(allocator, self);
+    fields_free(allocator, entries);
+}
+
+static int
+fields_index_mark(struct fields_index *self, const struct fields_reader *reader)
+{
+    struct fields_index_entry *entry;
+    struct fields_position position;
+
+    if (self->num_entries == self->max_entries) {
+        entry = fields_array_expand(self->allocator, self->entries,
+            &self->max_entries, self->num_entries + 1, sizeof(*entry));
+        if (entry == NULL)
+            return FIELDS_FAILURE;
+
+        self->entries = entry;
+    }
+
+    fields_reader_position(reader, &position);
+
+    entry = &self->entries[self->num_entries++];
+
+    entry->offset = reader->offset + (reader->cursor - reader->buffer);
+    entry->row = position.row;
+
+    return 0;
+}
+
+struct fields_index *
+fields_index_build(struct fields_reader *reader, size_t interval,
+    const struct fields_settings *settings)
+{
+    struct fields_index *self;
+    struct fields_record *record;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    if (interval == 0 || reader->suspension.active || reader->starved)
+        return NULL;
+
+    record = fields_reader_record(reader);
+    if (record == NULL)
+        return NULL;
+
+    self = fields_index_alloc(reader->delimiter, reader->quote, interval, 1,
+        settings);
+    if (self == NULL)
+        return NULL;
+
+    /*
+     * Mark the start of every record whose number is a multiple of the
+     * interval, as well as the end of the input if its number would be
+     * such, so that there is an entry for every record number up to and
+     * including the number of records.
+     */
+    while (fields_parse_start(reader, record) == 0) {
+        if (self->num_records % interval == 0 &&
+            fields_index_mark(self, reader) != 0) {
+            fields_index_free(self);
+            return NULL;
+        }
+
+        if (fields_reader_parse(reader, record) != 0)
+            break;
+
+        self->num_records++;
+    }
+
+    /*
+     * A reader that runs out of input before its end leaves the index
+     * incomplete.
+     */
+    if (reader->error != 0 || reader->starved ||
+        (self->num_records % interval == 0 &&
+        fields_index_mark(self, reader) != 0)) {
+        fields_index_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+size_t
+fields_index_records(const struct fields_index *self)
+{
+    return self->num_records;
+}
+
+static int
+fields_index_put(FILE *file, uint64_t value)
+{
+    unsigned char bytes[8];
+
+    fields_store_uint64(bytes, value);
+
+    return fwrite(bytes, sizeof(bytes), 1, file) == 1 ? 0 : FIELDS_FAILURE;
+}
+
+static int
+fields_index_get(FILE *file, uint64_t *value)
+{
+    unsigned char bytes[8];
+
+    if (fread(bytes, sizeof(bytes), 1, file) != 1)
+        return FIELDS_FAILURE;
+
+    *value = fields_load_uint64(bytes);
+
+    return 0;
+}
+
+int
+fields_index_save(const struct fields_index *self, FILE *file,
+    const struct fields_stamp *stamp)
+{
+    size_t i;
+
+    /*
+     * The index is stored as a magic string followed by serialized integers.
+     */
+    if (fwrite(FIELDS_INDEX_MAGIC, 8, 1, file) != 1)
+        return FIELDS_FAILURE;
+
+    if (fields_index_put(file, FIELDS_INDEX_VERSION) != 0 ||
+        fields_index_put(file, stamp->size) != 0 ||
+        fields_index_put(file, stamp->mtime) != 0 ||
+        fields_index_put(file, (unsigned char)self->delimiter) != 0 ||
+        fields_index_put(file, (unsigned char)self->quote) != 0 ||
+        fields_index_put(file, self->interval) != 0 ||
+        fields_index_put(file, self->num_records) != 0 ||
+        fields_index_put(file, self->num_entries) != 0)
+        return FIELDS_FAILURE;
+
+    for (i = 0; i < self->num_entries; i++) {
+        if (fields_index_put(file, self->entries[i].offset) != 0 ||
+            fields_index_put(file, self->entries[i].row) != 0)
+            return FIELDS_FAILURE;
+    }
+
+    return fflush(file) == 0 ? 0 : FIELDS_FAILURE;
+}
+
+struct fields_index *
+fields_index_load(FILE *file, const struct fields_stamp *stamp,
+    const struct fields_format *format, const struct fields_settings *settings)
+{
+    struct fields_index *self;
+    char magic[8];
+    uint64_t version, size, mtime, delimiter, quote;
+    uint64_t interval, num_records, num_entries;
+    size_t i;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        memcmp(magic, FIELDS_INDEX_MAGIC, sizeof(magic)) != 0)
+        return NULL;
+
+    if (fields_index_get(file, &version) != 0 ||
+        fields_index_get(file, &size) != 0 ||
+        fields_index_get(file, &mtime) != 0 ||
+        fields_index_get(file, &delimiter) != 0 ||
+        fields_index_get(file, &quote) != 0 ||
+        fields_index_get(file, &interval) != 0 ||
+        fields_index_get(file, &num_records) != 0 ||
+        fields_index_get(file, &num_entries) != 0)
+        return NULL;
+
+    /*
+     * An index is stale if the input has changed since it was saved.
+     */
+    if (version != FIELDS_INDEX_VERSION || size != stamp->size ||
+        mtime != stamp->mtime)
+        return NULL;
+
+    if (delimiter != (unsigned char)format->delimiter ||
+        quote != (unsigned char)format->quote)
+        return NULL;
+
+    if (interval == 0 || num_records >= SIZE_MAX ||
+        num_entries != num_records / interval + 1)
+        return NULL;
+
+    self = fields_index_alloc(format->delimiter, format->quote, interval,
+        num_entries, settings);
+    if (self == NULL)
+        return NULL;
+
+    self->num_records = num_records;
+
+    for (i = 0; i < num_entries; i++) {
+        if (fields_index_get(file, &self->entries[i].offset) != 0 ||
+            fields_index_get(file, &self->entries[i].row) != 0) {
+            fields_index_free(self);
+            return NULL;
+        }
+    }
+
+    self->num_entries = num_entries;
+
+    return self;
+}
+
+int
+fields_reader_seek(struct fields_reader *self, const struct fields_index *index,
+    size_t record_number)
+{
+    const struct fields_index_entry *entry;
+    struct fields_record *record;
+    size_t i;
+
+    if (self->source_seek == NULL || record_number > index->num_records)
+        return FIELDS_FAILURE;
+
+    if (self->delimiter != index->delimiter || self->quote != index->quote)
+        return FIELDS_FAILURE;
+
+    record = fields_reader_record(self);
+    if (record == NULL)
+        return FIELDS_FAILURE;
+
+    /*
+     * Start over from the nearest record in the index and read up to the
+     * record.
+     */
+    entry = &index->entries[record_number / index->interval];
+
+    if (fields_reader_reposition(self, entry->offset, entry->row, false) != 0)
+        return FIELDS_FAILURE;
+
+    for (i = record_number - record_number % index->interval;
+        i < record_number; i++) {
+        if (fields_reader_read(self, record) != 0)
+            return FIELDS_FAILURE;
+    }
+
+    return 0;
+}
+
+/*
+ * Checkpoints
+ * ===========
+ */
+
+int
+fields_reader_checkpoint(const struct fields_reader *self,
+    struct fields_checkpoint *checkpoint)
+{
+    struct fields_position position;
+
+    /*
+     * Between records, the cursor is at the start of the next record unless
+     * a line feed ending the previous one is still to be skipped.
+     */
+    if (self->error != 0 || self->suspension.active)
+        return FIELDS_FAILURE;
+
+    fields_reader_position(self, &position);
+
+    checkpoint->offset = self->offset + (self->cursor - self->buffer);
+    checkpoint->row = position.row;
+    checkpoint->cr = self->skip != '\0';
+
+    return 0;
+}
+
+int
+fields_reader_restore(struct fields_reader *self,
+    const struct fields_checkpoint *checkpoint)
+{
+    if (self->source_seek == NULL)
+        return FIELDS_FAILURE;
+
+    return fields_reader_reposition(self, checkpoint->offset,
+        checkpoint->row, checkpoint->cr != 0);
+}
+
+void
+fields_checkpoint_encode(const struct fields_checkpoint *self,
+    unsigned char *bytes)
+{
+    fields_store_uint64(bytes, self->offset);
+    fields_store_uint64(bytes + 8, self->row);
+    fields_store_uint64(bytes + 16, self->cr != 0);
+}
+
+int
+fields_checkpoint_decode(struct fields_checkpoint *self,
+    const unsigned char *bytes)
+{
+    uint64_t cr;
+
+    cr = fields_load_uint64(bytes + 16);
+    if (cr > 1)
+        return FIELDS_FAILURE;
+
+    self->offset = fields_load_uint64(bytes);
+    self->row = fields_load_uint64(bytes + 8);
+    self->cr = (int)cr;
+
+    return 0;
+}
+
+/*
+ * Push Parsers
+ * ============
+ */
+
+struct fields_parser
+{
+    struct fields_reader *          reader;
+    const char *                    buffer;
+    size_t                          buffer_size;
+    bool                            fed;
+    bool                            ended;
+    const struct fields_allocator * allocator;
+};
+
+static int
+fields_parser_source_read(void *source, const char **buffer,
+    size_t *buffer_size)
+{
+    struct fields_parser *self = source;
+
+    /*
+     * Hand out each chunk once. Without a chunk, starve the reader until
+     * the next one is fed, or report the end of input.
+     */
+    if (!self->fed && !self->ended) {
+        self->reader->starved = true;
+        return 0;
+    }
+
+    *buffer = self->buffer;
+    *buffer_size = self->buffer_size;
+
+    self->buffer = NULL;
+    self->buffer_size = 0;
+    self->fed = false;
+
+    return 0;
+}
+
+static void
+fields_parser_source_free(void *source)
+{
+    struct fields_parser *self = source;
+
+    fields_free(self->allocator, self);
+}
+
+struct fields_parser *
+fields_parser_alloc(const struct fields_format *format,
+    const struct fields_settings *settings)
+{
+    const struct fields_allocator *allocator;
+    struct fields_parser *self;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    allocator = fields_allocator(settings);
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->buffer = NULL;
+    self->buffer_size = 0;
+    self->fed = false;
+    self->ended = false;
+    self->allocator = allocator;
+
+    self->reader = fields_reader_alloc(self, &fields_parser_source_read,
+        &fields_parser_source_free, format, settings);
+    if (self->reader == NULL) {
+        fields_free(allocator, self);
+        return NULL;
+    }
+
+    self->reader->starved = true;
+
+    return self;
+}
+
+void
+fields_parser_free(struct fields_parser *self)
+{
+    fields_reader_free(self->reader);
+}
+
+int
+fields_parser_feed(struct fields_parser *self, const char *buffer,
+    size_t buffer_size)
+{
+    if (!self->reader->starved || self->ended)
+        return FIELDS_FAILURE;
+
+    if (buffer_size == 0)
+        self->ended = true;
+    else {
+        self->buffer = buffer;
+        self->buffer_size = buffer_size;
+        self->fed = true;
+    }
+
+    self->reader->starved = false;
+
+    return 0;
 }
 
 int
-fields_reader_read(struct fields_reader *self, struct fields_record *record)
+fields_parser_read(struct fields_parser *self, struct fields_record *record)
 {
-    if (fields_parse_start(self, record) != 0)
+    if (self->reader->starved)
         return FIELDS_FAILURE;
 
-    fields_record_init(record);
+    return fields_reader_read(self->reader, record);
+}
+
+int
+fields_parser_scan(struct fields_parser *self,
+    const struct fields_callbacks *callbacks, void *context)
+{
+    if (self->reader->starved)
+        return 0;
+
+    return fields_reader_scan(self->reader, callbacks, context);
+}
 
-    return self->parse(self, record);
+int
+fields_parser_starved(const struct fields_parser *self)
+{
+    return self->reader->starved;
 }
 
 void
-fields_reader_position(const struct fields_reader *self,
+fields_parser_position(const struct fields_parser *self,
     struct fields_position *position)
 {
-    fields_context_position(&self->context, position);
+    fields_reader_position(self->reader, position);
 }
 
 int
-fields_reader_error(const struct fields_reader *self)
+fields_parser_error(const struct fields_parser *self)
+{
+    return fields_reader_error(self->reader);
+}
+
+/*
+ * Writers
+ * =======
+ */
+
+struct fields_writer
+{
+    void *                  sink;
+    fields_sink_write_fn *  sink_write;
+    fields_sink_free_fn *   sink_free;
+    char                    delimiter;
+    char                    quote;
+    char *                  buffer;
+    size_t                  buffer_size;
+    size_t                  length;
+    size_t                  complete;
+    size_t                  num_fields;
+    bool                    empty;
+    int                     error;
+
+    const struct fields_allocator * allocator;
+};
+
+struct fields_writer *
+fields_write_buffer(char *buffer, size_t buffer_size, size_t *length,
+    const struct fields_format *format, const struct fields_settings *settings)
+{
+    struct fields_writer *writer;
+    struct fields_buffer_sink *sink;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    sink = fields_buffer_sink_alloc(buffer, buffer_size, length,
+        fields_allocator(settings));
+    if (sink == NULL)
+        return NULL;
+
+    writer = fields_writer_alloc(sink, &fields_buffer_sink_write,
+        &fields_buffer_sink_free, format, settings);
+    if (writer == NULL) {
+        fields_buffer_sink_free(sink);
+        return NULL;
+    }
+
+    return writer;
+}
+
+struct fields_writer *
+fields_write_file(FILE *file, const struct fields_format *format,
+    const struct fields_settings *settings)
+{
+    struct fields_writer *writer;
+    struct fields_file_sink *sink;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    sink = fields_file_sink_alloc(file, fields_allocator(settings));
+    if (sink == NULL)
+        return NULL;
+
+    writer = fields_writer_alloc(sink, &fields_file_sink_write,
+        &fields_file_sink_free, format, settings);
+    if (writer == NULL) {
+        fields_file_sink_free(sink);
+        return NULL;
+    }
+
+    return writer;
+}
+
+struct fields_writer *
+fields_writer_alloc(void *sink, fields_sink_write_fn *write_fn,
+    fields_sink_free_fn *free_fn, const struct fields_format *format,
+    const struct fields_settings *settings)
+{
+    const struct fields_allocator *allocator;
+    struct fields_writer *self;
+    size_t buffer_size;
+
+    if (fields_format_error(format) != 0)
+        return NULL;
+
+    if (fields_settings_error(settings) != 0)
+        return NULL;
+
+    allocator = fields_allocator(settings);
+
+    /*
+     * Settings filled in before writers had a buffer size of their own
+     * leave it zero.
+     */
+    buffer_size = settings->sink_buffer_size;
+    if (buffer_size == 0)
+        buffer_size = FIELDS_DEFAULT_SINK_BUFFER_SIZE;
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->buffer = fields_alloc(allocator, buffer_size);
+    if (self->buffer == NULL) {
+        fields_free(allocator, self);
+        return NULL;
+    }
+
+    self->allocator = allocator;
+    self->sink = sink;
+    self->sink_write = write_fn;
+    self->sink_free = free_fn;
+    self->delimiter = format->delimiter;
+    self->quote = format->quote;
+    self->buffer_size = buffer_size;
+    self->length = 0;
+    self->complete = 0;
+    self->num_fields = 0;
+    self->empty = true;
+    self->error = 0;
+
+    return self;
+}
+
+void
+fields_writer_free(struct fields_writer *self)
+{
+    const struct fields_allocator *allocator = self->allocator;
+    fields_sink_free_fn *sink_free = self->sink_free;
+    void *sink = self->sink;
+
+    fields_free(allocator, self->buffer);
+    fields_free(allocator, self);
+
+    sink_free(sink);
+}
+
+static int
+fields_writer_drain(struct fields_writer *self)
+{
+    if (self->length > 0 &&
+        self->sink_write(self->sink, self->buffer, self->length) != 0) {
+        self->error = FIELDS_WRITER_ERROR_UNWRITABLE_SINK;
+        return FIELDS_FAILURE;
+    }
+
+    self->length = 0;
+    self->complete = 0;
+
+    return 0;
+}
+
+static int
+fields_writer_put(struct fields_writer *self, const char *p, size_t n)
+{
+    size_t space = self->buffer_size - self->length;
+
+    if (n <= space) {
+        if (n > 0)
+            memcpy(self->buffer + self->length, p, n);
+
+        self->length += n;
+
+        return 0;
+    }
+
+    /*
+     * Fill and drain the sink buffer. Pass what does not fit in an empty
+     * sink buffer to the sink directly rather than copying it in pieces.
+     */
+    memcpy(self->buffer + self->length, p, space);
+    self->length += space;
+
+    if (fields_writer_drain(self) != 0)
+        return FIELDS_FAILURE;
+
+    p += space;
+    n -= space;
+
+    if (n >= self->buffer_size) {
+        if (self->sink_write(self->sink, p, n) != 0) {
+            self->error = FIELDS_WRITER_ERROR_UNWRITABLE_SINK;
+            return FIELDS_FAILURE;
+        }
+
+        return 0;
+    }
+
+    memcpy(self->buffer, p, n);
+    self->length = n;
+
+    return 0;
+}
+
+static inline int
+fields_writer_putc(struct fields_writer *self, char ch)
+{
+    if (self->length == self->buffer_size && fields_writer_drain(self) != 0)
+        return FIELDS_FAILURE;
+
+    self->buffer[self->length++] = ch;
+
+    return 0;
+}
+
+static int
+fields_writer_quote(struct fields_writer *self, const char *value,
+    size_t length, size_t offset)
+{
+    const char *end = value + length;
+    const char *p = value;
+    const char *q;
+
+    /*
+     * The first `offset` bytes contain no quote characters. Write the value
+     * in chunks that end at a quote character, doubling each of them.
+     */
+    if (fields_writer_putc(self, self->quote) != 0)
+        return FIELDS_FAILURE;
+
+    while ((q = memchr(value + offset, self->quote, end - value - offset))) {
+        if (fields_writer_put(self, p, q + 1 - p) != 0)
+            return FIELDS_FAILURE;
+
+        if (fields_writer_putc(self, self->quote) != 0)
+            return FIELDS_FAILURE;
+
+        p = q + 1;
+        offset = p - value;
+    }
+
+    if (fields_writer_put(self, p, end - p) != 0)
+        return FIELDS_FAILURE;
+
+    return fields_writer_putc(self, self->quote);
+}
+
+static FIELDS_INLINE int
+fields_writer_field(struct fields_writer *self, const char *value,
+    size_t length)
+{
+    size_t offset;
+
+    /*
+     * Without quoting, look for the delimiter in place of the quote
+     * character.
+     */
+    offset = fields_find(value, length, self->delimiter,
+        self->quote != '\0' ? self->quote : self->delimiter);
+
+    /*
+     * Drop what remains of the current record in the sink buffer, so that
+     * a flush still passes the complete records to the sink.
+     */
+    if (offset != length && self->quote == '\0') {
+        self->length = self->complete;
+        self->error = FIELDS_WRITER_ERROR_UNQUOTABLE_FIELD;
+        return FIELDS_FAILURE;
+    }
+
+    if (self->num_fields++ > 0 &&
+        fields_writer_putc(self, self->delimiter) != 0)
+        return FIELDS_FAILURE;
+
+    if (offset == length) {
+        if (length > 0)
+            self->empty = false;
+
+        return fields_writer_put(self, value, length);
+    }
+
+    self->empty = false;
+
+    return fields_writer_quote(self, value, length, offset);
+}
+
+int
+fields_writer_write_field(struct fields_writer *self,
+    const struct fields_field *field)
+{
+    if (self->error != 0)
+        return FIELDS_FAILURE;
+
+    return fields_writer_field(self, field->value, field->length);
+}
+
+int
+fields_writer_end_record(struct fields_writer *self)
+{
+    if (self->error != 0)
+        return FIELDS_FAILURE;
+
+    /*
+     * An empty line is read as a record with no fields. Quote a single empty
+     * field to tell it apart, if possible.
+     */
+    if (self->num_fields == 1 && self->empty && self->quote != '\0') {
+        if (fields_writer_putc(self, self->quote) != 0)
+            return FIELDS_FAILURE;
+
+        if (fields_writer_putc(self, self->quote) != 0)
+            return FIELDS_FAILURE;
+    }
+
+    self->num_fields = 0;
+    self->empty = true;
+
+    if (fields_writer_putc(self, FIELDS_LF) != 0)
+        return FIELDS_FAILURE;
+
+    self->complete = self->length;
+
+    return 0;
+}
+
+static size_t
+fields_writer_plain(struct fields_writer *self,
+    const struct fields_record *record, size_t first)
+{
+    size_t start, size, lead, i, k;
+    const char *p;
+    char *wp;
+
+    /*
+     * The fields of a record lie next to each other, each followed by one
+     * byte. Copy the fields from `first` on at once, with NUL between them,
+     * and scan them for a byte that requires quoting. Keep the fields that
+     * precede it, with delimiters between them, and return the index of
+     * the first field that does not. A NUL delimiter is left to the caller.
+     */
+    if (first == record->num_fields || self->delimiter == '\0')
+        return first;
+
+    start = fields_record_offset(record, first);
+    size = fields_record_offset(record, record->num_fields) - start - 1;
+    lead = self->num_fields > 0 ? 1 : 0;
+
+    if (size + lead > self->buffer_size - self->length) {
+        if (size + lead > self->buffer_size)
+            return first;
+
+        if (fields_writer_drain(self) != 0)
+            return first;
+    }
+
+    wp = self->buffer + self->length + lead;
+
+    memcpy(wp, record->base + start, size);
+
+    for (i = first + 1; i < record->num_fields; i++)
+        wp[fields_record_offset(record, i) - start - 1] = '\0';
+
+    p = wp + fields_find(wp, size, self->delimiter,
+        self->quote != '\0' ? self->quote : FIELDS_CR);
+
+    k = first;
+    while (k < record->num_fields &&
+        wp + fields_record_offset(record, k + 1) - start - 1 <= p)
+        k++;
+
+    if (k == first)
+        return first;
+
+    for (i = first + 1; i < k; i++)
+        wp[fields_record_offset(record, i) - start - 1] = self->delimiter;
+
+    if (lead > 0)
+        wp[-1] = self->delimiter;
+
+    size = fields_record_offset(record, k) - start - 1;
+
+    if (size > k - first - 1)
+        self->empty = false;
+
+    self->length += lead + size;
+    self->num_fields += k - first;
+
+    return k;
+}
+
+int
+fields_writer_write_record(struct fields_writer *self,
+    const struct fields_record *record)
+{
+    size_t i = 0;
+
+    if (self->error != 0)
+        return FIELDS_FAILURE;
+
+    /*
+     * Write runs of fields that need no quoting at once and the others one
+     * by one.
+     */
+    while ((i = fields_writer_plain(self, record, i)) < record->num_fields) {
+        size_t offset = fields_record_offset(record, i);
+        size_t next = fields_record_offset(record, i + 1);
+
+        if (self->error != 0)
+            return FIELDS_FAILURE;
+
+        if (fields_writer_field(self, record->base + offset,
+            next - offset - 1) != 0)
+            return FIELDS_FAILURE;
+
+        i++;
+    }
+
+    return fields_writer_end_record(self);
+}
+
+int
+fields_writer_flush(struct fields_writer *self)
+{
+    /*
+     * After an unquotable field, the sink buffer holds complete records
+     * only. They are passed to the sink, but the error remains.
+     */
+    if (self->error == FIELDS_WRITER_ERROR_UNQUOTABLE_FIELD) {
+        fields_writer_drain(self);
+        return FIELDS_FAILURE;
+    }
+
+    if (self->error != 0)
+        return FIELDS_FAILURE;
+
+    return fields_writer_drain(self);
+}
+
+int
+fields_writer_error(const struct fields_writer *self)
 {
     return self->error;
 }
 
 const char *
-fields_reader_strerror(int error)
-{
-    switch (error) {
-    case FIELDS_READER_ERROR_TOO_BIG_RECORD:
-        return "Too big record";
-    case FIELDS_READER_ERROR_TOO_MANY_FIELDS:
-        return "Too many fields";
-    case FIELDS_READER_ERROR_UNEXPECTED_CHARACTER:
-        return "Unexpected character";
-    case FIELDS_READER_ERROR_UNREADABLE_SOURCE:
-        return "Unreadable source";
+fields_writer_strerror(int error)
+{
+    switch (error) {
+    case FIELDS_WRITER_ERROR_UNQUOTABLE_FIELD:
+        return "Unquotable field";
+    case FIELDS_WRITER_ERROR_UNWRITABLE_SINK:
+        return "Unwritable sink";
     case 0:
         return "";
     default:
@@ -723,7 +4709,13 @@ const struct fields_settings fields_defaults =
     .expand             = true,
     .source_buffer_size = FIELDS_DEFAULT_SOURCE_BUFFER_SIZE,
     .record_buffer_size = FIELDS_DEFAULT_RECORD_BUFFER_SIZE,
-    .record_max_fields  = FIELDS_DEFAULT_RECORD_MAX_FIELDS
+    .record_max_fields  = FIELDS_DEFAULT_RECORD_MAX_FIELDS,
+    .views              = false,
+    .projection         = NULL,
+    .projection_size    = 0,
+    .allocator          = NULL,
+    .record_shrink_interval = FIELDS_DEFAULT_RECORD_SHRINK_INTERVAL,
+    .sink_buffer_size   = FIELDS_DEFAULT_SINK_BUFFER_SIZE
 };
 
 int
@@ -738,6 +4730,19 @@ fields_settings_error(const struct fields_settings *settings)
     if (settings->record_max_fields < FIELDS_MINIMUM_RECORD_MAX_FIELDS)
         return FIELDS_SETTINGS_ERROR_RECORD_MAX_FIELDS;
 
+    if (settings->sink_buffer_size != 0 &&
+        settings->sink_buffer_size < FIELDS_MINIMUM_SINK_BUFFER_SIZE)
+        return FIELDS_SETTINGS_ERROR_SINK_BUFFER_SIZE;
+
+    if (settings->projection != NULL) {
+        size_t i;
+
+        for (i = 1; i < settings->projection_size; i++) {
+            if (settings->projection[i] <= settings->projection[i - 1])
+                return FIELDS_SETTINGS_ERROR_PROJECTION;
+        }
+    }
+
     return 0;
 }
 
@@ -751,6 +4756,10 @@ fields_settings_strerror(int error)
         return "Too low record buffer size";
     case FIELDS_SETTINGS_ERROR_RECORD_MAX_FIELDS:
         return "Too low maximum for fields in record";
+    case FIELDS_SETTINGS_ERROR_PROJECTION:
+        return "Bad projection";
+    case FIELDS_SETTINGS_ERROR_SINK_BUFFER_SIZE:
+        return "Too low sink buffer size";
     case 0:
         return "";
     default:
@@ -760,261 +4769,816 @@ fields_settings_strerror(int error)
     return "Unknown error";
 }
 
-/*
- * Parsers
- * =======
- */
+/*
+ * Parsers
+ * =======
+ */
+
+static int
+fields_parse_fail(struct fields_reader *reader, struct fields_record *record,
+    const char *rp, enum fields_reader_error error)
+{
+    reader->cursor = rp;
+    reader->error = error;
+
+    fields_record_init(record);
+
+    return FIELDS_FAILURE;
+}
+
+static int
+fields_parse_suspend(struct fields_reader *reader, struct fields_record *record,
+    enum fields_state state, char *wp, size_t index, bool quoted)
+{
+    reader->suspension.active = true;
+    reader->suspension.state = state;
+    reader->suspension.offset = wp - record->buffer;
+    reader->suspension.index = index;
+    reader->suspension.quoted = quoted;
+
+    return FIELDS_FAILURE;
+}
+
+static char *
+fields_parse_resume(struct fields_reader *reader, struct fields_record *record)
+{
+    /*
+     * Continue the record in the record buffer where the parser left off.
+     * The cursor is at the end of the previous source buffer.
+     */
+    reader->suspension.active = false;
+
+    return record->buffer + reader->suspension.offset;
+}
+
+static void
+fields_parse_consume(struct fields_reader *reader, const char *rp)
+{
+    reader->cursor = rp;
+
+    if (reader->mark != rp) {
+        fields_context_scan(&reader->context, reader->mark, rp - reader->mark);
+        reader->mark = rp;
+        reader->rescan = false;
+    }
+}
+
+static int
+fields_parse_finish(struct fields_reader *reader, struct fields_record *record,
+    const char *rp, char *wp)
+{
+    fields_parse_consume(reader, rp);
+
+    fields_record_finish(record, wp);
+
+    return 0;
+}
+
+static int
+fields_parse_crlf(struct fields_reader *reader, struct fields_record *record,
+    const char *rp, char *wp)
+{
+    if (*rp == FIELDS_CR)
+        reader->skip = FIELDS_LF;
+
+    fields_reader_return(reader, rp);
+
+    *wp++ = '\0';
+    rp++;
+
+    return fields_parse_finish(reader, record, rp, wp);
+}
+
+static FIELDS_INLINE int
+fields_parse_unquoted_generic(struct fields_reader *reader,
+    struct fields_record *record, char delimiter)
+{
+    const char *rp;
+    const char *rq;
+
+    char *wp;
+    const char *wq;
+
+    rp = reader->cursor;
+    rq = fields_reader_end(reader);
+
+    if (reader->suspension.active)
+        wp = fields_parse_resume(reader, record);
+    else {
+        wp = record->buffer + record->start;
+        fields_record_push(record, wp);
+    }
+
+    wq = fields_record_end(record);
+
+    while (true) {
+        while ((rp != rq) && (wp != wq)) {
+            size_t n;
+
+            /*
+             * Copy the run of bytes preceding the next delimiter, CR or LF
+             * in one go.
+             */
+            n = (size_t)(rq - rp) < (size_t)(wq - wp) ? rq - rp : wq - wp;
+            n = fields_scan(wp, rp, n, delimiter);
+
+            rp += n;
+            wp += n;
+
+            if ((rp == rq) || (wp == wq))
+                break;
+
+            if (*rp == delimiter) {
+                *wp++ = '\0';
+                rp++;
+                if (fields_record_push(record, wp) != 0)
+                    return fields_parse_fail(reader, record, rp,
+                        FIELDS_READER_ERROR_TOO_MANY_FIELDS);
+            }
+            else
+                return fields_parse_crlf(reader, record, rp, wp);
+        }
+
+        if (wp == wq) {
+            wp = fields_record_expand(record, wp);
+            if (wp == NULL)
+                return fields_parse_fail(reader, record, rp,
+                    FIELDS_READER_ERROR_TOO_BIG_RECORD);
+
+            wq = fields_record_end(record);
+        }
+
+        if (rp == rq) {
+            int result = fields_reader_fill(reader);
+
+            if (result == FIELDS_SUSPEND)
+                return fields_parse_suspend(reader, record,
+                    FIELDS_STATE_INSIDE_FIELD, wp, 0, false);
+
+            if (result != 0)
+                return fields_parse_fail(reader, record, reader->cursor,
+                    FIELDS_READER_ERROR_UNREADABLE_SOURCE);
+
+            rp = reader->cursor;
+            rq = fields_reader_end(reader);
+        }
+
+        if (rp == rq) {
+            *wp++ = '\0';
+            return fields_parse_finish(reader, record, rp, wp);
+        }
+    }
+
+    return fields_parse_fail(reader, record, rp,
+        FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+}
+
+static int
+fields_parse_unquoted(struct fields_reader *reader, struct fields_record *record)
+{
+    return fields_parse_unquoted_generic(reader, record, reader->delimiter);
+}
+
+static int
+fields_parse_tsv(struct fields_reader *reader, struct fields_record *record)
+{
+    return fields_parse_unquoted_generic(reader, record, '\t');
+}
+
+static int
+fields_parse_psv(struct fields_reader *reader, struct fields_record *record)
+{
+    return fields_parse_unquoted_generic(reader, record, '|');
+}
+
+static FIELDS_INLINE int
+fields_parse_quoted_generic(struct fields_reader *reader,
+    struct fields_record *record, char delimiter, char quote,
+    const unsigned char *classes)
+{
+    enum fields_state state;
+
+    const char *rp;
+    const char *rq;
+
+    char *wp;
+    const char *wq;
+
+#ifdef FIELDS_BLOCK_SIZE
+    struct fields_block block = { 0, 0, 0, 0 };
+    const char *base;
+    const char *limit;
+    uint64_t events;
+#endif
+
+    rp = reader->cursor;
+    rq = fields_reader_end(reader);
+
+    if (reader->suspension.active) {
+        state = reader->suspension.state;
+        wp = fields_parse_resume(reader, record);
+    }
+    else {
+        state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
+        wp = record->buffer + record->start;
+        fields_record_push(record, wp);
+    }
+
+    wq = fields_record_end(record);
+
+#ifdef FIELDS_BLOCK_SIZE
+    base = rp;
+    limit = rp;
+    events = 0;
+#else
+    /* Only the block scanner needs the delimiter and quote characters. */
+    (void)delimiter;
+    (void)quote;
+#endif
+
+    while (true) {
+        while ((rp != rq) && (wp != wq)) {
+#ifdef FIELDS_BLOCK_SIZE
+            /*
+             * Classify the next 64 bytes if there is room for copying them
+             * in whole. Only the quote characters and the field delimiters
+             * and record separators outside quoted regions are processed one
+             * byte at a time. The bytes between them are copied or skipped
+             * in runs.
+             */
+            if ((rp >= limit) &&
+                (rq - rp >= 2 * FIELDS_BLOCK_SIZE) &&
+                (wq - wp >= 2 * FIELDS_BLOCK_SIZE)) {
+                uint64_t inside;
+
+                fields_block_classify(&block, rp, delimiter, quote);
+
+                inside = fields_prefix_xor(block.quotes);
+                if (state == FIELDS_STATE_INSIDE_QUOTED_FIELD)
+                    inside = ~inside;
+
+                base = rp;
+                limit = rp + FIELDS_BLOCK_SIZE;
+                events = block.quotes |
+                    ((block.delimiters | block.crlfs) & ~inside);
+            }
+
+            if (rp < limit) {
+                unsigned from = rp - base;
+                unsigned to = events != 0 ? __builtin_ctzll(events) :
+                    FIELDS_BLOCK_SIZE;
+                uint64_t run = fields_bits(from, to);
+                uint64_t bad;
+                size_t n = to - from;
+
+                switch (state) {
+                case FIELDS_STATE_MAYBE_INSIDE_FIELD:
+                    if ((run & ~block.spaces) != 0)
+                        state = FIELDS_STATE_INSIDE_FIELD;
+                    memcpy(wp, rp, FIELDS_BLOCK_SIZE);
+                    wp += n;
+                    break;
+                case FIELDS_STATE_INSIDE_FIELD:
+                    memcpy(wp, rp, FIELDS_BLOCK_SIZE);
+                    wp += n;
+                    break;
+                case FIELDS_STATE_INSIDE_QUOTED_FIELD:
+                    if ((run & block.crlfs) != 0)
+                        reader->rescan = true;
+                    memcpy(wp, rp, FIELDS_BLOCK_SIZE);
+                    wp += n;
+                    break;
+                case FIELDS_STATE_MAYBE_BEYOND_QUOTED_FIELD:
+                case FIELDS_STATE_BEYOND_QUOTED_FIELD:
+                    bad = run & ~block.spaces;
+                    if (bad != 0) {
+                        n = __builtin_ctzll(bad) - from;
+                        return fields_parse_fail(reader, record,
+                            rp + n + 1,
+                            FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+                    }
+                    if (n != 0)
+                        state = FIELDS_STATE_BEYOND_QUOTED_FIELD;
+                    break;
+                default:
+                    break;
+                }
+
+                rp += n;
+
+                if (to == FIELDS_BLOCK_SIZE)
+                    continue;
+
+                events &= events - 1;
+            }
+#endif
+
+            switch (state) {
+            case FIELDS_STATE_MAYBE_INSIDE_FIELD:
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_QUOTE:
+                    rp++;
+                    wp = fields_record_pop(record);
+                    if (fields_record_push(record, wp) != 0)
+                        return fields_parse_fail(reader, record, rp,
+                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
+                    state = FIELDS_STATE_INSIDE_QUOTED_FIELD;
+                    break;
+                case FIELDS_CLASS_DELIMITER:
+                    *wp++ = '\0';
+                    rp++;
+                    if (fields_record_push(record, wp) != 0)
+                        return fields_parse_fail(reader, record, rp,
+                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    return fields_parse_crlf(reader, record, rp, wp);
+                case FIELDS_CLASS_SPACE:
+                    *wp++ = *rp++;
+                    break;
+                default:
+                    *wp++ = *rp++;
+                    state = FIELDS_STATE_INSIDE_FIELD;
+                    break;
+                }
+                break;
+            case FIELDS_STATE_INSIDE_FIELD:
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_QUOTE:
+                    return fields_parse_fail(reader, record, rp + 1,
+                        FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+                case FIELDS_CLASS_DELIMITER:
+                    *wp++ = '\0';
+                    rp++;
+                    if (fields_record_push(record, wp) != 0)
+                        return fields_parse_fail(reader, record, rp,
+                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
+                    state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    return fields_parse_crlf(reader, record, rp, wp);
+                default:
+                    *wp++ = *rp++;
+                    break;
+                }
+                break;
+            case FIELDS_STATE_INSIDE_QUOTED_FIELD:
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_QUOTE:
+                    rp++;
+                    state = FIELDS_STATE_MAYBE_BEYOND_QUOTED_FIELD;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    reader->rescan = true;
+                    *wp++ = *rp++;
+                    break;
+                default:
+                    *wp++ = *rp++;
+                    break;
+                }
+                break;
+            case FIELDS_STATE_MAYBE_BEYOND_QUOTED_FIELD:
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_QUOTE:
+                    *wp++ = *rp++;
+                    state = FIELDS_STATE_INSIDE_QUOTED_FIELD;
+                    break;
+                case FIELDS_CLASS_DELIMITER:
+                    *wp++ = '\0';
+                    rp++;
+                    if (fields_record_push(record, wp) != 0)
+                        return fields_parse_fail(reader, record, rp,
+                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
+                    state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    return fields_parse_crlf(reader, record, rp, wp);
+                case FIELDS_CLASS_SPACE:
+                    rp++;
+                    state = FIELDS_STATE_BEYOND_QUOTED_FIELD;
+                    break;
+                default:
+                    return fields_parse_fail(reader, record, rp + 1,
+                        FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+                }
+                break;
+            case FIELDS_STATE_BEYOND_QUOTED_FIELD:
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_DELIMITER:
+                    *wp++ = '\0';
+                    rp++;
+                    if (fields_record_push(record, wp) != 0)
+                        return fields_parse_fail(reader, record, rp,
+                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
+                    state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    return fields_parse_crlf(reader, record, rp, wp);
+                case FIELDS_CLASS_SPACE:
+                    rp++;
+                    break;
+                default:
+                    return fields_parse_fail(reader, record, rp + 1,
+                        FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+                }
+                break;
+            default:
+                return fields_parse_fail(reader, record, rp,
+                    FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+            }
+        }
+
+        if (wp == wq) {
+            wp = fields_record_expand(record, wp);
+            if (wp == NULL)
+                return fields_parse_fail(reader, record, rp,
+                    FIELDS_READER_ERROR_TOO_BIG_RECORD);
+
+            wq = fields_record_end(record);
+        }
+
+        if (rp == rq) {
+            int result = fields_reader_fill(reader);
+
+            if (result == FIELDS_SUSPEND)
+                return fields_parse_suspend(reader, record, state, wp, 0,
+                    false);
+
+            if (result != 0)
+                return fields_parse_fail(reader, record, reader->cursor,
+                    FIELDS_READER_ERROR_UNREADABLE_SOURCE);
+
+            rp = reader->cursor;
+            rq = fields_reader_end(reader);
+
+#ifdef FIELDS_BLOCK_SIZE
+            base = rp;
+            limit = rp;
+#endif
+        }
+
+        if (rp == rq) {
+            *wp++ = '\0';
+            return fields_parse_finish(reader, record, rp, wp);
+        }
+    }
+
+    return fields_parse_fail(reader, record, rp,
+        FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+}
 
 static int
-fields_parse_fail(struct fields_reader *reader, struct fields_record *record,
-    enum fields_reader_error error)
+fields_parse_quoted(struct fields_reader *reader, struct fields_record *record)
 {
-    reader->error = error;
+    return fields_parse_quoted_generic(reader, record, reader->delimiter,
+        reader->quote, reader->classes);
+}
 
-    fields_record_init(record);
+static int
+fields_parse_csv(struct fields_reader *reader, struct fields_record *record)
+{
+    return fields_parse_quoted_generic(reader, record, ',', '"',
+        fields_csv_classes);
+}
 
-    return FIELDS_FAILURE;
+static int
+fields_parse_ssv(struct fields_reader *reader, struct fields_record *record)
+{
+    return fields_parse_quoted_generic(reader, record, ';', '"',
+        fields_ssv_classes);
 }
 
 static int
-fields_parse_finish(struct fields_reader *reader, struct fields_record *record,
-    const char *rp, char *wp)
+fields_parse_projected_finish(struct fields_reader *reader,
+    struct fields_record *record, const char *rp, char *wp, bool first)
 {
-    reader->cursor = rp;
+    fields_parse_consume(reader, rp);
 
-    fields_record_finish(record, wp);
+    /*
+     * A record containing one field of zero length becomes a record
+     * containing no fields only if that field is the first one in the input.
+     */
+    if (first)
+        fields_record_finish(record, wp);
+    else
+        fields_record_set(record, record->num_fields, wp);
 
     return 0;
 }
 
 static int
-fields_parse_crlf(struct fields_reader *reader, struct fields_record *record,
-    const char *rp, char *wp)
+fields_parse_projected_crlf(struct fields_reader *reader,
+    struct fields_record *record, const char *rp, char *wp, bool first)
 {
     if (*rp == FIELDS_CR)
         reader->skip = FIELDS_LF;
 
-    *wp++ = '\0';
+    fields_reader_return(reader, rp);
+
     rp++;
 
-    return fields_parse_finish(reader, record, rp, wp);
+    return fields_parse_projected_finish(reader, record, rp, wp, first);
 }
 
 static int
-fields_parse_unquoted(struct fields_reader *reader, struct fields_record *record)
+fields_parse_projected_rest(struct fields_reader *reader,
+    struct fields_record *record, const char *rp, char *wp, bool quoted)
 {
-    char delimiter;
-
-    const char *rp;
     const char *rq;
+    char quote;
+    int result;
 
-    char *wp;
-    const char *wq;
-
-    delimiter = reader->delimiter;
+    /*
+     * Skip to the end of the record, keeping track of quoted regions only.
+     * Without a quote character, look for CR and LF only.
+     */
+    quote = reader->quote != '\0' ? reader->quote : FIELDS_LF;
 
-    rp = reader->cursor;
     rq = fields_reader_end(reader);
 
-    wp = record->buffer;
-    wq = fields_record_end(record);
-
-    fields_record_push(record, wp);
-
     while (true) {
-        while ((rp != rq) && (wp != wq)) {
-            fields_context_update(&reader->context, *rp);
+        while (rp != rq) {
+            rp += fields_find(rp, rq - rp, quote, quote);
 
-            if (*rp == delimiter) {
-                *wp++ = '\0';
-                rp++;
-                if (fields_record_push(record, wp) != 0)
-                    return fields_parse_fail(reader, record,
-                        FIELDS_READER_ERROR_TOO_MANY_FIELDS);
-            }
-            else if (fields_crlf(*rp))
-                return fields_parse_crlf(reader, record, rp, wp);
+            if (rp == rq)
+                break;
+
+            if (!fields_crlf(*rp))
+                quoted = !quoted;
+            else if (quoted)
+                reader->rescan = true;
             else
-                *wp++ = *rp++;
+                return fields_parse_projected_crlf(reader, record, rp, wp,
+                    false);
+
+            rp++;
         }
 
-        if (wp == wq) {
-            wp = fields_record_expand(record, wp);
-            if (wp == NULL)
-                return fields_parse_fail(reader, record,
-                    FIELDS_READER_ERROR_TOO_BIG_RECORD);
+        result = fields_reader_fill(reader);
 
-            wq = fields_record_end(record);
-        }
+        if (result == FIELDS_SUSPEND)
+            return fields_parse_suspend(reader, record,
+                FIELDS_STATE_MAYBE_INSIDE_FIELD, wp, reader->projection_size,
+                quoted);
 
-        if (rp == rq) {
-            if (fields_reader_fill(reader) != 0)
-                return fields_parse_fail(reader, record,
-                    FIELDS_READER_ERROR_UNREADABLE_SOURCE);
+        if (result != 0)
+            return fields_parse_fail(reader, record, reader->cursor,
+                FIELDS_READER_ERROR_UNREADABLE_SOURCE);
 
-            rp = reader->cursor;
-            rq = fields_reader_end(reader);
-        }
+        rp = reader->cursor;
+        rq = fields_reader_end(reader);
 
-        if (rp == rq) {
-            *wp++ = '\0';
-            return fields_parse_finish(reader, record, rp, wp);
-        }
+        if (rp == rq)
+            return fields_parse_projected_finish(reader, record, rp, wp,
+                false);
     }
-
-    return fields_parse_fail(reader, record,
-        FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
 }
 
-enum fields_state {
-    FIELDS_STATE_MAYBE_INSIDE_FIELD,
-    FIELDS_STATE_INSIDE_FIELD,
-    FIELDS_STATE_INSIDE_QUOTED_FIELD,
-    FIELDS_STATE_MAYBE_BEYOND_QUOTED_FIELD,
-    FIELDS_STATE_BEYOND_QUOTED_FIELD
-};
-
 static int
-fields_parse_quoted(struct fields_reader *reader, struct fields_record *record)
+fields_parse_projected(struct fields_reader *reader,
+    struct fields_record *record)
 {
-    enum fields_state state;
-
+    const unsigned char *classes;
     char delimiter;
     char quote;
 
+    enum fields_state state;
+    size_t index;
+    bool copy;
+
     const char *rp;
     const char *rq;
 
     char *wp;
     const char *wq;
 
-    state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
-
+    /*
+     * This parser runs the state machine of the quoted parser, which also
+     * suits unquoted formats as their classes contain no quote character.
+     * Only the fields in the projection are copied. The other fields are
+     * run through the state machine without copying, up to the last field
+     * in the projection.
+     */
+    classes = reader->classes;
     delimiter = reader->delimiter;
-    quote = reader->quote;
+    quote = reader->quote != '\0' ? reader->quote : reader->delimiter;
 
     rp = reader->cursor;
     rq = fields_reader_end(reader);
 
-    wp = record->buffer;
-    wq = fields_record_end(record);
+    if (reader->suspension.active) {
+        state = reader->suspension.state;
+        index = reader->suspension.index;
+        wp = fields_parse_resume(reader, record);
+
+        if (index == reader->projection_size)
+            return fields_parse_projected_rest(reader, record, rp, wp,
+                reader->suspension.quoted);
+
+        copy = reader->projection[index];
+    }
+    else {
+        state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
+        index = 0;
+        wp = record->buffer + record->start;
+
+        if (reader->projection_size == 0)
+            return fields_parse_projected_rest(reader, record, rp, wp, false);
+
+        copy = reader->projection[0];
+        if (copy)
+            fields_record_push(record, wp);
+    }
 
-    fields_record_push(record, wp);
+    wq = fields_record_end(record);
 
     while (true) {
-        while ((rp != rq) && (wp != wq)) {
-            fields_context_update(&reader->context, *rp);
+        while ((rp != rq) && (wp != wq || !copy)) {
+            unsigned char separator = FIELDS_CLASS_OTHER;
+
+            /*
+             * Copy or skip the run of bytes preceding the next special
+             * character in one go.
+             */
+            if ((state == FIELDS_STATE_INSIDE_FIELD) ||
+                (state == FIELDS_STATE_INSIDE_QUOTED_FIELD)) {
+                size_t n = rq - rp;
+
+                if (copy && n > (size_t)(wq - wp))
+                    n = wq - wp;
+
+                if (state == FIELDS_STATE_INSIDE_FIELD)
+                    n = fields_find(rp, n, delimiter, quote);
+                else
+                    n = fields_find(rp, n, quote, quote);
+
+                if (copy) {
+                    memcpy(wp, rp, n);
+                    wp += n;
+                }
+
+                rp += n;
+
+                if ((rp == rq) || (copy && wp == wq))
+                    continue;
+            }
 
             switch (state) {
             case FIELDS_STATE_MAYBE_INSIDE_FIELD:
-                if (*rp == quote) {
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_QUOTE:
                     rp++;
-                    wp = fields_record_pop(record);
-                    if (fields_record_push(record, wp) != 0)
-                        return fields_parse_fail(reader, record,
-                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
+                    if (copy)
+                        wp = record->base + fields_record_offset(record,
+                            record->num_fields - 1);
                     state = FIELDS_STATE_INSIDE_QUOTED_FIELD;
-                }
-                else if (*rp == delimiter) {
-                    *wp++ = '\0';
+                    break;
+                case FIELDS_CLASS_DELIMITER:
+                    separator = FIELDS_CLASS_DELIMITER;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    separator = FIELDS_CLASS_CRLF;
+                    break;
+                case FIELDS_CLASS_SPACE:
+                    if (copy)
+                        *wp++ = *rp;
+                    rp++;
+                    break;
+                default:
+                    if (copy)
+                        *wp++ = *rp;
                     rp++;
-                    if (fields_record_push(record, wp) != 0)
-                        return fields_parse_fail(reader, record,
-                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
-                }
-                else if (fields_crlf(*rp))
-                    return fields_parse_crlf(reader, record, rp, wp);
-                else if (fields_whitespace(*rp))
-                    *wp++ = *rp++;
-                else {
-                    *wp++ = *rp++;
                     state = FIELDS_STATE_INSIDE_FIELD;
+                    break;
                 }
                 break;
             case FIELDS_STATE_INSIDE_FIELD:
-                if (*rp == quote)
-                    return fields_parse_fail(reader, record,
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_QUOTE:
+                    return fields_parse_fail(reader, record, rp + 1,
                         FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
-                else if (*rp == delimiter) {
-                    *wp++ = '\0';
+                case FIELDS_CLASS_DELIMITER:
+                    separator = FIELDS_CLASS_DELIMITER;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    separator = FIELDS_CLASS_CRLF;
+                    break;
+                default:
+                    if (copy)
+                        *wp++ = *rp;
                     rp++;
-                    if (fields_record_push(record, wp) != 0)
-                        return fields_parse_fail(reader, record,
-                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
-                    state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
+                    break;
                 }
-                else if (fields_crlf(*rp))
-                    return fields_parse_crlf(reader, record, rp, wp);
-                else
-                    *wp++ = *rp++;
                 break;
             case FIELDS_STATE_INSIDE_QUOTED_FIELD:
-                if (*rp == quote) {
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_QUOTE:
                     rp++;
                     state = FIELDS_STATE_MAYBE_BEYOND_QUOTED_FIELD;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    reader->rescan = true;
+                    if (copy)
+                        *wp++ = *rp;
+                    rp++;
+                    break;
+                default:
+                    if (copy)
+                        *wp++ = *rp;
+                    rp++;
+                    break;
                 }
-                else
-                    *wp++ = *rp++;
                 break;
             case FIELDS_STATE_MAYBE_BEYOND_QUOTED_FIELD:
-                if (*rp == quote) {
-                    *wp++ = *rp++;
-                    state = FIELDS_STATE_INSIDE_QUOTED_FIELD;
-                }
-                else if (*rp == delimiter) {
-                    *wp++ = '\0';
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_QUOTE:
+                    if (copy)
+                        *wp++ = *rp;
                     rp++;
-                    if (fields_record_push(record, wp) != 0)
-                        return fields_parse_fail(reader, record,
-                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
-                    state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
-                }
-                else if (fields_crlf(*rp))
-                    return fields_parse_crlf(reader, record, rp, wp);
-                else if (fields_whitespace(*rp)) {
+                    state = FIELDS_STATE_INSIDE_QUOTED_FIELD;
+                    break;
+                case FIELDS_CLASS_DELIMITER:
+                    separator = FIELDS_CLASS_DELIMITER;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    separator = FIELDS_CLASS_CRLF;
+                    break;
+                case FIELDS_CLASS_SPACE:
                     rp++;
                     state = FIELDS_STATE_BEYOND_QUOTED_FIELD;
-                }
-                else
-                    return fields_parse_fail(reader, record,
+                    break;
+                default:
+                    return fields_parse_fail(reader, record, rp + 1,
                         FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+                }
                 break;
             case FIELDS_STATE_BEYOND_QUOTED_FIELD:
-                if (*rp == delimiter) {
-                    *wp++ = '\0';
-                    rp++;
-                    if (fields_record_push(record, wp) != 0)
-                        return fields_parse_fail(reader, record,
-                            FIELDS_READER_ERROR_TOO_MANY_FIELDS);
-                    state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
-                }
-                else if (fields_crlf(*rp))
-                    return fields_parse_crlf(reader, record, rp, wp);
-                else if (fields_whitespace(*rp))
+                switch (classes[(unsigned char)*rp]) {
+                case FIELDS_CLASS_DELIMITER:
+                    separator = FIELDS_CLASS_DELIMITER;
+                    break;
+                case FIELDS_CLASS_CRLF:
+                    separator = FIELDS_CLASS_CRLF;
+                    break;
+                case FIELDS_CLASS_SPACE:
                     rp++;
-                else
-                    return fields_parse_fail(reader, record,
+                    break;
+                default:
+                    return fields_parse_fail(reader, record, rp + 1,
                         FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
+                }
                 break;
             default:
-                return fields_parse_fail(reader, record,
+                return fields_parse_fail(reader, record, rp,
                     FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
             }
 
+            if (separator == FIELDS_CLASS_CRLF) {
+                if (copy)
+                    *wp++ = '\0';
+
+                return fields_parse_projected_crlf(reader, record, rp, wp,
+                    index == 0);
+            }
+
+            if (separator == FIELDS_CLASS_DELIMITER) {
+                if (copy)
+                    *wp++ = '\0';
+
+                rp++;
+                index++;
+
+                if (index == reader->projection_size)
+                    return fields_parse_projected_rest(reader, record, rp,
+                        wp, false);
+
+                copy = reader->projection[index];
+                if (copy && fields_record_push(record, wp) != 0)
+                    return fields_parse_fail(reader, record, rp,
+                        FIELDS_READER_ERROR_TOO_MANY_FIELDS);
+
+                state = FIELDS_STATE_MAYBE_INSIDE_FIELD;
+            }
         }
 
-        if (wp == wq) {
+        if (copy && wp == wq) {
             wp = fields_record_expand(record, wp);
             if (wp == NULL)
-                return fields_parse_fail(reader, record,
+                return fields_parse_fail(reader, record, rp,
                     FIELDS_READER_ERROR_TOO_BIG_RECORD);
 
             wq = fields_record_end(record);
         }
 
         if (rp == rq) {
-            if (fields_reader_fill(reader) != 0)
-                return fields_parse_fail(reader, record,
+            int result = fields_reader_fill(reader);
+
+            if (result == FIELDS_SUSPEND)
+                return fields_parse_suspend(reader, record, state, wp, index,
+                    false);
+
+            if (result != 0)
+                return fields_parse_fail(reader, record, reader->cursor,
                     FIELDS_READER_ERROR_UNREADABLE_SOURCE);
 
             rp = reader->cursor;
@@ -1022,31 +5586,186 @@ fields_parse_quoted(struct fields_reader *reader, struct fields_record *record)
         }
 
         if (rp == rq) {
-            *wp++ = '\0';
-            return fields_parse_finish(reader, record, rp, wp);
+            if (copy)
+                *wp++ = '\0';
+
+            return fields_parse_projected_finish(reader, record, rp, wp,
+                index == 0);
         }
     }
 
-    return fields_parse_fail(reader, record,
+    return fields_parse_fail(reader, record, rp,
         FIELDS_READER_ERROR_UNEXPECTED_CHARACTER);
 }
 
+static int
+fields_parse_view(struct fields_reader *reader, struct fields_record *record)
+{
+    char delimiter;
+    char quote;
+
+    const char *rp;
+    const char *rq;
+
+    delimiter = reader->delimiter;
+    quote = reader->quote != '\0' ? reader->quote : reader->delimiter;
+
+    /*
+     * A view must end within the source buffer and must not be larger than
+     * the record buffer. Otherwise the record is copied, so that the limits
+     * and the error handling stay the same.
+     */
+    rp = reader->cursor;
+    rq = fields_reader_end(reader);
+
+    if ((size_t)(rq - rp) > record->buffer_size)
+        rq = rp + record->buffer_size;
+
+    record->base = (char *)rp;
+
+    fields_record_push(record, (char *)rp);
+
+    while (true) {
+        rp += fields_find(rp, rq - rp, delimiter, quote);
+
+        if (rp == rq)
+            break;
+
+        if (*rp == delimiter) {
+            rp++;
+            if (record->num_fields == record->max_fields)
+                break;
+            fields_record_push(record, (char *)rp);
+        }
+        else if (fields_crlf(*rp)) {
+            if (*rp == FIELDS_CR)
+                reader->skip = FIELDS_LF;
+
+            fields_reader_return(reader, rp);
+
+            rp++;
+
+            reader->cursor = rp;
+
+            fields_record_finish(record, (char *)rp);
+
+            return 0;
+        }
+        else
+            break;
+    }
+
+    fields_record_init(record);
+
+    return FIELDS_FAILURE;
+}
+
+static int
+fields_parse_scan(struct fields_reader *reader,
+    const struct fields_callbacks *callbacks, void *context)
+{
+    char delimiter;
+    char quote;
+
+    const char *rp;
+    const char *rq;
+    const char *start;
+    size_t index;
+
+    delimiter = reader->delimiter;
+    quote = reader->quote != '\0' ? reader->quote : reader->delimiter;
+
+    /*
+     * Pass each field to the callback as soon as its delimiter is found.
+     * Stop at a quote character, at the end of the source buffer or at the
+     * limits of a record that does not expand. The fields passed so far are
+     * then the same as those of the record read by the parser.
+     */
+    rp = reader->cursor;
+    rq = fields_reader_end(reader);
+
+    if (!reader->settings.expand &&
+        (size_t)(rq - rp) > reader->settings.record_buffer_size)
+        rq = rp + reader->settings.record_buffer_size;
+
+    start = rp;
+    index = 0;
+
+    while (true) {
+        rp += fields_find(rp, rq - rp, delimiter, quote);
+
+        if (rp == rq)
+            break;
+
+        if (*rp == delimiter) {
+            if (!reader->settings.expand &&
+                index + 1 == reader->settings.record_max_fields)
+                break;
+
+            if (callbacks->on_field != NULL)
+                callbacks->on_field(context, start, rp - start, index);
+
+            index++;
+            start = ++rp;
+        }
+        else if (fields_crlf(*rp)) {
+            /*
+             * A record containing one field of zero length contains no
+             * fields.
+             */
+            if ((index > 0 || rp != start) && callbacks->on_field != NULL)
+                callbacks->on_field(context, start, rp - start, index);
+
+            if (*rp == FIELDS_CR)
+                reader->skip = FIELDS_LF;
+
+            fields_reader_return(reader, rp);
+
+            reader->cursor = rp + 1;
+
+            if (callbacks->on_record_end != NULL)
+                callbacks->on_record_end(context);
+
+            return 0;
+        }
+        else
+            break;
+    }
+
+    reader->scanned = index;
+
+    return FIELDS_FAILURE;
+}
+
 static int
 fields_parse_start(struct fields_reader *reader, struct fields_record *record)
 {
     if (reader->error != 0)
-        return fields_parse_fail(reader, record, reader->error);
+        return fields_parse_fail(reader, record, reader->cursor,
+            reader->error);
 
-    if (reader->cursor == fields_reader_end(reader)) {
-        if (fields_reader_fill(reader) != 0)
-            return fields_parse_fail(reader, record,
-                FIELDS_READER_ERROR_UNREADABLE_SOURCE);
+    /*
+     * A line feed to be skipped may be the last character of the source
+     * buffer or the first one of the next source buffer.
+     */
+    while ((reader->cursor == fields_reader_end(reader)) ||
+        (reader->skip != '\0')) {
+        if (reader->cursor == fields_reader_end(reader)) {
+            int result = fields_reader_fill(reader);
 
-        if (reader->buffer_size == 0)
-            return FIELDS_FAILURE;
-    }
+            if (result == FIELDS_SUSPEND)
+                return FIELDS_FAILURE;
+
+            if (result != 0)
+                return fields_parse_fail(reader, record, reader->cursor,
+                    FIELDS_READER_ERROR_UNREADABLE_SOURCE);
+
+            if (reader->buffer_size == 0)
+                return FIELDS_FAILURE;
+        }
 
-    fields_reader_skip(reader);
+        fields_reader_skip(reader);
+    }
 
     return 0;
 }
@@ -20,39 +20,75 @@
  * THE SOFTWARE.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef FIELDS_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef FIELDS_ZSTD
+#include <zstd.h>
+#endif
+
 #include "fields.h"
 #include "fields_posix.h"
+#include "fields_private.h"
 
 #define FIELDS_FAILURE (-1)
 
+#define FIELDS_CR 13
+#define FIELDS_LF 10
+
+/*
+ * File Descriptor Sources
+ * =======================
+ */
+
 struct fields_fd {
-    int     fd;
-    char *  buffer;
-    size_t  buffer_size;
+    int                             fd;
+    off_t                           start;
+    char *                          buffer;
+    size_t                          buffer_size;
+    const struct fields_allocator * allocator;
 };
 
 static struct fields_fd *
-fields_fd_alloc(int fd, size_t buffer_size)
+fields_fd_alloc(int fd, size_t buffer_size,
+    const struct fields_allocator *allocator)
 {
     struct fields_fd *self;
     char *buffer;
 
-    buffer = malloc(buffer_size);
+    buffer = fields_alloc(allocator, buffer_size);
     if (buffer == NULL)
         return NULL;
 
-    self = malloc(sizeof(*self));
+    self = fields_alloc(allocator, sizeof(*self));
     if (self == NULL) {
-        free(buffer);
+        fields_free(allocator, buffer);
         return NULL;
     }
 
+    /*
+     * The file offset at which reading starts is -1 if the file descriptor
+     * cannot seek.
+     */
     self->fd = fd;
+    self->start = lseek(fd, 0, SEEK_CUR);
     self->buffer = buffer;
     self->buffer_size = buffer_size;
+    self->allocator = allocator;
 
     return self;
 }
@@ -73,13 +109,32 @@ fields_fd_read(void *source, const char **buffer, size_t *buffer_size)
     return 0;
 }
 
+static int
+fields_fd_seek(void *source, uint64_t offset)
+{
+    struct fields_fd *self = source;
+
+    if (self->start == -1)
+        return FIELDS_FAILURE;
+
+    if ((off_t)offset < 0 || (uint64_t)(off_t)offset != offset)
+        return FIELDS_FAILURE;
+
+    if (lseek(self->fd, self->start + (off_t)offset, SEEK_SET) == -1)
+        return FIELDS_FAILURE;
+
+    return 0;
+}
+
 static void
 fields_fd_free(void *source)
 {
     struct fields_fd *self = source;
+    const struct fields_allocator *allocator = self->allocator;
+    char *buffer = self->buffer;
 
-    free(self->buffer);
-    free(self);
+    fields_free(allocator, self);
+    fields_free(allocator, buffer);
 }
 
 struct fields_reader *
@@ -92,7 +147,8 @@ fields_read_fd(int fd, const struct fields_format *format,
     if (settings == NULL)
         settings = &fields_defaults;
 
-    source = fields_fd_alloc(fd, settings->source_buffer_size);
+    source = fields_fd_alloc(fd, settings->source_buffer_size,
+        fields_allocator(settings));
     if (source == NULL)
         return NULL;
 
@@ -103,5 +159,1461 @@ fields_read_fd(int fd, const struct fields_format *format,
         return NULL;
     }
 
+    fields_reader_set_source_seek(reader, &fields_fd_seek);
+
+    return reader;
+}
+
+/*
+ * Memory-Mapped File Sources
+ * ==========================
+ */
+
+struct fields_mmap {
+    void *                          address;
+    size_t                          length;
+    const char *                    origin;
+    size_t                          origin_size;
+    const char *                    buffer;
+    size_t                          buffer_size;
+    const struct fields_allocator * allocator;
+};
+
+static struct fields_mmap *
+fields_mmap_alloc(int fd, const struct fields_allocator *allocator)
+{
+    struct fields_mmap *self;
+    struct stat st;
+    off_t offset;
+    off_t start;
+    void *address;
+    size_t length;
+
+    if (fstat(fd, &st) != 0)
+        return NULL;
+
+    if (!S_ISREG(st.st_mode))
+        return NULL;
+
+    offset = lseek(fd, 0, SEEK_CUR);
+    if (offset == -1)
+        return NULL;
+
+    if (offset > st.st_size)
+        offset = st.st_size;
+
+    /*
+     * The mapping must start at a page boundary. Map the file from the page
+     * containing the current file offset to the end.
+     */
+    start = offset - offset % sysconf(_SC_PAGESIZE);
+
+    if ((uintmax_t)(st.st_size - start) > SIZE_MAX)
+        return NULL;
+
+    address = NULL;
+    length = st.st_size - start;
+
+    /*
+     * An empty mapping is not allowed. Nothing needs to be mapped if there
+     * is nothing to read.
+     */
+    if (offset != st.st_size) {
+        address = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, start);
+        if (address == MAP_FAILED)
+            return NULL;
+
+        posix_madvise(address, length, POSIX_MADV_SEQUENTIAL);
+    }
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL) {
+        if (address != NULL)
+            munmap(address, length);
+        return NULL;
+    }
+
+    self->allocator = allocator;
+    self->address = address;
+    self->length = length;
+    self->origin = address != NULL ? (char *)address + (offset - start) : NULL;
+    self->origin_size = st.st_size - offset;
+    self->buffer = self->origin;
+    self->buffer_size = self->origin_size;
+
+    return self;
+}
+
+static int
+fields_mmap_read(void *source, const char **buffer, size_t *buffer_size)
+{
+    struct fields_mmap *self = source;
+
+    *buffer = self->buffer;
+    *buffer_size = self->buffer_size;
+
+    self->buffer = NULL;
+    self->buffer_size = 0;
+
+    return 0;
+}
+
+static int
+fields_mmap_seek(void *source, uint64_t offset)
+{
+    struct fields_mmap *self = source;
+
+    if (offset > self->origin_size)
+        return FIELDS_FAILURE;
+
+    self->buffer = self->origin != NULL ? self->origin + offset : NULL;
+    self->buffer_size = self->origin_size - offset;
+
+    return 0;
+}
+
+static void
+fields_mmap_free(void *source)
+{
+    struct fields_mmap *self = source;
+
+    if (self->address != NULL)
+        munmap(self->address, self->length);
+
+    fields_free(self->allocator, self);
+}
+
+struct fields_reader *
+fields_read_mmap(int fd, const struct fields_format *format,
+    const struct fields_settings *settings)
+{
+    struct fields_reader *reader;
+    struct fields_mmap *source;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    source = fields_mmap_alloc(fd, fields_allocator(settings));
+    if (source == NULL)
+        return NULL;
+
+    reader = fields_reader_alloc(source, &fields_mmap_read, &fields_mmap_free,
+        format, settings);
+    if (reader == NULL) {
+        fields_mmap_free(source);
+        return NULL;
+    }
+
+    fields_reader_set_source_seek(reader, &fields_mmap_seek);
+
+    return reader;
+}
+
+/*
+ * Read-Ahead Sources
+ * ==================
+ */
+
+/*
+ * A read-ahead source reads the file descriptor in an I/O thread into a
+ * ring of buffers. The I/O thread is the only producer and the reading
+ * thread the only consumer. The counters of filled and consumed buffers are
+ * published with atomic operations, so that neither thread needs a lock
+ * unless the ring is full or empty and it has to wait.
+ *
+ * The I/O thread fills each buffer with a fill function, which either reads
+ * the file descriptor or decompresses its contents. The size of the data is
+ * zero at the end of the input.
+ */
+typedef int fields_ahead_fill_fn(void *, int, char *, size_t, size_t *);
+
+typedef void fields_ahead_free_fn(void *);
+
+struct fields_ahead_buffer {
+    char *  data;
+    size_t  size;
+    int     error;
+};
+
+struct fields_ahead {
+    int                             fd;
+    void *                          decoder;
+    fields_ahead_fill_fn *          fill;
+    fields_ahead_free_fn *          decoder_free;
+    struct fields_ahead_buffer *    buffers;
+    unsigned int                    num_buffers;
+    size_t                          buffer_size;
+    size_t                          filled;
+    size_t                          consumed;
+    bool                            holding;
+    bool                            producer_waiting;
+    bool                            consumer_waiting;
+    bool                            stop;
+    pthread_mutex_t                 mutex;
+    pthread_cond_t                  cond;
+    pthread_t                       thread;
+    const struct fields_allocator * allocator;
+};
+
+static size_t
+fields_ahead_load(const size_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+}
+
+static void
+fields_ahead_store(size_t *counter, size_t value)
+{
+    __atomic_store_n(counter, value, __ATOMIC_SEQ_CST);
+}
+
+static void
+fields_ahead_wait(struct fields_ahead *self, bool *waiting,
+    const size_t *counter, size_t value)
+{
+    /*
+     * Wait until the other thread changes the counter from `value`. The
+     * waiting flag is set before the counter is checked again, and the
+     * other thread checks the flag after updating the counter, so that
+     * either this thread sees the update or the other thread sees the flag
+     * and signals.
+     */
+    pthread_mutex_lock(&self->mutex);
+
+    __atomic_store_n(waiting, true, __ATOMIC_SEQ_CST);
+
+    while (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == value &&
+        !__atomic_load_n(&self->stop, __ATOMIC_SEQ_CST))
+        pthread_cond_wait(&self->cond, &self->mutex);
+
+    __atomic_store_n(waiting, false, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&self->mutex);
+}
+
+static void
+fields_ahead_signal(struct fields_ahead *self, const bool *waiting)
+{
+    if (!__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+        return;
+
+    pthread_mutex_lock(&self->mutex);
+    pthread_cond_broadcast(&self->cond);
+    pthread_mutex_unlock(&self->mutex);
+}
+
+static void *
+fields_ahead_work(void *arg)
+{
+    struct fields_ahead *self = arg;
+    size_t filled = 0;
+
+    while (!__atomic_load_n(&self->stop, __ATOMIC_SEQ_CST)) {
+        struct fields_ahead_buffer *buffer;
+        size_t consumed;
+        size_t size;
+        int result;
+
+        consumed = fields_ahead_load(&self->consumed);
+        if (filled - consumed == self->num_buffers) {
+            fields_ahead_wait(self, &self->producer_waiting, &self->consumed,
+                consumed);
+            continue;
+        }
+
+        buffer = &self->buffers[filled % self->num_buffers];
+
+        result = self->fill(self->decoder, self->fd, buffer->data,
+            self->buffer_size, &size);
+
+        buffer->size = result == 0 ? size : 0;
+        buffer->error = result != 0;
+
+        fields_ahead_store(&self->filled, ++filled);
+        fields_ahead_signal(self, &self->consumer_waiting);
+
+        /*
+         * The end of the input and errors are final.
+         */
+        if (buffer->size == 0)
+            break;
+    }
+
+    return NULL;
+}
+
+static void
+fields_ahead_destroy(struct fields_ahead *self)
+{
+    const struct fields_allocator *allocator = self->allocator;
+    unsigned int i;
+
+    if (self->buffers != NULL) {
+        for (i = self->num_buffers; i > 0; i--)
+            fields_free(allocator, self->buffers[i - 1].data);
+    }
+
+    pthread_cond_destroy(&self->cond);
+    pthread_mutex_destroy(&self->mutex);
+
+    fields_free(allocator, self->buffers);
+    fields_free(allocator, self);
+}
+
+static int
+fields_ahead_read_fd(void *decoder, int fd, char *data, size_t size,
+    size_t *length)
+{
+    ssize_t result;
+
+    (void)decoder;
+
+    result = read(fd, data, size);
+    if (result == -1)
+        return FIELDS_FAILURE;
+
+    *length = result;
+
+    return 0;
+}
+
+static struct fields_ahead *
+fields_ahead_alloc(int fd, void *decoder, fields_ahead_fill_fn *fill,
+    fields_ahead_free_fn *decoder_free, size_t buffer_size,
+    unsigned int num_buffers, const struct fields_allocator *allocator)
+{
+    struct fields_ahead *self;
+    unsigned int i;
+
+    self = fields_calloc(allocator, 1, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->fd = fd;
+    self->decoder = decoder;
+    self->fill = fill;
+    self->decoder_free = decoder_free;
+    self->buffer_size = buffer_size;
+    self->allocator = allocator;
+
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->cond, NULL);
+
+    self->buffers = fields_calloc(allocator, num_buffers,
+        sizeof(*self->buffers));
+    if (self->buffers == NULL) {
+        fields_ahead_destroy(self);
+        return NULL;
+    }
+
+    self->num_buffers = num_buffers;
+
+    for (i = 0; i < num_buffers; i++) {
+        self->buffers[i].data = fields_alloc(allocator, buffer_size);
+        if (self->buffers[i].data == NULL) {
+            fields_ahead_destroy(self);
+            return NULL;
+        }
+    }
+
+    if (pthread_create(&self->thread, NULL, &fields_ahead_work, self) != 0) {
+        fields_ahead_destroy(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+static int
+fields_ahead_read(void *source, const char **buffer, size_t *buffer_size)
+{
+    struct fields_ahead *self = source;
+    struct fields_ahead_buffer *current;
+    size_t consumed = self->consumed;
+
+    current = &self->buffers[consumed % self->num_buffers];
+
+    /*
+     * The reader may use the previous buffer until the next read, so hand
+     * it back to the I/O thread only now. The end of the input and errors
+     * are final: the I/O thread has stopped and the buffer is kept.
+     */
+    if (self->holding && !current->error && current->size > 0) {
+        fields_ahead_store(&self->consumed, ++consumed);
+        fields_ahead_signal(self, &self->producer_waiting);
+
+        self->holding = false;
+
+        current = &self->buffers[consumed % self->num_buffers];
+    }
+
+    if (!self->holding) {
+        while (fields_ahead_load(&self->filled) == consumed)
+            fields_ahead_wait(self, &self->consumer_waiting, &self->filled,
+                consumed);
+
+        self->holding = true;
+    }
+
+    if (current->error)
+        return FIELDS_FAILURE;
+
+    *buffer = current->data;
+    *buffer_size = current->size;
+
+    return 0;
+}
+
+static void
+fields_ahead_free(void *source)
+{
+    struct fields_ahead *self = source;
+
+    pthread_mutex_lock(&self->mutex);
+    __atomic_store_n(&self->stop, true, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&self->cond);
+    pthread_mutex_unlock(&self->mutex);
+
+    pthread_join(self->thread, NULL);
+
+    /*
+     * The source owns the decoder once it has been allocated.
+     */
+    if (self->decoder_free != NULL)
+        self->decoder_free(self->decoder);
+
+    fields_ahead_destroy(self);
+}
+
+static int
+fields_ahead_check(const struct fields_format *format,
+    const struct fields_settings *settings, unsigned int num_buffers)
+{
+    if (num_buffers < 2)
+        return FIELDS_FAILURE;
+
+    if (fields_format_error(format) != 0)
+        return FIELDS_FAILURE;
+
+    if (fields_settings_error(settings) != 0)
+        return FIELDS_FAILURE;
+
+    return 0;
+}
+
+static struct fields_reader *
+fields_ahead_reader(int fd, void *decoder, fields_ahead_fill_fn *fill,
+    fields_ahead_free_fn *decoder_free, const struct fields_format *format,
+    const struct fields_settings *settings, unsigned int num_buffers)
+{
+    struct fields_reader *reader;
+    struct fields_ahead *source;
+
+    source = fields_ahead_alloc(fd, decoder, fill, decoder_free,
+        settings->source_buffer_size, num_buffers,
+        fields_allocator(settings));
+    if (source == NULL) {
+        if (decoder_free != NULL)
+            decoder_free(decoder);
+        return NULL;
+    }
+
+    reader = fields_reader_alloc(source, &fields_ahead_read,
+        &fields_ahead_free, format, settings);
+    if (reader == NULL) {
+        fields_ahead_free(source);
+        return NULL;
+    }
+
     return reader;
 }
+
+struct fields_reader *
+fields_read_ahead(int fd, const struct fields_format *format,
+    const struct fields_settings *settings, unsigned int num_buffers)
+{
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    if (fields_ahead_check(format, settings, num_buffers) != 0)
+        return NULL;
+
+    return fields_ahead_reader(fd, NULL, &fields_ahead_read_fd, NULL, format,
+        settings, num_buffers);
+}
+
+/*
+ * Compressed Sources
+ * ==================
+ */
+
+/*
+ * A compressed source is a read-ahead source whose I/O thread decompresses
+ * the input into the ring of buffers, so that decompression and parsing run
+ * in parallel. Each buffer is filled completely before it is handed to the
+ * reader, except at the end of the input.
+ */
+#if defined(FIELDS_ZLIB) || defined(FIELDS_ZSTD)
+
+#define FIELDS_COMPRESSED_BUFFER_SIZE (128 * 1024)
+
+static ssize_t
+fields_compressed_read(int fd, void *buffer, size_t buffer_size)
+{
+    ssize_t result;
+
+    do {
+        result = read(fd, buffer, buffer_size);
+    } while (result == -1 && errno == EINTR);
+
+    return result;
+}
+
+#endif
+
+#ifdef FIELDS_ZLIB
+
+/*
+ * A gzip decoder inflates one gzip member after another, like `zcat`. Data
+ * in the zlib format is accepted too.
+ */
+struct fields_gzip {
+    z_stream                        stream;
+    unsigned char *                 input;
+    bool                            inside;
+    bool                            eof;
+    const struct fields_allocator * allocator;
+};
+
+static void
+fields_gzip_free(void *decoder)
+{
+    struct fields_gzip *self = decoder;
+    const struct fields_allocator *allocator = self->allocator;
+    unsigned char *input = self->input;
+
+    inflateEnd(&self->stream);
+
+    fields_free(allocator, self);
+    fields_free(allocator, input);
+}
+
+static struct fields_gzip *
+fields_gzip_alloc(const struct fields_allocator *allocator)
+{
+    struct fields_gzip *self;
+    unsigned char *input;
+
+    input = fields_alloc(allocator, FIELDS_COMPRESSED_BUFFER_SIZE);
+    if (input == NULL)
+        return NULL;
+
+    self = fields_calloc(allocator, 1, sizeof(*self));
+    if (self == NULL) {
+        fields_free(allocator, input);
+        return NULL;
+    }
+
+    self->input = input;
+    self->allocator = allocator;
+
+    /*
+     * Detect the gzip or the zlib header automatically.
+     */
+    if (inflateInit2(&self->stream, 15 + 32) != Z_OK) {
+        fields_free(allocator, self);
+        fields_free(allocator, input);
+        return NULL;
+    }
+
+    return self;
+}
+
+static int
+fields_gzip_fill(void *decoder, int fd, char *data, size_t size,
+    size_t *length)
+{
+    struct fields_gzip *self = decoder;
+    z_stream *stream = &self->stream;
+
+    if (size > UINT_MAX)
+        size = UINT_MAX;
+
+    stream->next_out = (Bytef *)data;
+    stream->avail_out = size;
+
+    while (stream->avail_out > 0) {
+        int status;
+
+        if (stream->avail_in == 0 && !self->eof) {
+            ssize_t result;
+
+            result = fields_compressed_read(fd, self->input,
+                FIELDS_COMPRESSED_BUFFER_SIZE);
+            if (result == -1)
+                return FIELDS_FAILURE;
+
+            stream->next_in = self->input;
+            stream->avail_in = result;
+
+            self->eof = result == 0;
+        }
+
+        if (stream->avail_in == 0 && self->eof && !self->inside)
+            break;
+
+        status = inflate(stream, Z_NO_FLUSH);
+
+        /*
+         * Input that ends in the middle of a member is truncated.
+         */
+        if (status == Z_STREAM_END) {
+            if (inflateReset(stream) != Z_OK)
+                return FIELDS_FAILURE;
+
+            self->inside = false;
+        }
+        else if (status == Z_OK)
+            self->inside = true;
+        else
+            return FIELDS_FAILURE;
+    }
+
+    *length = size - stream->avail_out;
+
+    return 0;
+}
+
+struct fields_reader *
+fields_read_gzip(int fd, const struct fields_format *format,
+    const struct fields_settings *settings, unsigned int num_buffers)
+{
+    struct fields_gzip *decoder;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    if (fields_ahead_check(format, settings, num_buffers) != 0)
+        return NULL;
+
+    decoder = fields_gzip_alloc(fields_allocator(settings));
+    if (decoder == NULL)
+        return NULL;
+
+    return fields_ahead_reader(fd, decoder, &fields_gzip_fill,
+        &fields_gzip_free, format, settings, num_buffers);
+}
+
+#else
+
+struct fields_reader *
+fields_read_gzip(int fd, const struct fields_format *format,
+    const struct fields_settings *settings, unsigned int num_buffers)
+{
+    (void)fd;
+    (void)format;
+    (void)settings;
+    (void)num_buffers;
+
+    return NULL;
+}
+
+#endif
+
+#ifdef FIELDS_ZSTD
+
+/*
+ * A Zstandard decoder decompresses one frame after another, like `zstdcat`.
+ */
+struct fields_zstd {
+    ZSTD_DStream *                  stream;
+    ZSTD_inBuffer                   input;
+    void *                          buffer;
+    size_t                          hint;
+    bool                            eof;
+    const struct fields_allocator * allocator;
+};
+
+static void
+fields_zstd_free(void *decoder)
+{
+    struct fields_zstd *self = decoder;
+    const struct fields_allocator *allocator = self->allocator;
+    void *buffer = self->buffer;
+
+    ZSTD_freeDStream(self->stream);
+
+    fields_free(allocator, self);
+    fields_free(allocator, buffer);
+}
+
+static struct fields_zstd *
+fields_zstd_alloc(const struct fields_allocator *allocator)
+{
+    struct fields_zstd *self;
+    void *buffer;
+
+    buffer = fields_alloc(allocator, FIELDS_COMPRESSED_BUFFER_SIZE);
+    if (buffer == NULL)
+        return NULL;
+
+    self = fields_calloc(allocator, 1, sizeof(*self));
+    if (self == NULL) {
+        fields_free(allocator, buffer);
+        return NULL;
+    }
+
+    self->buffer = buffer;
+    self->allocator = allocator;
+
+    self->stream = ZSTD_createDStream();
+    if (self->stream == NULL) {
+        fields_free(allocator, self);
+        fields_free(allocator, buffer);
+        return NULL;
+    }
+
+    if (ZSTD_isError(ZSTD_initDStream(self->stream))) {
+        fields_zstd_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+static int
+fields_zstd_fill(void *decoder, int fd, char *data, size_t size,
+    size_t *length)
+{
+    struct fields_zstd *self = decoder;
+    ZSTD_outBuffer output;
+
+    output.dst = data;
+    output.size = size;
+    output.pos = 0;
+
+    while (output.pos < output.size) {
+        size_t pos = output.pos;
+
+        if (self->input.pos == self->input.size && !self->eof) {
+            ssize_t result;
+
+            result = fields_compressed_read(fd, self->buffer,
+                FIELDS_COMPRESSED_BUFFER_SIZE);
+            if (result == -1)
+                return FIELDS_FAILURE;
+
+            self->input.src = self->buffer;
+            self->input.size = result;
+            self->input.pos = 0;
+
+            self->eof = result == 0;
+        }
+
+        /*
+         * A zero hint tells that a frame has been decoded and flushed.
+         */
+        if (self->input.pos == self->input.size && self->eof &&
+            self->hint == 0)
+            break;
+
+        self->hint = ZSTD_decompressStream(self->stream, &output,
+            &self->input);
+        if (ZSTD_isError(self->hint))
+            return FIELDS_FAILURE;
+
+        /*
+         * Input that ends in the middle of a frame is truncated.
+         */
+        if (self->input.pos == self->input.size && self->eof &&
+            output.pos == pos && self->hint != 0)
+            return FIELDS_FAILURE;
+    }
+
+    *length = output.pos;
+
+    return 0;
+}
+
+struct fields_reader *
+fields_read_zstd(int fd, const struct fields_format *format,
+    const struct fields_settings *settings, unsigned int num_buffers)
+{
+    struct fields_zstd *decoder;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    if (fields_ahead_check(format, settings, num_buffers) != 0)
+        return NULL;
+
+    decoder = fields_zstd_alloc(fields_allocator(settings));
+    if (decoder == NULL)
+        return NULL;
+
+    return fields_ahead_reader(fd, decoder, &fields_zstd_fill,
+        &fields_zstd_free, format, settings, num_buffers);
+}
+
+#else
+
+struct fields_reader *
+fields_read_zstd(int fd, const struct fields_format *format,
+    const struct fields_settings *settings, unsigned int num_buffers)
+{
+    (void)fd;
+    (void)format;
+    (void)settings;
+    (void)num_buffers;
+
+    return NULL;
+}
+
+#endif
+
+/*
+ * File Descriptor Sinks
+ * =====================
+ */
+
+struct fields_fd_sink {
+    int                             fd;
+    const struct fields_allocator * allocator;
+};
+
+static struct fields_fd_sink *
+fields_fd_sink_alloc(int fd, const struct fields_allocator *allocator)
+{
+    struct fields_fd_sink *self;
+
+    self = fields_alloc(allocator, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->fd = fd;
+    self->allocator = allocator;
+
+    return self;
+}
+
+static int
+fields_fd_sink_write(void *sink, const char *buffer, size_t buffer_size)
+{
+    struct fields_fd_sink *self = sink;
+
+    /*
+     * A write to a pipe or a socket may be partial.
+     */
+    while (buffer_size > 0) {
+        ssize_t size;
+
+        size = write(self->fd, buffer, buffer_size);
+        if (size == -1) {
+            if (errno == EINTR)
+                continue;
+
+            return FIELDS_FAILURE;
+        }
+
+        buffer += size;
+        buffer_size -= size;
+    }
+
+    return 0;
+}
+
+static void
+fields_fd_sink_free(void *sink)
+{
+    struct fields_fd_sink *self = sink;
+
+    fields_free(self->allocator, self);
+}
+
+struct fields_writer *
+fields_write_fd(int fd, const struct fields_format *format,
+    const struct fields_settings *settings)
+{
+    struct fields_writer *writer;
+    struct fields_fd_sink *sink;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    sink = fields_fd_sink_alloc(fd, fields_allocator(settings));
+    if (sink == NULL)
+        return NULL;
+
+    writer = fields_writer_alloc(sink, &fields_fd_sink_write,
+        &fields_fd_sink_free, format, settings);
+    if (writer == NULL) {
+        fields_fd_sink_free(sink);
+        return NULL;
+    }
+
+    return writer;
+}
+
+/*
+ * Index Sidecars
+ * ==============
+ */
+
+static int
+fields_index_stamp(int fd, struct fields_stamp *stamp)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+        return FIELDS_FAILURE;
+
+    stamp->size = st.st_size;
+
+    /*
+     * A modification within the same second changes the stamp only if the
+     * time has a finer resolution.
+     */
+#if defined(__APPLE__)
+    stamp->mtime = (uint64_t)st.st_mtime * 1000000000;
+#else
+    stamp->mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000 +
+        st.st_mtim.tv_nsec;
+#endif
+
+    return 0;
+}
+
+int
+fields_index_save_sidecar(const struct fields_index *index, const char *path,
+    int fd)
+{
+    struct fields_stamp stamp;
+    FILE *file;
+    int result;
+
+    if (fields_index_stamp(fd, &stamp) != 0)
+        return FIELDS_FAILURE;
+
+    file = fopen(path, "wb");
+    if (file == NULL)
+        return FIELDS_FAILURE;
+
+    result = fields_index_save(index, file, &stamp);
+
+    if (fclose(file) != 0)
+        result = FIELDS_FAILURE;
+
+    /*
+     * Leave no partial index behind.
+     */
+    if (result != 0)
+        remove(path);
+
+    return result;
+}
+
+struct fields_index *
+fields_index_load_sidecar(const char *path, int fd,
+    const struct fields_format *format, const struct fields_settings *settings)
+{
+    struct fields_index *index;
+    struct fields_stamp stamp;
+    FILE *file;
+
+    if (fields_index_stamp(fd, &stamp) != 0)
+        return NULL;
+
+    file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    index = fields_index_load(file, &stamp, format, settings);
+
+    fclose(file);
+
+    return index;
+}
+
+/*
+ * Chunks
+ * ======
+ */
+
+/*
+ * A chunk is a part of the input that begins at the beginning of a record
+ * and ends at the end of a record. The positions of the records within a
+ * chunk are relative to the beginning of the chunk.
+ */
+struct fields_chunk {
+    const char *                    buffer;
+    size_t                          buffer_size;
+    struct fields_batch *           batch;
+    struct fields_position *        positions;
+    size_t                          max_positions;
+    struct fields_position          position;
+    int                             error;
+    bool                            done;
+    const struct fields_allocator * allocator;
+};
+
+static int
+fields_chunk_init(struct fields_chunk *self,
+    const struct fields_settings *settings)
+{
+    self->allocator = fields_allocator(settings);
+
+    self->batch = fields_batch_alloc(settings);
+    if (self->batch == NULL)
+        return FIELDS_FAILURE;
+
+    self->max_positions = 1024;
+
+    self->positions = fields_alloc(self->allocator,
+        self->max_positions * sizeof(*self->positions));
+    if (self->positions == NULL) {
+        fields_batch_free(self->batch);
+        return FIELDS_FAILURE;
+    }
+
+    return 0;
+}
+
+static void
+fields_chunk_destroy(struct fields_chunk *self)
+{
+    fields_free(self->allocator, self->positions);
+    fields_batch_free(self->batch);
+}
+
+static int
+fields_chunk_push(struct fields_chunk *self, const struct fields_record *record,
+    const struct fields_position *position)
+{
+    size_t size = fields_batch_size(self->batch);
+
+    if (size == self->max_positions) {
+        struct fields_position *positions;
+
+        positions = fields_realloc(self->allocator, self->positions,
+            2 * self->max_positions * sizeof(*self->positions));
+        if (positions == NULL)
+            return FIELDS_FAILURE;
+
+        self->positions = positions;
+        self->max_positions *= 2;
+    }
+
+    if (fields_batch_push(self->batch, record) != 0)
+        return FIELDS_FAILURE;
+
+    self->positions[size] = *position;
+
+    return 0;
+}
+
+static void
+fields_chunk_parse(struct fields_chunk *self, struct fields_record *record,
+    const struct fields_format *format, const struct fields_settings *settings)
+{
+    struct fields_reader *reader;
+    struct fields_position position;
+
+    fields_batch_clear(self->batch);
+
+    reader = fields_read_buffer(self->buffer, self->buffer_size, format,
+        settings);
+    if (reader == NULL) {
+        self->error = FIELDS_READER_ERROR_UNREADABLE_SOURCE;
+        self->position.row = 1;
+        self->position.column = 0;
+        return;
+    }
+
+    while (fields_reader_read(reader, record) == 0) {
+        fields_reader_position(reader, &position);
+
+        if (fields_chunk_push(self, record, &position) != 0) {
+            self->error = FIELDS_READER_ERROR_TOO_BIG_RECORD;
+            self->position = position;
+            fields_reader_free(reader);
+            return;
+        }
+    }
+
+    self->error = fields_reader_error(reader);
+
+    fields_reader_position(reader, &self->position);
+
+    fields_reader_free(reader);
+}
+
+/*
+ * Parallel Readers
+ * ================
+ */
+
+struct fields_parallel;
+
+struct fields_worker {
+    struct fields_parallel *    parallel;
+    struct fields_record *      record;
+    pthread_t                   thread;
+};
+
+struct fields_parallel {
+    const char *            buffer;
+    size_t                  buffer_size;
+    const char *            split;
+    struct fields_format    format;
+    struct fields_settings  settings;
+    size_t *                projection;
+    struct fields_worker *  workers;
+    unsigned int            num_workers;
+    struct fields_chunk *   chunks;
+    size_t                  num_chunks;
+    size_t                  num_split;
+    size_t                  num_parsed;
+    size_t                  num_read;
+    bool                    stop;
+    pthread_mutex_t         mutex;
+    pthread_cond_t          split_cond;
+    pthread_cond_t          parsed_cond;
+    size_t                  index;
+    unsigned long           row;
+    struct fields_position  position;
+    int                     error;
+
+    const struct fields_allocator * allocator;
+};
+
+static const char *
+fields_parallel_boundary(const struct fields_parallel *self, const char *p)
+{
+    /*
+     * This function returns the beginning of the first record that begins
+     * at least `source_buffer_size` bytes after `p`, which must be the
+     * beginning of a record. A record separator ends a record only outside
+     * quoted fields. Whether a quote character opens or closes a quoted
+     * field follows from the number of quote characters before it.
+     */
+    const char *end = self->buffer + self->buffer_size;
+    const char *q;
+    char quote = self->format.quote;
+    bool quoted = false;
+
+    if ((size_t)(end - p) <= self->settings.source_buffer_size)
+        return end;
+
+    q = p + self->settings.source_buffer_size;
+
+    if (quote != '\0')
+        quoted = fields_count(p, self->settings.source_buffer_size,
+            quote) % 2 != 0;
+
+    /*
+     * Skip from one quote character, CR or LF to the next.
+     */
+    while (q != end) {
+        char ch;
+
+        q += fields_find_break(q, end - q, quote);
+        if (q == end)
+            break;
+
+        ch = *q++;
+
+        if (ch == quote && quote != '\0')
+            quoted = !quoted;
+        else if (!quoted) {
+            if (ch == FIELDS_CR && q != end && *q == FIELDS_LF)
+                q++;
+            break;
+        }
+    }
+
+    return q;
+}
+
+static void
+fields_parallel_split(struct fields_parallel *self)
+{
+    const char *end = self->buffer + self->buffer_size;
+    size_t num_split = self->num_split;
+
+    /*
+     * Only the reading thread splits the input. A chunk may be reused once
+     * its records have been read.
+     */
+    while ((self->split != end) &&
+        (num_split - self->num_read < self->num_chunks)) {
+        struct fields_chunk *chunk = &self->chunks[num_split % self->num_chunks];
+        const char *split = fields_parallel_boundary(self, self->split);
+
+        chunk->buffer = self->split;
+        chunk->buffer_size = split - self->split;
+        chunk->done = false;
+
+        self->split = split;
+        num_split++;
+    }
+
+    if (num_split == self->num_split)
+        return;
+
+    pthread_mutex_lock(&self->mutex);
+    self->num_split = num_split;
+    pthread_cond_broadcast(&self->split_cond);
+    pthread_mutex_unlock(&self->mutex);
+}
+
+static void *
+fields_parallel_work(void *arg)
+{
+    struct fields_worker *worker = arg;
+    struct fields_parallel *self = worker->parallel;
+
+    pthread_mutex_lock(&self->mutex);
+
+    while (true) {
+        struct fields_chunk *chunk;
+
+        while (!self->stop && self->num_parsed == self->num_split)
+            pthread_cond_wait(&self->split_cond, &self->mutex);
+
+        if (self->stop)
+            break;
+
+        chunk = &self->chunks[self->num_parsed++ % self->num_chunks];
+
+        pthread_mutex_unlock(&self->mutex);
+
+        fields_chunk_parse(chunk, worker->record, &self->format,
+            &self->settings);
+
+        pthread_mutex_lock(&self->mutex);
+
+        chunk->done = true;
+        pthread_cond_broadcast(&self->parsed_cond);
+    }
+
+    pthread_mutex_unlock(&self->mutex);
+
+    return NULL;
+}
+
+static void
+fields_parallel_stop(struct fields_parallel *self, unsigned int num_workers)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&self->mutex);
+    self->stop = true;
+    pthread_cond_broadcast(&self->split_cond);
+    pthread_mutex_unlock(&self->mutex);
+
+    for (i = 0; i < num_workers; i++)
+        pthread_join(self->workers[i].thread, NULL);
+}
+
+static void
+fields_parallel_destroy(struct fields_parallel *self)
+{
+    size_t i;
+
+    for (i = 0; i < self->num_chunks; i++)
+        fields_chunk_destroy(&self->chunks[i]);
+
+    for (i = 0; i < self->num_workers; i++)
+        fields_record_free(self->workers[i].record);
+
+    pthread_cond_destroy(&self->parsed_cond);
+    pthread_cond_destroy(&self->split_cond);
+    pthread_mutex_destroy(&self->mutex);
+
+    fields_free(self->allocator, self->workers);
+    fields_free(self->allocator, self->chunks);
+    fields_free(self->allocator, self->projection);
+    fields_free(self->allocator, self);
+}
+
+struct fields_parallel *
+fields_parallel_alloc(const char *buffer, size_t buffer_size,
+    const struct fields_format *format, const struct fields_settings *settings,
+    unsigned int num_threads)
+{
+    struct fields_parallel *self;
+    unsigned int i;
+
+    if (settings == NULL)
+        settings = &fields_defaults;
+
+    if (fields_format_error(format) != 0)
+        return NULL;
+
+    if (fields_settings_error(settings) != 0)
+        return NULL;
+
+    if (num_threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+        num_threads = online > 0 ? online : 1;
+    }
+
+    self = fields_calloc(fields_allocator(settings), 1, sizeof(*self));
+    if (self == NULL)
+        return NULL;
+
+    self->allocator = fields_allocator(settings);
+    self->buffer = buffer;
+    self->buffer_size = buffer_size;
+    self->split = buffer;
+    self->format = *format;
+    self->settings = *settings;
+    self->row = 1;
+
+    self->position.row = 1;
+    self->position.column = 0;
+
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->split_cond, NULL);
+    pthread_cond_init(&self->parsed_cond, NULL);
+
+    /*
+     * The workers allocate readers long after this function returns, so keep
+     * a copy of the projection.
+     */
+    if (settings->projection != NULL) {
+        size_t size = settings->projection_size * sizeof(size_t);
+
+        self->projection = fields_alloc(self->allocator, size > 0 ? size : 1);
+        if (self->projection == NULL) {
+            fields_parallel_destroy(self);
+            return NULL;
+        }
+
+        memcpy(self->projection, settings->projection, size);
+
+        self->settings.projection = self->projection;
+    }
+
+    self->chunks = fields_calloc(self->allocator, 2 * num_threads,
+        sizeof(*self->chunks));
+    self->workers = fields_calloc(self->allocator, num_threads,
+        sizeof(*self->workers));
+
+    if (self->chunks == NULL || self->workers == NULL) {
+        fields_parallel_destroy(self);
+        return NULL;
+    }
+
+    for (i = 0; i < 2 * num_threads; i++) {
+        if (fields_chunk_init(&self->chunks[i], &self->settings) != 0) {
+            fields_parallel_destroy(self);
+            return NULL;
+        }
+
+        self->num_chunks++;
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        struct fields_worker *worker = &self->workers[i];
+
+        worker->parallel = self;
+        worker->record = fields_record_alloc(&self->settings);
+        if (worker->record == NULL) {
+            fields_parallel_destroy(self);
+            return NULL;
+        }
+
+        self->num_workers++;
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        struct fields_worker *worker = &self->workers[i];
+
+        if (pthread_create(&worker->thread, NULL, &fields_parallel_work,
+            worker) != 0) {
+            fields_parallel_stop(self, i);
+            fields_parallel_destroy(self);
+            return NULL;
+        }
+    }
+
+    fields_parallel_split(self);
+
+    return self;
+}
+
+void
+fields_parallel_free(struct fields_parallel *self)
+{
+    fields_parallel_stop(self, self->num_workers);
+    fields_parallel_destroy(self);
+}
+
+int
+fields_parallel_read(struct fields_parallel *self,
+    struct fields_record *record)
+{
+    while (self->error == 0) {
+        struct fields_chunk *chunk;
+
+        if (self->num_read == self->num_split)
+            return FIELDS_FAILURE;
+
+        chunk = &self->chunks[self->num_read % self->num_chunks];
+
+        pthread_mutex_lock(&self->mutex);
+        while (!chunk->done)
+            pthread_cond_wait(&self->parsed_cond, &self->mutex);
+        pthread_mutex_unlock(&self->mutex);
+
+        if (self->index < fields_batch_size(chunk->batch)) {
+            const struct fields_position *position;
+
+            if (fields_batch_record(chunk->batch, self->index, record) != 0) {
+                self->error = FIELDS_READER_ERROR_TOO_MANY_FIELDS;
+                break;
+            }
+
+            position = &chunk->positions[self->index++];
+
+            self->position.row = self->row + position->row - 1;
+            self->position.column = position->column;
+
+            return 0;
+        }
+
+        if (chunk->error != 0) {
+            self->error = chunk->error;
+            self->position.row = self->row + chunk->position.row - 1;
+            self->position.column = chunk->position.column;
+            break;
+        }
+
+        /*
+         * Each chunk but the last one ends with a record separator, so the
+         * next chunk begins at the beginning of a row.
+         */
+        self->row += chunk->position.row - 1;
+        self->index = 0;
+        self->num_read++;
+
+        fields_parallel_split(self);
+    }
+
+    return FIELDS_FAILURE;
+}
+
+void
+fields_parallel_position(const struct fields_parallel *self,
+    struct fields_position *position)
+{
+    *position = self->position;
+}
+
+int
+fields_parallel_error(const struct fields_parallel *self)
+{
+    return self->error;
+}
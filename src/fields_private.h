@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2012 Jussi Virtanen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FIELDS_PRIVATE_H
+#define FIELDS_PRIVATE_H
+
+#include <stddef.h>
+
+#include "fields.h"
+
+/*
+ * The functions declared here are shared by the source files of the
+ * library but are not part of its interface. Keep them out of the symbols
+ * that a shared library exports, where the compiler allows.
+ */
+#if defined(__GNUC__) && !defined(_WIN32)
+#define FIELDS_INTERNAL __attribute__((visibility("hidden")))
+#else
+#define FIELDS_INTERNAL
+#endif
+
+/*
+ * Allocators
+ * ==========
+ *
+ * These functions are shared by the parts of the library. They allocate
+ * memory through an allocator object.
+ */
+
+/*
+ * Get the allocator of the settings. If the settings specify no allocator,
+ * the standard library allocator is used.
+ *
+ * - settings: a settings object
+ *
+ * Returns an allocator object.
+ */
+FIELDS_INTERNAL const struct fields_allocator *fields_allocator(
+    const struct fields_settings *);
+
+/*
+ * Allocate memory.
+ *
+ * - allocator: an allocator object
+ * - size:      the number of bytes
+ *
+ * If successful, returns a pointer to the memory. Otherwise returns `NULL`.
+ */
+FIELDS_INTERNAL void *fields_alloc(const struct fields_allocator *, size_t);
+
+/*
+ * Allocate zeroed memory for an array. The operation fails if the size of
+ * the array overflows.
+ *
+ * - allocator: an allocator object
+ * - count:     the number of elements
+ * - size:      the size of an element
+ *
+ * If successful, returns a pointer to the memory. Otherwise returns `NULL`.
+ */
+FIELDS_INTERNAL void *fields_calloc(const struct fields_allocator *, size_t,
+    size_t);
+
+/*
+ * Resize memory.
+ *
+ * - allocator: an allocator object
+ * - ptr:       a pointer to the memory or `NULL`
+ * - size:      the number of bytes
+ *
+ * If successful, returns a pointer to the memory. Otherwise returns `NULL`
+ * and leaves the memory intact.
+ */
+FIELDS_INTERNAL void *fields_realloc(const struct fields_allocator *, void *,
+    size_t);
+
+/*
+ * Deallocate memory. Does nothing if the pointer is `NULL`.
+ *
+ * - allocator: an allocator object
+ * - ptr:       a pointer to the memory or `NULL`
+ */
+FIELDS_INTERNAL void fields_free(const struct fields_allocator *, void *);
+
+/*
+ * Scanning
+ * ========
+ *
+ * These functions scan the input with vector instructions where available.
+ */
+
+/*
+ * Find the first quote character, CR or LF. If the quote character is `\0`,
+ * quoting is disabled and only CR and LF are looked for.
+ *
+ * - p:     a pointer to the input
+ * - n:     the number of bytes of input
+ * - quote: the quote character or `\0`
+ *
+ * Returns the index of the first byte found, or `n` if there is none.
+ */
+FIELDS_INTERNAL size_t fields_find_break(const char *, size_t, char);
+
+/*
+ * Count the occurrences of a character.
+ *
+ * - p:  a pointer to the input
+ * - n:  the number of bytes of input
+ * - ch: the character
+ *
+ * Returns the number of occurrences.
+ */
+FIELDS_INTERNAL size_t fields_count(const char *, size_t, char);
+
+#endif /* FIELDS_PRIVATE_H */